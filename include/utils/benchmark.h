@@ -0,0 +1,169 @@
+/*
+Benchmark utilities
+- OffscreenTarget class: framebuffer with color and depth/stencil renderbuffers, used to render without a visible window
+- BenchmarkLog class: per-frame record of CPU time, render statistics (see RenderStats) and GPU time of each profiler scope, written in a CSV file
+
+The GPU times of a frame are available only some frames later (see GPUProfiler): the log stores the CPU side of each frame, and the GPU columns are filled when the CSV is written, after GPUProfiler::Flush().
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/gpu_profiler.h>
+#include <utils/render_stats.h>
+
+/////////////////// OFFSCREENTARGET class ///////////////////////
+class OffscreenTarget
+{
+public:
+    GLuint FBO;
+    GLint width, height;
+
+    //////////////////////////////////////////
+    // constructor: we allocate a RGBA8 color buffer and a depth/stencil buffer (the application uses the stencil for the outlines)
+    OffscreenTarget(GLint width, GLint height)
+        : width(width), height(height)
+    {
+        glGenRenderbuffers(1, &this->colorBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &this->depthStencilBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, this->depthStencilBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &this->FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->colorBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, this->depthStencilBuffer);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::OFFSCREENTARGET:: Framebuffer is not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+    // following draw calls render in the offscreen buffers
+    void Bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glViewport(0, 0, this->width, this->height);
+    }
+
+    //////////////////////////////////////////
+    // resources are deallocated when application ends
+    void Delete()
+    {
+        glDeleteFramebuffers(1, &this->FBO);
+        glDeleteRenderbuffers(1, &this->colorBuffer);
+        glDeleteRenderbuffers(1, &this->depthStencilBuffer);
+    }
+
+private:
+    GLuint colorBuffer, depthStencilBuffer;
+};
+
+/////////////////// BENCHMARKLOG class ///////////////////////
+class BenchmarkLog
+{
+public:
+    //////////////////////////////////////////
+    BenchmarkLog(GLuint frames = 0)
+    {
+        this->rows.reserve(frames);
+    }
+
+    //////////////////////////////////////////
+    // we start the CPU timer of a frame
+    void BeginFrame()
+    {
+        this->frameStart = chrono::steady_clock::now();
+    }
+
+    //////////////////////////////////////////
+    // we store the CPU time and the render statistics of the frame. "frameNumber" must match the one recorded by the GPU profiler
+    void EndFrame(GLuint frameNumber, GLfloat simulatedTime, const RenderStats &stats)
+    {
+        BenchmarkRow row;
+        row.frame = frameNumber;
+        row.time = simulatedTime;
+        row.cpuMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - this->frameStart).count();
+        row.stats = stats;
+        this->rows.push_back(row);
+    }
+
+    //////////////////////////////////////////
+    // we write a row for each frame, with a column for each GPU profiler scope (empty if the GPU time is not available)
+    bool WriteCSV(const string &path, GPUProfiler &profiler)
+    {
+        ofstream file(path.c_str());
+        if(!file.is_open())
+        {
+            cout << "ERROR::BENCHMARKLOG:: Cannot write " << path << endl;
+            return false;
+        }
+
+        const vector<string> &scopes = profiler.ScopeNames();
+        file << "frame,time,cpu_ms,draw_calls,instanced_draws,triangles,program_binds,uniform_uploads,texture_binds,buffer_bytes,stencil_changes,culled_objects";
+        for(GLuint i = 0; i < scopes.size(); i++)
+            file << ",gpu_" << scopes[i] << "_ms";
+        file << ",gpu_total_ms\n";
+
+        GLfloat cpuSum = 0.0f, gpuSum = 0.0f;
+        GLuint gpuFrames = 0;
+        for(GLuint r = 0; r < this->rows.size(); r++)
+        {
+            BenchmarkRow &row = this->rows[r];
+            const RenderStats &s = row.stats;
+            file << row.frame << "," << row.time << "," << row.cpuMs << "," << s.drawCalls << "," << s.instancedDraws << "," << s.triangles << "," << s.programBinds << ","
+                 << s.uniformUploads << "," << s.textureBinds << "," << s.bufferBytes << "," << s.stencilChanges << "," << s.culledObjects;
+            cpuSum += row.cpuMs;
+
+            vector<GLfloat> times;
+            bool hasGPU = profiler.FrameTimes(row.frame, times);
+            GLfloat total = 0.0f;
+            for(GLuint i = 0; i < scopes.size(); i++)
+            {
+                file << ",";
+                if(hasGPU && times[i] >= 0.0f)
+                {
+                    file << times[i];
+                    total += times[i];
+                }
+            }
+            file << ",";
+            if(hasGPU)
+            {
+                file << total;
+                gpuSum += total;
+                gpuFrames++;
+            }
+            file << "\n";
+        }
+
+        cout << "Benchmark: " << this->rows.size() << " frames, average CPU " << (this->rows.empty() ? 0.0f : cpuSum / this->rows.size())
+             << " ms, average GPU " << (gpuFrames == 0 ? 0.0f : gpuSum / gpuFrames) << " ms (" << gpuFrames << " frames timed). Written to " << path << endl;
+        return true;
+    }
+
+private:
+    struct BenchmarkRow {
+        GLuint frame;
+        GLfloat time;
+        GLfloat cpuMs;
+        RenderStats stats;
+    };
+
+    vector<BenchmarkRow> rows;
+    chrono::steady_clock::time_point frameStart;
+};
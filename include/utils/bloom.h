@@ -0,0 +1,186 @@
+/*
+Bloom class
+- dual filter (dual Kawase) bloom of a HDR target, as passes of a RenderGraph: a chain of downsamples (each one halves the resolution), followed by a chain of upsamples back to the first level
+- the first downsample reads the scene at 1/divisor of its resolution, and it keeps only the bright part of the scene (soft threshold)
+- each pass samples few bilinear taps at half-texel offsets, which cover a wide area at low resolution: the cost is dominated by the first levels, so the divisor is the main tunable.
+  With the defaults (divisor 4, 4 taps) each chain (down or up) writes about 1/12 of the pixels of the scene: at 1080p the frame budget goes to the resolve and the post pass, which read and write the full resolution
+- the number of taps of the filters is a shader permutation (TAPS in bloomDown.frag and bloomUp.frag): 4 (diagonal taps only) or 8 (full dual filter: center and 4 diagonal taps down, 8 taps up)
+- the targets of the levels are transient targets of the graph (R11F_G11F_B10F, half the bandwidth of RGBA16F): the down and up targets of the same level share a framebuffer.
+  When divisor or levels change, the targets are resized and the passes of the unused levels are disabled (the graph is compiled again)
+
+Usage:
+    Bloom bloom(graph, hdrScene, width, height, downShaders, upShaders, fullscreen);    // after the passes writing hdrScene
+    graph.Read(tonemapPass, bloom.Result());                                           // the result is sampled with graph.Texture(bloom.Result())
+    ... in the render loop ...
+    bloom.Update();    // before graph.Execute()
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <algorithm>
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/shader_v1.h>
+#include <utils/render_graph.h>
+#include <utils/fullscreen_triangle.h>
+#include <utils/gl_state.h>
+
+// maximum number of levels of the chain
+const GLuint BLOOM_MAX_LEVELS = 6;
+
+/////////////////// BLOOM class ///////////////////////
+class Bloom
+{
+public:
+    // resolution of the first level = resolution of the scene / divisor
+    GLint divisor;
+    // levels of the chain (2 to BLOOM_MAX_LEVELS)
+    GLuint levels;
+    // taps of the filters: 4 or 8 (see TAPS in bloomDown.frag and bloomUp.frag)
+    GLuint taps;
+    // brightness where the bloom starts, and width of the soft transition around it
+    GLfloat threshold, knee;
+
+    //////////////////////////////////////////
+    // we add the passes of all the levels to the graph. downShaders and upShaders are the 4 and 8 taps permutations
+    Bloom(RenderGraph &graph, GLuint source, GLint width, GLint height, Shader* downShaders[2], Shader* upShaders[2], FullscreenTriangle &fullscreen)
+        : divisor(4), levels(5), taps(4), threshold(1.0f), knee(0.5f), graph(graph), source(source), width(width), height(height), fullscreen(fullscreen),
+          configuredLevels(0)
+    {
+        this->downShaders[0] = downShaders[0];
+        this->downShaders[1] = downShaders[1];
+        this->upShaders[0] = upShaders[0];
+        this->upShaders[1] = upShaders[1];
+
+        RenderState state = FullscreenState();
+        for(GLuint i = 0; i < BLOOM_MAX_LEVELS; i++)
+        {
+            this->downTargets.push_back(graph.CreateTarget("bloomDown" + to_string(i), RenderTargetDesc(1, 1, GL_R11F_G11F_B10F), 0));
+            // the passes of all the levels have the same name: the GPU profiler sums their times
+            GLuint pass = graph.AddPass("BLOOM DOWN", [this, i](){ this->Downsample(i); });
+            graph.Read(pass, i == 0 ? source : this->downTargets[i - 1]);
+            graph.Write(pass, this->downTargets[i]);
+            graph.SetState(pass, state);
+            this->downPasses.push_back(pass);
+        }
+        // up pass i reads level i+1, and writes level i (the passes are added from the deepest level)
+        this->upTargets.resize(BLOOM_MAX_LEVELS - 1);
+        this->upPasses.resize(BLOOM_MAX_LEVELS - 1);
+        for(GLint i = BLOOM_MAX_LEVELS - 2; i >= 0; i--)
+        {
+            this->upTargets[i] = graph.CreateTarget("bloomUp" + to_string(i), RenderTargetDesc(1, 1, GL_R11F_G11F_B10F), 0);
+            GLuint pass = graph.AddPass("BLOOM UP", [this, i](){ this->Upsample(i); });
+            graph.Write(pass, this->upTargets[i]);
+            graph.SetState(pass, state);
+            this->upPasses[i] = pass;
+        }
+        this->Update();
+    }
+
+    //////////////////////////////////////////
+    // target with the bloom (at 1/divisor of the scene resolution)
+    GLuint Result() { return this->upTargets[0]; }
+
+    //////////////////////////////////////////
+    // the scene has a new resolution
+    void Resize(GLint width, GLint height)
+    {
+        this->width = width;
+        this->height = height;
+    }
+
+    //////////////////////////////////////////
+    // we apply divisor and levels to the targets and the passes (the graph is compiled again only if something changed)
+    void Update()
+    {
+        this->divisor = max(this->divisor, 1);
+        this->levels = min(max(this->levels, (GLuint)2), BLOOM_MAX_LEVELS);
+        for(GLuint i = 0; i < BLOOM_MAX_LEVELS; i++)
+        {
+            GLint w, h;
+            this->LevelSize(i, w, h);
+            this->graph.ResizeTarget(this->downTargets[i], w, h);
+            if(i < BLOOM_MAX_LEVELS - 1)
+                this->graph.ResizeTarget(this->upTargets[i], w, h);
+            this->graph.SetEnabled(this->downPasses[i], i < this->levels);
+            if(i < BLOOM_MAX_LEVELS - 1)
+                this->graph.SetEnabled(this->upPasses[i], i + 1 < this->levels);
+        }
+        // the deepest upsample reads the last downsample, the others read the upsample of the level below
+        if(this->levels != this->configuredLevels)
+        {
+            for(GLuint i = 0; i < BLOOM_MAX_LEVELS - 1; i++)
+            {
+                this->graph.ClearReads(this->upPasses[i]);
+                this->graph.Read(this->upPasses[i], this->UpSource(i));
+            }
+            this->configuredLevels = this->levels;
+        }
+    }
+
+private:
+    RenderGraph &graph;
+    // HDR scene
+    GLuint source;
+    GLint width, height;
+    FullscreenTriangle &fullscreen;
+    Shader* downShaders[2];
+    Shader* upShaders[2];
+    vector<GLuint> downTargets, upTargets;
+    vector<GLuint> downPasses, upPasses;
+    // levels used for the reads of the up passes
+    GLuint configuredLevels;
+
+    //////////////////////////////////////////
+    void LevelSize(GLuint level, GLint &w, GLint &h)
+    {
+        w = max((this->width / this->divisor) >> level, 1);
+        h = max((this->height / this->divisor) >> level, 1);
+    }
+
+    GLuint UpSource(GLuint level)
+    {
+        return level + 2 == this->levels ? this->downTargets[level + 1] : this->upTargets[level + 1];
+    }
+
+    //////////////////////////////////////////
+    // we sample the source texture on unit 0, with the size of its texels
+    void BindSource(Shader &shader, GLuint texture, GLint w, GLint h)
+    {
+        shader.Use();
+        glState.ActiveTexture(GL_TEXTURE0);
+        glState.BindTexture(GL_TEXTURE_2D, texture);
+        shader.Uniform1i("source", 0);
+        shader.Uniform2f("texelSize", 1.0f / w, 1.0f / h);
+    }
+
+    //////////////////////////////////////////
+    void Downsample(GLuint level)
+    {
+        Shader &shader = *this->downShaders[this->taps == 8 ? 1 : 0];
+        GLint w = this->width, h = this->height;
+        if(level > 0)
+            this->LevelSize(level - 1, w, h);
+        this->BindSource(shader, this->graph.Texture(level == 0 ? this->source : this->downTargets[level - 1]), w, h);
+        shader.Uniform1i("prefilter", level == 0);
+        shader.Uniform1f("threshold", this->threshold);
+        shader.Uniform1f("knee", this->knee);
+        this->fullscreen.Draw();
+    }
+
+    //////////////////////////////////////////
+    void Upsample(GLuint level)
+    {
+        Shader &shader = *this->upShaders[this->taps == 8 ? 1 : 0];
+        GLint w, h;
+        this->LevelSize(level + 1, w, h);
+        this->BindSource(shader, this->graph.Texture(this->UpSource(level)), w, h);
+        this->fullscreen.Draw();
+    }
+};
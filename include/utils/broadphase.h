@@ -0,0 +1,130 @@
+/*
+Collision broadphase and narrowphase of the powerups
+- ZBroadphase class: the moving powerups, sorted along Z (the only axis they move on). A query returns only the powerups inside a Z window (e.g. the one overlapping the car), with two binary searches
+- NarrowPhase: AABB - sphere test of a batch of candidates, 4 at a time with SSE2 (scalar fallback)
+
+All the moving powerups are translated by the same amount in each step, and float addition is monotonic: their order along Z never changes, so the list is sorted once, when a powerup is inserted.
+New powerups enter at the far end of the street, and they are removed at the other end, so insertion and removal in the deque are cheap.
+The cost of a query does not depend on the number of powerups, only on the number of the ones inside the window.
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <cmath>
+
+// GL Includes (only for the types)
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <utils/entity_store.h>
+
+/////////////////// ZBROADPHASE class ///////////////////////
+class ZBroadphase
+{
+public:
+    //////////////////////////////////////////
+    void Clear()
+    {
+        this->sorted.clear();
+    }
+
+    GLuint Size()
+    {
+        return this->sorted.size();
+    }
+
+    //////////////////////////////////////////
+    // we insert a powerup at its place along Z. N.B.) it must be one of the moving powerups (see PowerUpStore::Advance)
+    void Insert(const PowerUpStore &pwUps, GLuint i)
+    {
+        ZLess less(pwUps);
+        this->sorted.insert(upper_bound(this->sorted.begin(), this->sorted.end(), pwUps.z[i], less), i);
+    }
+
+    //////////////////////////////////////////
+    // we remove a powerup. N.B.) it must be called before its position changes (e.g. before the respawn)
+    void Remove(const PowerUpStore &pwUps, GLuint i)
+    {
+        ZLess less(pwUps);
+        deque<GLuint>::iterator it = lower_bound(this->sorted.begin(), this->sorted.end(), pwUps.z[i], less);
+        // powerups with the same Z are next to each other
+        for(; it != this->sorted.end() && pwUps.z[*it] == pwUps.z[i]; ++it)
+        {
+            if(*it == i)
+            {
+                this->sorted.erase(it);
+                return;
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+    // we append to "candidates" the powerups with Z in [zMin, zMax], sorted by index (so the collisions are resolved in the same order of a linear scan)
+    void Query(const PowerUpStore &pwUps, GLfloat zMin, GLfloat zMax, vector<GLuint> &candidates)
+    {
+        ZLess less(pwUps);
+        deque<GLuint>::iterator first = lower_bound(this->sorted.begin(), this->sorted.end(), zMin, less);
+        deque<GLuint>::iterator last = upper_bound(first, this->sorted.end(), zMax, less);
+        GLuint start = candidates.size();
+        candidates.insert(candidates.end(), first, last);
+        sort(candidates.begin() + start, candidates.end());
+    }
+
+private:
+    // indices of the moving powerups, by increasing Z
+    deque<GLuint> sorted;
+
+    // comparison of the Z coordinates of the powerups with a value
+    struct ZLess {
+        const PowerUpStore &pwUps;
+        ZLess(const PowerUpStore &pwUps) : pwUps(pwUps) {}
+        bool operator()(GLuint i, GLfloat z) const { return this->pwUps.z[i] < z; }
+        bool operator()(GLfloat z, GLuint i) const { return z < this->pwUps.z[i]; }
+    };
+};
+
+//////////////////////////////////////////
+// AABB - sphere collision test of the candidates: we append to "hits" the ones colliding with the box.
+// The SSE2 and the scalar paths perform the same operations (the ones of glm::clamp and glm::length), so they give the same results
+void NarrowPhase(const PowerUpStore &pwUps, const vector<GLuint> &candidates, const glm::vec3 &boxCenter, const glm::vec3 &halfExtents, vector<GLuint> &hits)
+{
+    GLuint i = 0;
+    GLuint n = candidates.size();
+#ifdef ENTITY_SIMD
+    const __m128 cx = _mm_set1_ps(boxCenter.x), cy = _mm_set1_ps(boxCenter.y), cz = _mm_set1_ps(boxCenter.z);
+    const __m128 hx = _mm_set1_ps(halfExtents.x), hy = _mm_set1_ps(halfExtents.y), hz = _mm_set1_ps(halfExtents.z);
+    const __m128 radius = _mm_set1_ps(pwUps.radius);
+    for(; i + 4 <= n; i += 4)
+    {
+        const GLuint* c = &candidates[i];
+        // gather of the 4 sphere centers
+        __m128 px = _mm_setr_ps(pwUps.x[c[0]], pwUps.x[c[1]], pwUps.x[c[2]], pwUps.x[c[3]]);
+        __m128 py = _mm_setr_ps(pwUps.y[c[0]], pwUps.y[c[1]], pwUps.y[c[2]], pwUps.y[c[3]]);
+        __m128 pz = _mm_setr_ps(pwUps.z[c[0]], pwUps.z[c[1]], pwUps.z[c[2]], pwUps.z[c[3]]);
+        // closest point of the box to the center of the sphere, and its distance from the center
+        __m128 dx = _mm_sub_ps(_mm_add_ps(cx, _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), hx), _mm_min_ps(_mm_sub_ps(px, cx), hx))), px);
+        __m128 dy = _mm_sub_ps(_mm_add_ps(cy, _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), hy), _mm_min_ps(_mm_sub_ps(py, cy), hy))), py);
+        __m128 dz = _mm_sub_ps(_mm_add_ps(cz, _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), hz), _mm_min_ps(_mm_sub_ps(pz, cz), hz))), pz);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        int mask = _mm_movemask_ps(_mm_cmplt_ps(length, radius));
+        for(GLuint lane = 0; lane < 4; lane++)
+            if(mask & (1 << lane))
+                hits.push_back(c[lane]);
+    }
+#endif
+    for(; i < n; i++)
+    {
+        GLuint k = candidates[i];
+        glm::vec3 center(pwUps.x[k], pwUps.y[k], pwUps.z[k]);
+        glm::vec3 closest = boxCenter + glm::clamp(center - boxCenter, -halfExtents, halfExtents);
+        glm::vec3 difference = closest - center;
+        if(sqrt(difference.x * difference.x + difference.y * difference.y + difference.z * difference.z) < pwUps.radius)
+            hits.push_back(k);
+    }
+}
@@ -0,0 +1,245 @@
+/*
+CPU zone profiler
+- low overhead instrumentation of CPU code sections ("zones"), with begin and end timestamps taken from std::chrono::steady_clock
+- each thread writes its zones in its own ring buffer (no locks on the recording path): only the most recent CPU_PROFILER_EVENTS zones are kept
+- the last N seconds can be exported in the Chrome trace JSON format, readable by chrome://tracing and by Perfetto (ui.perfetto.dev)
+
+The instrumentation is compiled out in release builds (NDEBUG defined), unless CPU_PROFILER is defined.
+Zone names must be string literals (or strings living as long as the application), because only their pointer is stored.
+
+Usage:
+    void AubioCompute(...)
+    {
+        CPU_ZONE("AubioCompute");    // scoped zone, closed at the end of the block
+        ...
+    }
+
+    CPU_ZONE_BEGIN("PALM");          // explicit zone, for sections that are not a block
+    ...
+    CPU_ZONE_END();
+
+    CPUProfiler::DumpChromeTrace("trace.json", 10.0);
+*/
+
+#pragma once
+
+using namespace std;
+
+#if !defined(NDEBUG) || defined(CPU_PROFILER)
+    #define CPU_PROFILER_ENABLED
+#endif
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+
+// number of zones kept by each thread
+const unsigned int CPU_PROFILER_EVENTS = 1 << 16;
+
+// a completed zone. Times are in nanoseconds from the profiler start
+struct CPUZoneEvent {
+    const char* name;
+    long long begin;
+    long long end;
+    unsigned int depth;
+};
+
+// ring buffer of the zones recorded by a thread
+struct CPUZoneBuffer {
+    vector<CPUZoneEvent> events;
+    // total number of zones written (the ring index is count % CPU_PROFILER_EVENTS)
+    atomic<unsigned long long> count;
+    // open zones of the thread (for CPU_ZONE_BEGIN/CPU_ZONE_END)
+    vector<CPUZoneEvent> open;
+    unsigned int depth;
+    // thread id used in the trace
+    unsigned int tid;
+    string threadName;
+
+    CPUZoneBuffer() : events(CPU_PROFILER_EVENTS), count(0), depth(0), tid(0) {}
+};
+
+/////////////////// CPUPROFILER class ///////////////////////
+// static functions only: the state is shared by all the threads
+class CPUProfiler
+{
+public:
+    //////////////////////////////////////////
+    // nanoseconds from the first call
+    static long long Now()
+    {
+        static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    //////////////////////////////////////////
+    // ring buffer of the calling thread, created and registered the first time
+    static CPUZoneBuffer& ThreadBuffer()
+    {
+        thread_local CPUZoneBuffer* buffer = Register();
+        return *buffer;
+    }
+
+    //////////////////////////////////////////
+    // name shown in the trace for the calling thread
+    static void SetThreadName(const string &name)
+    {
+        ThreadBuffer().threadName = name;
+    }
+
+    //////////////////////////////////////////
+    // we store a completed zone in the ring buffer of the calling thread
+    static void Record(const char* name, long long begin, long long end, unsigned int depth)
+    {
+        CPUZoneBuffer &buffer = ThreadBuffer();
+        unsigned long long index = buffer.count.load(memory_order_relaxed);
+        CPUZoneEvent &event = buffer.events[index % CPU_PROFILER_EVENTS];
+        event.name = name;
+        event.begin = begin;
+        event.end = end;
+        event.depth = depth;
+        // the zone becomes visible to the exporter only after it has been written
+        buffer.count.store(index + 1, memory_order_release);
+    }
+
+    //////////////////////////////////////////
+    // explicit zones
+    static void Begin(const char* name)
+    {
+        CPUZoneBuffer &buffer = ThreadBuffer();
+        CPUZoneEvent event;
+        event.name = name;
+        event.depth = buffer.depth++;
+        event.begin = Now();
+        event.end = 0;
+        buffer.open.push_back(event);
+    }
+
+    static void End()
+    {
+        CPUZoneBuffer &buffer = ThreadBuffer();
+        if(buffer.open.empty())
+            return;
+        CPUZoneEvent event = buffer.open.back();
+        buffer.open.pop_back();
+        buffer.depth--;
+        Record(event.name, event.begin, Now(), event.depth);
+    }
+
+    //////////////////////////////////////////
+    // we write the zones ended in the last "seconds" seconds (of all the threads) in a Chrome trace JSON file
+    // N.B.) zones written by other threads during the export may be overwritten while we read them: dump when the workers are idle for exact results
+    static bool DumpChromeTrace(const string &path, double seconds)
+    {
+        ofstream file(path.c_str());
+        if(!file.is_open())
+        {
+            cout << "ERROR::CPUPROFILER:: Cannot write " << path << endl;
+            return false;
+        }
+
+        long long now = Now();
+        long long from = now - (long long)(seconds * 1e9);
+        unsigned int written = 0;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+        lock_guard<mutex> lock(Mutex());
+        vector<CPUZoneBuffer*> &buffers = Buffers();
+        for(unsigned int b = 0; b < buffers.size(); b++)
+        {
+            CPUZoneBuffer &buffer = *buffers[b];
+            // thread name metadata
+            if(written > 0)
+                file << ",\n";
+            file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer.tid
+                 << ",\"args\":{\"name\":\"" << buffer.threadName << "\"}}";
+            written++;
+
+            unsigned long long count = buffer.count.load(memory_order_acquire);
+            unsigned long long first = count > CPU_PROFILER_EVENTS ? count - CPU_PROFILER_EVENTS : 0;
+            for(unsigned long long i = first; i < count; i++)
+            {
+                const CPUZoneEvent &event = buffer.events[i % CPU_PROFILER_EVENTS];
+                if(event.end < from)
+                    continue;
+                // complete events ("X"), times in microseconds
+                file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer.tid
+                     << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+                written++;
+            }
+        }
+        file << "\n]}\n";
+
+        cout << "CPU trace (" << written << " events, last " << seconds << " s) written to " << path << endl;
+        return true;
+    }
+
+private:
+    //////////////////////////////////////////
+    static mutex& Mutex()
+    {
+        static mutex m;
+        return m;
+    }
+
+    static vector<CPUZoneBuffer*>& Buffers()
+    {
+        static vector<CPUZoneBuffer*> buffers;
+        return buffers;
+    }
+
+    //////////////////////////////////////////
+    // the buffers are never deallocated: the zones of terminated threads can still be exported
+    static CPUZoneBuffer* Register()
+    {
+        CPUZoneBuffer* buffer = new CPUZoneBuffer();
+        lock_guard<mutex> lock(Mutex());
+        buffer->tid = Buffers().size();
+        buffer->threadName = buffer->tid == 0 ? "main" : "thread " + to_string(buffer->tid);
+        Buffers().push_back(buffer);
+        return buffer;
+    }
+};
+
+//////////////////////////////////////////
+// scoped zone: it begins in the constructor and ends in the destructor
+class CPUZone
+{
+public:
+    CPUZone(const char* name) : name(name)
+    {
+        CPUZoneBuffer &buffer = CPUProfiler::ThreadBuffer();
+        this->depth = buffer.depth++;
+        this->begin = CPUProfiler::Now();
+    }
+
+    ~CPUZone()
+    {
+        long long end = CPUProfiler::Now();
+        CPUProfiler::ThreadBuffer().depth--;
+        CPUProfiler::Record(this->name, this->begin, end, this->depth);
+    }
+
+private:
+    const char* name;
+    long long begin;
+    unsigned int depth;
+};
+
+#ifdef CPU_PROFILER_ENABLED
+    #define CPU_ZONE_CONCAT_(a, b) a##b
+    #define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_(a, b)
+    #define CPU_ZONE(name) CPUZone CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+    #define CPU_ZONE_BEGIN(name) CPUProfiler::Begin(name)
+    #define CPU_ZONE_END() CPUProfiler::End()
+#else
+    #define CPU_ZONE(name)
+    #define CPU_ZONE_BEGIN(name)
+    #define CPU_ZONE_END()
+#endif
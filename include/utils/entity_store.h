@@ -0,0 +1,286 @@
+/*
+Entity storage for the gameplay
+- PowerUpStore class: structure-of-arrays storage of the powerups (separate x/y/z position arrays, outline scale and explosion timer arrays, one flags byte per powerup)
+- update kernels working on the whole set at once: scroll and spawning animation of the powerups, detection of the powerups to respawn, scroll and wrap of the palms
+- PowerUpPool class: free list of the waiting powerups (O(1) acquire and release), and queue of the beats waiting for a free powerup
+- each kernel has a SSE2 version (4 entities for each iteration) and a scalar version, which is the reference and the fallback when SSE2 is not available
+
+Both versions perform the same single precision operations, in the same order, so they give exactly the same results (and the same simulation states in a replay).
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+// GL Includes (only for the types)
+#include <glad/glad.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define ENTITY_SIMD
+    #include <emmintrin.h>
+#endif
+
+// bits of the flags byte of a powerup
+enum PowerUpFlag {
+    // the powerup is moving along the street (it stops when it passes the respawn threshold)
+    POWERUP_SPAWNING = 1 << 0,
+    // the spawning animation of the outline is over: the powerup is visible and it can be hit
+    POWERUP_SPAWNED = 1 << 1,
+    // the car hit the powerup (it is exploding)
+    POWERUP_HIT = 1 << 2,
+    // the powerup increases the speed (otherwise, it decreases it)
+    POWERUP_SPEEDUP = 1 << 3
+};
+
+/////////////////// POWERUPSTORE class ///////////////////////
+class PowerUpStore
+{
+public:
+    // positions
+    vector<GLfloat> x, y, z;
+    // scale of the outline, used during the spawning animation
+    vector<GLfloat> outlineScale;
+    // (simulation) time when the explosion starts
+    vector<GLfloat> explosionStart;
+    // PowerUpFlag bits
+    vector<uint8_t> flags;
+    // sphere collider radius (the same for all the powerups)
+    GLfloat radius;
+
+    //////////////////////////////////////////
+    PowerUpStore() : radius(0.0f) {}
+
+    //////////////////////////////////////////
+    GLuint Size() const
+    {
+        return this->flags.size();
+    }
+
+    void Resize(GLuint count)
+    {
+        this->x.resize(count, 0.0f);
+        this->y.resize(count, 0.0f);
+        this->z.resize(count, 0.0f);
+        this->outlineScale.resize(count, 0.0f);
+        this->explosionStart.resize(count, 0.0f);
+        this->flags.resize(count, 0);
+    }
+
+    //////////////////////////////////////////
+    // flags of a single powerup
+    bool Is(GLuint i, PowerUpFlag flag) const
+    {
+        return (this->flags[i] & flag) != 0;
+    }
+
+    void Set(GLuint i, PowerUpFlag flag, bool value)
+    {
+        if(value)
+            this->flags[i] |= flag;
+        else
+            this->flags[i] &= ~flag;
+    }
+
+    //////////////////////////////////////////
+    // scroll and spawning animation of all the spawning powerups:
+    // the outline shrinks by "shrink" until it reaches minScale (then the powerup is spawned), and the powerup moves by dz along Z
+    void Advance(GLfloat dz, GLfloat shrink, GLfloat minScale)
+    {
+        this->Advance(dz, shrink, minScale, 0, this->Size());
+    }
+
+    // the same, on the powerups in [first, last): separate ranges can be updated in parallel (see Simulation::jobs)
+    void Advance(GLfloat dz, GLfloat shrink, GLfloat minScale, GLuint first, GLuint last)
+    {
+        GLuint i = first;
+        GLuint n = last;
+#ifdef ENTITY_SIMD
+        const __m128 vdz = _mm_set1_ps(dz);
+        const __m128 vshrink = _mm_set1_ps(shrink);
+        const __m128 vmin = _mm_set1_ps(minScale);
+        const __m128i spawningBit = _mm_set1_epi32(POWERUP_SPAWNING);
+        const __m128i spawnedBit = _mm_set1_epi32(POWERUP_SPAWNED);
+        for(; i + 4 <= n; i += 4)
+        {
+            __m128i f = this->LoadFlags(i);
+            __m128 spawning = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(f, spawningBit), spawningBit));
+
+            __m128 scale = _mm_loadu_ps(&this->outlineScale[i]);
+            __m128 larger = _mm_cmpgt_ps(scale, vmin);
+            // spawning and still shrinking
+            __m128 shrinking = _mm_and_ps(spawning, larger);
+            // spawning and already at the minimum scale
+            __m128 done = _mm_andnot_ps(larger, spawning);
+            _mm_storeu_ps(&this->outlineScale[i], _mm_sub_ps(scale, _mm_and_ps(shrinking, vshrink)));
+
+            __m128 pz = _mm_loadu_ps(&this->z[i]);
+            _mm_storeu_ps(&this->z[i], _mm_add_ps(pz, _mm_and_ps(spawning, vdz)));
+
+            f = _mm_or_si128(f, _mm_and_si128(_mm_castps_si128(done), spawnedBit));
+            this->StoreFlags(i, f);
+        }
+#endif
+        this->AdvanceScalar(dz, shrink, minScale, i, n);
+    }
+
+    //////////////////////////////////////////
+    // scalar version of Advance, on the powerups in [first, last)
+    void AdvanceScalar(GLfloat dz, GLfloat shrink, GLfloat minScale, GLuint first, GLuint last)
+    {
+        for(GLuint i = first; i < last; i++)
+        {
+            if(!(this->flags[i] & POWERUP_SPAWNING))
+                continue;
+            if(this->outlineScale[i] > minScale)
+                this->outlineScale[i] -= shrink;
+            else
+                this->flags[i] |= POWERUP_SPAWNED;
+            this->z[i] += dz;
+        }
+    }
+
+    //////////////////////////////////////////
+    // we append to "passed" the indices of the spawning powerups beyond the threshold along Z
+    void FindPassed(GLfloat threshold, vector<GLuint> &passed)
+    {
+        GLuint i = 0;
+        GLuint n = this->Size();
+#ifdef ENTITY_SIMD
+        const __m128 vthreshold = _mm_set1_ps(threshold);
+        const __m128i spawningBit = _mm_set1_epi32(POWERUP_SPAWNING);
+        for(; i + 4 <= n; i += 4)
+        {
+            __m128 spawning = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(this->LoadFlags(i), spawningBit), spawningBit));
+            __m128 beyond = _mm_cmpgt_ps(_mm_loadu_ps(&this->z[i]), vthreshold);
+            int mask = _mm_movemask_ps(_mm_and_ps(spawning, beyond));
+            // most of the times no powerup passed the threshold
+            while(mask)
+            {
+                int lane = 0;
+                while(!(mask & (1 << lane)))
+                    lane++;
+                passed.push_back(i + lane);
+                mask &= ~(1 << lane);
+            }
+        }
+#endif
+        for(; i < n; i++)
+            if((this->flags[i] & POWERUP_SPAWNING) && this->z[i] > threshold)
+                passed.push_back(i);
+    }
+
+private:
+#ifdef ENTITY_SIMD
+    //////////////////////////////////////////
+    // 4 flags bytes expanded to 4 x 32 bit lanes
+    __m128i LoadFlags(GLuint i)
+    {
+        int32_t packed;
+        memcpy(&packed, &this->flags[i], sizeof(packed));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i f = _mm_cvtsi32_si128(packed);
+        f = _mm_unpacklo_epi8(f, zero);
+        return _mm_unpacklo_epi16(f, zero);
+    }
+
+    // 4 x 32 bit lanes packed back to 4 flags bytes (flags are < 128, so saturation never happens)
+    void StoreFlags(GLuint i, __m128i f)
+    {
+        f = _mm_packs_epi32(f, f);
+        f = _mm_packus_epi16(f, f);
+        int32_t packed = _mm_cvtsi128_si32(f);
+        memcpy(&this->flags[i], &packed, sizeof(packed));
+    }
+#endif
+};
+
+/////////////////// POWERUPPOOL class ///////////////////////
+class PowerUpPool
+{
+public:
+    // beats arrived when all the powerups were moving: they are served as soon as a powerup is released
+    GLuint queuedBeats;
+    // maximum number of queued beats (then the beats are dropped)
+    GLuint maxQueuedBeats;
+    // beats dropped since the beginning
+    GLuint droppedBeats;
+
+    //////////////////////////////////////////
+    PowerUpPool() : queuedBeats(0), maxQueuedBeats(0), droppedBeats(0) {}
+
+    //////////////////////////////////////////
+    // empty pool for "capacity" powerups (all of them in use), with a queue of the same length
+    void Reset(GLuint capacity)
+    {
+        this->freeSlots.clear();
+        this->freeSlots.reserve(capacity);
+        this->queuedBeats = 0;
+        this->maxQueuedBeats = capacity;
+        this->droppedBeats = 0;
+    }
+
+    //////////////////////////////////////////
+    // a powerup is waiting again
+    void Release(GLuint i)
+    {
+        this->freeSlots.push_back(i);
+    }
+
+    //////////////////////////////////////////
+    // we take a waiting powerup. It returns false if all of them are in use
+    bool Acquire(GLuint &i)
+    {
+        if(this->freeSlots.empty())
+            return false;
+        i = this->freeSlots.back();
+        this->freeSlots.pop_back();
+        return true;
+    }
+
+    //////////////////////////////////////////
+    void QueueBeat()
+    {
+        if(this->queuedBeats < this->maxQueuedBeats)
+            this->queuedBeats++;
+        else
+            this->droppedBeats++;
+    }
+
+    GLuint FreeCount() const
+    {
+        return this->freeSlots.size();
+    }
+
+private:
+    // stack of the waiting powerups
+    vector<GLuint> freeSlots;
+};
+
+//////////////////////////////////////////
+// we move "count" values by dz, and the ones beyond "limit" are moved back to "reset" (e.g. the Z coordinates of the palms)
+void ScrollAndWrap(GLfloat* values, GLuint count, GLfloat dz, GLfloat limit, GLfloat reset)
+{
+    GLuint i = 0;
+#ifdef ENTITY_SIMD
+    const __m128 vdz = _mm_set1_ps(dz);
+    const __m128 vlimit = _mm_set1_ps(limit);
+    const __m128 vreset = _mm_set1_ps(reset);
+    for(; i + 4 <= count; i += 4)
+    {
+        __m128 v = _mm_add_ps(_mm_loadu_ps(values + i), vdz);
+        __m128 beyond = _mm_cmpgt_ps(v, vlimit);
+        _mm_storeu_ps(values + i, _mm_or_ps(_mm_and_ps(beyond, vreset), _mm_andnot_ps(beyond, v)));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        values[i] += dz;
+        if(values[i] > limit)
+            values[i] = reset;
+    }
+}
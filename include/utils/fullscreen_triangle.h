@@ -0,0 +1,47 @@
+/*
+FullscreenTriangle class
+- draw of a single triangle covering the whole viewport, for the post-processing passes (the vertices are generated from gl_VertexID in fullscreen.vert)
+- no vertex buffer is needed, but the Core profile needs a VAO bound to draw: the class owns an empty one
+
+Usage:
+    FullscreenTriangle fullscreen;    // after the creation of the OpenGL context
+    shader.Use();                     // e.g., fullscreen.vert + a post-process fragment shader
+    fullscreen.Draw();
+*/
+
+#pragma once
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/render_stats.h>
+#include <utils/gl_state.h>
+
+/////////////////// FULLSCREENTRIANGLE class ///////////////////////
+class FullscreenTriangle
+{
+public:
+    //////////////////////////////////////////
+    FullscreenTriangle()
+    {
+        glGenVertexArrays(1, &this->VAO);
+    }
+
+    //////////////////////////////////////////
+    void Draw()
+    {
+        glState.BindVertexArray(this->VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        CountDraw(GL_TRIANGLES, 3);
+    }
+
+    //////////////////////////////////////////
+    // the VAO is deleted when application ends
+    void Delete()
+    {
+        glState.DeleteVertexArray(this->VAO);
+    }
+
+private:
+    GLuint VAO;
+};
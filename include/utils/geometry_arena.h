@@ -0,0 +1,186 @@
+/*
+GeometryArena class
+- a single vertex buffer and a single index buffer (with one VAO, and a second one for the instanced draws) for the static geometry of all the models: binding a model does not change the VAO or the buffers
+- each mesh added to the arena is a range of indices, relative to its base vertex: it is drawn with glDrawElementsBaseVertex (see Mesh)
+- a draw command (DrawElementsIndirectCommand) is stored for each range, in the order of Add: consecutive ranges (e.g., all the meshes of a model) can be drawn with a single glMultiDrawElementsIndirect call (OpenGL 4.3 or GL_ARB_multi_draw_indirect).
+  Otherwise, MultiDraw issues a glDrawElementsBaseVertex call for each range, with the VAO bound once
+
+Usage:
+    GeometryArena arena;                         // after the creation of the OpenGL context
+    arena.EnableMultiDrawIndirect(multiDraw);    // optional: glMultiDrawElementsIndirect
+    model.Upload(&arena);                        // the meshes of the model are added to the arena
+    arena.Upload();                              // after all the models: creation of the buffers
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <iostream>
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/mesh_v2.h>
+#include <utils/render_stats.h>
+
+// glMultiDrawElementsIndirect is not loaded by glad (OpenGL 4.3): the application passes the function pointer
+#ifndef GL_VERSION_4_3
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+#endif
+
+// range of the arena: indices (in the index buffer) of a mesh, with its base vertex, and its draw command
+struct ArenaRange {
+    GLuint firstIndex, indexCount;
+    GLint baseVertex;
+    GLuint command;
+};
+
+// layout of the commands read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/////////////////// GEOMETRYARENA class ///////////////////////
+class GeometryArena
+{
+public:
+    // the VAO of all the meshes in the arena, and the one of their instanced draws (same buffers, plus the instance attributes set by Mesh::SetInstanceMatrices)
+    GLuint VAO, instancedVAO;
+    // vertices and indices added to the arena
+    GLuint vertexCount, indexCount;
+    // the ranges are drawn with glMultiDrawElementsIndirect
+    bool multiDrawIndirect;
+
+    //////////////////////////////////////////
+    // N.B.) it must be created after the OpenGL context
+    GeometryArena()
+        : vertexCount(0), indexCount(0), multiDrawIndirect(false), indirectBuffer(0), multiDrawElementsIndirect(NULL)
+    {
+        glGenVertexArrays(1, &this->VAO);
+        glGenVertexArrays(1, &this->instancedVAO);
+        glGenBuffers(1, &this->VBO);
+        glGenBuffers(1, &this->EBO);
+    }
+
+    //////////////////////////////////////////
+    // the pointer to glMultiDrawElementsIndirect, if available (before Upload)
+    void EnableMultiDrawIndirect(PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDraw)
+    {
+        this->multiDrawElementsIndirect = multiDraw;
+        this->multiDrawIndirect = multiDraw != NULL;
+    }
+
+    //////////////////////////////////////////
+    // we add a mesh to the arena (only on the CPU side, the buffers are created in Upload). The indices are relative to the first vertex of the mesh
+    ArenaRange Add(const vector<Vertex> &vertices, const vector<GLuint> &indices)
+    {
+        ArenaRange range;
+        range.firstIndex = this->indices.size();
+        range.indexCount = indices.size();
+        range.baseVertex = this->vertices.size();
+        range.command = this->commands.size();
+        this->vertices.insert(this->vertices.end(), vertices.begin(), vertices.end());
+        this->indices.insert(this->indices.end(), indices.begin(), indices.end());
+
+        DrawElementsIndirectCommand command;
+        command.count = range.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = 0;
+        this->commands.push_back(command);
+
+        this->vertexCount = this->vertices.size();
+        this->indexCount = this->indices.size();
+        return range;
+    }
+
+    //////////////////////////////////////////
+    // creation of the buffers with all the added meshes. The CPU copies of vertices and indices are deallocated
+    void Upload()
+    {
+        if(this->vertices.empty())
+        {
+            cout << "ERROR::GEOMETRYARENA:: No meshes added to the arena" << endl;
+            return;
+        }
+        glState.BindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+        Mesh::SetVertexAttributes();
+        // the instanced draws have their own VAO: the instance data in the stream buffer are never referenced by the VAO of the other draws
+        glState.BindVertexArray(this->instancedVAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+        Mesh::SetVertexAttributes();
+        glState.BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        if(this->multiDrawIndirect)
+        {
+            glGenBuffers(1, &this->indirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, this->commands.size() * sizeof(DrawElementsIndirectCommand), &this->commands[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+
+        vector<Vertex>().swap(this->vertices);
+        vector<GLuint>().swap(this->indices);
+    }
+
+    //////////////////////////////////////////
+    // we draw "count" consecutive ranges, starting from the one with command "first" (e.g., all the meshes of a model). No textures are bound
+    void MultiDraw(GLuint first, GLuint count)
+    {
+        glState.BindVertexArray(this->VAO);
+        if(this->multiDrawIndirect)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            this->multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)(size_t)(first * sizeof(DrawElementsIndirectCommand)), count, 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            // a single draw call, with the indices of all the ranges
+            GLuint indices = 0;
+            for(GLuint i = first; i < first + count; i++)
+                indices += this->commands[i].count;
+            CountDraw(GL_TRIANGLES, indices);
+        }
+        else
+        {
+            for(GLuint i = first; i < first + count; i++)
+            {
+                const DrawElementsIndirectCommand &command = this->commands[i];
+                glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (GLvoid*)(size_t)(command.firstIndex * sizeof(GLuint)), command.baseVertex);
+                CountDraw(GL_TRIANGLES, command.count);
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+    // buffers are deleted when application ends
+    void Delete()
+    {
+        glState.DeleteVertexArray(this->VAO);
+        glState.DeleteVertexArray(this->instancedVAO);
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteBuffers(1, &this->EBO);
+        if(this->indirectBuffer)
+            glDeleteBuffers(1, &this->indirectBuffer);
+        this->indirectBuffer = 0;
+    }
+
+private:
+    GLuint VBO, EBO, indirectBuffer;
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect;
+    // data of the added meshes (until Upload), and draw commands of the ranges
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    vector<DrawElementsIndirectCommand> commands;
+};
@@ -0,0 +1,324 @@
+/*
+GLState class
+- thin layer over the OpenGL state changes: it shadows the current state (program, VAO, active texture unit and textures bound on each unit,
+  enabled capabilities, depth, stencil and blending functions, write masks, polygon mode), and it drops the calls that would not change it
+- the calls issued to the driver and the filtered ones are counted for each kind of state, and the counters of the last frame are kept (see BeginFrame)
+- the state is unknown at the beginning and after Invalidate: the first call of each kind is always issued
+- the code changing the state without GLState must restore it (e.g., ImGui does it at the end of its rendering), or call Invalidate
+- programs, textures and VAOs must be deleted with DeleteProgram, DeleteTexture and DeleteVertexArray: OpenGL can reuse their names for new objects
+
+Usage:
+    glState.UseProgram(program);
+    glState.ActiveTexture(GL_TEXTURE1);
+    glState.BindTexture(GL_TEXTURE_2D, texture);
+    glState.Enable(GL_DEPTH_TEST);
+    ...
+    glState.BeginFrame();    // issued and filtered calls of the last frame are in lastIssued and lastFiltered
+*/
+
+#pragma once
+
+// GL Includes
+#include <glad/glad.h>
+
+// program, texture and stencil changes issued to the driver are counted in the render statistics
+#include <utils/render_stats.h>
+
+// kinds of state changes, for the counters
+enum GLStateKind {
+    GL_STATE_PROGRAM,
+    GL_STATE_VERTEX_ARRAY,
+    GL_STATE_TEXTURE,
+    GL_STATE_CAPABILITY,
+    GL_STATE_DEPTH,
+    GL_STATE_STENCIL,
+    GL_STATE_BLEND,
+    GL_STATE_POLYGON_MODE,
+    GL_STATE_KINDS
+};
+
+const char* const GL_STATE_KIND_NAMES[GL_STATE_KINDS] = {"Program", "Vertex array", "Texture", "Enable/Disable", "Depth", "Stencil", "Blend", "Polygon mode"};
+
+// texture units and targets shadowed (the other ones are always issued)
+const GLuint GL_STATE_TEXTURE_UNITS = 32;
+const GLuint GL_STATE_TEXTURE_TARGETS = 4;
+
+/////////////////// GLSTATE class ///////////////////////
+class GLState
+{
+public:
+    // calls of the last frame, issued to the driver and filtered, for each kind of state
+    GLuint lastIssued[GL_STATE_KINDS], lastFiltered[GL_STATE_KINDS];
+
+    //////////////////////////////////////////
+    GLState()
+    {
+        for(GLuint k = 0; k < GL_STATE_KINDS; k++)
+            this->issued[k] = this->filtered[k] = this->lastIssued[k] = this->lastFiltered[k] = 0;
+        this->Invalidate();
+    }
+
+    //////////////////////////////////////////
+    // the shadowed state is forgotten: the next calls are all issued
+    void Invalidate()
+    {
+        this->program = UNKNOWN;
+        this->vertexArray = UNKNOWN;
+        this->activeUnit = UNKNOWN;
+        for(GLuint u = 0; u < GL_STATE_TEXTURE_UNITS; u++)
+            for(GLuint t = 0; t < GL_STATE_TEXTURE_TARGETS; t++)
+                this->textures[u][t] = UNKNOWN;
+        for(GLuint c = 0; c < CAPABILITIES; c++)
+            this->capabilities[c] = UNKNOWN;
+        this->depthFunc = this->depthMask = UNKNOWN;
+        this->stencilFunc = this->stencilRef = this->stencilReadMask = this->stencilWriteMask = UNKNOWN;
+        this->stencilFail = this->stencilDepthFail = this->stencilPass = UNKNOWN;
+        this->blendSrc = this->blendDst = UNKNOWN;
+        this->polygonMode = UNKNOWN;
+    }
+
+    //////////////////////////////////////////
+    // the counters of the frame just ended become the ones of the last frame
+    void BeginFrame()
+    {
+        for(GLuint k = 0; k < GL_STATE_KINDS; k++)
+        {
+            this->lastIssued[k] = this->issued[k];
+            this->lastFiltered[k] = this->filtered[k];
+            this->issued[k] = this->filtered[k] = 0;
+        }
+    }
+
+    //////////////////////////////////////////
+    void UseProgram(GLuint program)
+    {
+        if(this->Changed(GL_STATE_PROGRAM, this->program, program))
+        {
+            renderStats.programBinds++;
+            glUseProgram(program);
+        }
+    }
+
+    //////////////////////////////////////////
+    // a program in use is deleted only when another one is used: its name must not be considered current after that
+    void DeleteProgram(GLuint program)
+    {
+        glDeleteProgram(program);
+        if(this->program == program)
+            this->program = UNKNOWN;
+    }
+
+    //////////////////////////////////////////
+    void BindVertexArray(GLuint vertexArray)
+    {
+        if(this->Changed(GL_STATE_VERTEX_ARRAY, this->vertexArray, vertexArray))
+            glBindVertexArray(vertexArray);
+    }
+
+    //////////////////////////////////////////
+    // "unit" is GL_TEXTURE0 + index, like glActiveTexture
+    void ActiveTexture(GLenum unit)
+    {
+        if(this->Changed(GL_STATE_TEXTURE, this->activeUnit, unit))
+            glActiveTexture(unit);
+    }
+
+    //////////////////////////////////////////
+    // binding on the active unit
+    void BindTexture(GLenum target, GLuint texture)
+    {
+        GLuint* bound = this->Binding(target);
+        if(bound && !this->Changed(GL_STATE_TEXTURE, *bound, texture))
+            return;
+        if(!bound)
+            this->issued[GL_STATE_TEXTURE]++;
+        renderStats.textureBinds++;
+        glBindTexture(target, texture);
+    }
+
+    //////////////////////////////////////////
+    // the texture is removed from all the units (OpenGL binds 0 where it was bound)
+    void DeleteTexture(GLuint texture)
+    {
+        glDeleteTextures(1, &texture);
+        for(GLuint u = 0; u < GL_STATE_TEXTURE_UNITS; u++)
+            for(GLuint t = 0; t < GL_STATE_TEXTURE_TARGETS; t++)
+                if(this->textures[u][t] == texture)
+                    this->textures[u][t] = 0;
+    }
+
+    //////////////////////////////////////////
+    void DeleteVertexArray(GLuint vertexArray)
+    {
+        glDeleteVertexArrays(1, &vertexArray);
+        if(this->vertexArray == vertexArray)
+            this->vertexArray = 0;
+    }
+
+    //////////////////////////////////////////
+    // glEnable and glDisable of the shadowed capabilities
+    void Enable(GLenum capability) { this->Set(capability, true); }
+    void Disable(GLenum capability) { this->Set(capability, false); }
+
+    void Set(GLenum capability, bool enabled)
+    {
+        GLuint c = CapabilityIndex(capability);
+        if(c == CAPABILITIES)
+        {
+            this->issued[GL_STATE_CAPABILITY]++;
+            enabled ? glEnable(capability) : glDisable(capability);
+        }
+        else if(this->Changed(GL_STATE_CAPABILITY, this->capabilities[c], enabled ? 1 : 0))
+            enabled ? glEnable(capability) : glDisable(capability);
+    }
+
+    //////////////////////////////////////////
+    void DepthFunc(GLenum func)
+    {
+        if(this->Changed(GL_STATE_DEPTH, this->depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    void DepthMask(GLboolean mask)
+    {
+        if(this->Changed(GL_STATE_DEPTH, this->depthMask, mask))
+            glDepthMask(mask);
+    }
+
+    //////////////////////////////////////////
+    void StencilFunc(GLenum func, GLint ref, GLuint mask)
+    {
+        bool same = this->stencilFunc == func && this->stencilRef == (GLuint)ref && this->stencilReadMask == mask;
+        if(this->Count(GL_STATE_STENCIL, same))
+        {
+            this->stencilFunc = func;
+            this->stencilRef = ref;
+            this->stencilReadMask = mask;
+            renderStats.stencilChanges++;
+            glStencilFunc(func, ref, mask);
+        }
+    }
+
+    void StencilMask(GLuint mask)
+    {
+        if(this->Changed(GL_STATE_STENCIL, this->stencilWriteMask, mask))
+        {
+            renderStats.stencilChanges++;
+            glStencilMask(mask);
+        }
+    }
+
+    void StencilOp(GLenum fail, GLenum depthFail, GLenum pass)
+    {
+        bool same = this->stencilFail == fail && this->stencilDepthFail == depthFail && this->stencilPass == pass;
+        if(this->Count(GL_STATE_STENCIL, same))
+        {
+            this->stencilFail = fail;
+            this->stencilDepthFail = depthFail;
+            this->stencilPass = pass;
+            renderStats.stencilChanges++;
+            glStencilOp(fail, depthFail, pass);
+        }
+    }
+
+    //////////////////////////////////////////
+    void BlendFunc(GLenum src, GLenum dst)
+    {
+        bool same = this->blendSrc == src && this->blendDst == dst;
+        if(this->Count(GL_STATE_BLEND, same))
+        {
+            this->blendSrc = src;
+            this->blendDst = dst;
+            glBlendFunc(src, dst);
+        }
+    }
+
+    //////////////////////////////////////////
+    // only GL_FRONT_AND_BACK is valid in the core profile
+    void PolygonMode(GLenum mode)
+    {
+        if(this->Changed(GL_STATE_POLYGON_MODE, this->polygonMode, mode))
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+
+    //////////////////////////////////////////
+    // current values of the shadowed state (UNKNOWN if not known)
+    GLuint Program() const { return this->program; }
+    GLuint PolygonModeValue() const { return this->polygonMode; }
+
+    // value of the shadowed state not set after the last Invalidate
+    static const GLuint UNKNOWN = 0xFFFFFFFF;
+
+private:
+    // calls of the current frame
+    GLuint issued[GL_STATE_KINDS], filtered[GL_STATE_KINDS];
+
+    // shadowed capabilities
+    static const GLuint CAPABILITIES = 6;
+
+    GLuint program, vertexArray, activeUnit;
+    GLuint textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+    GLuint capabilities[CAPABILITIES];
+    GLuint depthFunc, depthMask;
+    GLuint stencilFunc, stencilRef, stencilReadMask, stencilWriteMask;
+    GLuint stencilFail, stencilDepthFail, stencilPass;
+    GLuint blendSrc, blendDst;
+    GLuint polygonMode;
+
+    //////////////////////////////////////////
+    // we count the call, and we update the shadowed value: true if the call must be issued
+    bool Changed(GLStateKind kind, GLuint &current, GLuint value)
+    {
+        if(!this->Count(kind, current == value))
+            return false;
+        current = value;
+        return true;
+    }
+
+    bool Count(GLStateKind kind, bool same)
+    {
+        if(same)
+        {
+            this->filtered[kind]++;
+            return false;
+        }
+        this->issued[kind]++;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // shadowed binding of the target on the active unit (NULL if not shadowed)
+    GLuint* Binding(GLenum target)
+    {
+        if(this->activeUnit == UNKNOWN || this->activeUnit - GL_TEXTURE0 >= GL_STATE_TEXTURE_UNITS)
+            return NULL;
+        GLuint t;
+        switch(target)
+        {
+            case GL_TEXTURE_2D: t = 0; break;
+            case GL_TEXTURE_CUBE_MAP: t = 1; break;
+            case GL_TEXTURE_2D_MULTISAMPLE: t = 2; break;
+            case GL_TEXTURE_3D: t = 3; break;
+            default: return NULL;
+        }
+        return &this->textures[this->activeUnit - GL_TEXTURE0][t];
+    }
+
+    //////////////////////////////////////////
+    static GLuint CapabilityIndex(GLenum capability)
+    {
+        switch(capability)
+        {
+            case GL_DEPTH_TEST: return 0;
+            case GL_STENCIL_TEST: return 1;
+            case GL_BLEND: return 2;
+            case GL_CULL_FACE: return 3;
+            case GL_MULTISAMPLE: return 4;
+            case GL_RASTERIZER_DISCARD: return 5;
+            default: return CAPABILITIES;
+        }
+    }
+};
+
+// state of the OpenGL context of the application
+GLState glState;
@@ -0,0 +1,332 @@
+/*
+GPUProfiler class
+- measurement of the GPU time spent in named sections (scopes) of the frame, using GL_TIMESTAMP queries
+- results are read back with a delay of GPU_PROFILER_FRAMES frames, checking GL_QUERY_RESULT_AVAILABLE: the CPU never waits for the GPU
+- rolling statistics (min, average, 99th percentile) over the last frames, and dump of the history to a CSV file
+
+Timestamps (glQueryCounter) are used instead of GL_TIME_ELAPSED queries because the latter cannot be nested, while scopes can.
+If a scope is opened more than once in the same frame, its times are summed.
+
+Usage:
+    profiler.BeginFrame();
+    profiler.Begin("NEONGRID");
+    ... GL calls ...
+    profiler.End();
+    profiler.EndFrame();
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// GL Includes
+#include <glad/glad.h>
+
+// number of frames between the queries and their readback
+const GLuint GPU_PROFILER_FRAMES = 4;
+
+// statistics of a scope over the history, in milliseconds
+struct ProfilerStats {
+    string name;
+    GLfloat last;
+    GLfloat min;
+    GLfloat avg;
+    GLfloat p99;
+};
+
+/////////////////// GPUPROFILER class ///////////////////////
+class GPUProfiler
+{
+public:
+    // number of frames kept in the history
+    GLuint historySize;
+    // the profiler can be disabled at runtime: no queries are issued
+    bool enabled;
+
+    //////////////////////////////////////////
+    // constructor. N.B.) no OpenGL calls here, query objects are created when needed (the profiler can be created before the context)
+    GPUProfiler(GLuint historySize = 300)
+        : historySize(historySize), enabled(true), currentFrame(0), frameNumber(0)
+    {
+        this->frames.resize(GPU_PROFILER_FRAMES);
+    }
+
+    //////////////////////////////////////////
+    // we read the results of the oldest frame (if they are available) and we start recording a new one
+    void BeginFrame()
+    {
+        ProfilerFrame &frame = this->frames[this->currentFrame];
+        if(frame.pending)
+            this->Collect(frame);
+
+        frame.records.clear();
+        frame.usedQueries = 0;
+        frame.pending = false;
+        frame.number = this->frameNumber;
+        this->openScopes.clear();
+    }
+
+    //////////////////////////////////////////
+    // we open a named scope
+    void Begin(const string &name)
+    {
+        if(!this->enabled)
+            return;
+        ProfilerFrame &frame = this->frames[this->currentFrame];
+
+        ProfilerRecord record;
+        record.scope = this->ScopeId(name);
+        record.beginQuery = this->NextQuery(frame);
+        record.endQuery = 0;
+        glQueryCounter(frame.queries[record.beginQuery], GL_TIMESTAMP);
+
+        frame.records.push_back(record);
+        this->openScopes.push_back(frame.records.size() - 1);
+    }
+
+    //////////////////////////////////////////
+    // we close the last opened scope
+    void End()
+    {
+        if(!this->enabled || this->openScopes.empty())
+            return;
+        ProfilerFrame &frame = this->frames[this->currentFrame];
+
+        ProfilerRecord &record = frame.records[this->openScopes.back()];
+        this->openScopes.pop_back();
+        record.endQuery = this->NextQuery(frame);
+        glQueryCounter(frame.queries[record.endQuery], GL_TIMESTAMP);
+    }
+
+    //////////////////////////////////////////
+    // the frame is complete: its results will be read GPU_PROFILER_FRAMES frames later
+    void EndFrame()
+    {
+        // scopes left open are closed here
+        while(!this->openScopes.empty())
+            this->End();
+
+        this->frames[this->currentFrame].pending = !this->frames[this->currentFrame].records.empty();
+        this->currentFrame = (this->currentFrame + 1) % GPU_PROFILER_FRAMES;
+        this->frameNumber++;
+    }
+
+    //////////////////////////////////////////
+    // statistics of each scope, in the order they were first opened
+    vector<ProfilerStats> Stats()
+    {
+        vector<ProfilerStats> stats;
+        for(GLuint i = 0; i < this->scopeNames.size(); i++)
+        {
+            ProfilerStats s;
+            s.name = this->scopeNames[i];
+            s.last = s.min = s.avg = s.p99 = 0.0f;
+
+            vector<GLfloat> samples;
+            for(GLuint f = 0; f < this->history.size(); f++)
+                if(i < this->history[f].size() && this->history[f][i] >= 0.0f)
+                    samples.push_back(this->history[f][i]);
+
+            if(!samples.empty())
+            {
+                s.last = samples.back();
+                GLfloat sum = 0.0f;
+                for(GLuint k = 0; k < samples.size(); k++)
+                    sum += samples[k];
+                s.avg = sum / samples.size();
+                sort(samples.begin(), samples.end());
+                s.min = samples.front();
+                s.p99 = samples[(GLuint)((samples.size() - 1) * 0.99f)];
+            }
+            stats.push_back(s);
+        }
+        return stats;
+    }
+
+    //////////////////////////////////////////
+    // we write the history in a CSV file: one row for each frame, one column (in ms) for each scope
+    bool DumpCSV(const string &path)
+    {
+        ofstream file(path.c_str());
+        if(!file.is_open())
+        {
+            cout << "ERROR::GPUPROFILER:: Cannot write " << path << endl;
+            return false;
+        }
+
+        file << "frame";
+        for(GLuint i = 0; i < this->scopeNames.size(); i++)
+            file << "," << this->scopeNames[i];
+        file << "\n";
+
+        for(GLuint f = 0; f < this->history.size(); f++)
+        {
+            file << this->historyFrames[f];
+            for(GLuint i = 0; i < this->scopeNames.size(); i++)
+            {
+                file << ",";
+                // empty cell if the scope was not used in that frame
+                if(i < this->history[f].size() && this->history[f][i] >= 0.0f)
+                    file << this->history[f][i];
+            }
+            file << "\n";
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // we wait for the GPU and we collect all the recorded frames.
+    // N.B.) it stalls the pipeline: use it only at the end of a benchmark
+    void Flush()
+    {
+        glFinish();
+        // from the oldest frame to the newest one
+        for(GLuint i = 0; i < GPU_PROFILER_FRAMES; i++)
+        {
+            ProfilerFrame &frame = this->frames[(this->currentFrame + i) % GPU_PROFILER_FRAMES];
+            if(frame.pending)
+                this->Collect(frame);
+            frame.pending = false;
+        }
+    }
+
+    //////////////////////////////////////////
+    // number of the frame being recorded
+    GLuint FrameNumber()
+    {
+        return this->frameNumber;
+    }
+
+    //////////////////////////////////////////
+    // names of the scopes, in the order of their ids
+    const vector<string>& ScopeNames()
+    {
+        return this->scopeNames;
+    }
+
+    //////////////////////////////////////////
+    // times (ms) of the scopes in the given frame, negative for unused scopes.
+    // It returns false if the frame is not in the history (too old, or dropped because its results were not available in time)
+    bool FrameTimes(GLuint frameNumber, vector<GLfloat> &times)
+    {
+        // frame numbers in the history are increasing
+        deque<GLuint>::iterator it = lower_bound(this->historyFrames.begin(), this->historyFrames.end(), frameNumber);
+        if(it == this->historyFrames.end() || *it != frameNumber)
+            return false;
+        times = this->history[it - this->historyFrames.begin()];
+        times.resize(this->scopeNames.size(), -1.0f);
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // query objects are deleted when application ends
+    void Delete()
+    {
+        for(GLuint i = 0; i < this->frames.size(); i++)
+        {
+            if(!this->frames[i].queries.empty())
+                glDeleteQueries(this->frames[i].queries.size(), &this->frames[i].queries[0]);
+            this->frames[i].queries.clear();
+        }
+    }
+
+private:
+    // a scope recorded in a frame, with the indices of its begin and end queries
+    struct ProfilerRecord {
+        GLuint scope;
+        GLuint beginQuery;
+        GLuint endQuery;
+    };
+
+    // the queries of a frame
+    struct ProfilerFrame {
+        vector<GLuint> queries;
+        GLuint usedQueries;
+        vector<ProfilerRecord> records;
+        // the frame has been recorded, but not read yet
+        bool pending;
+        // frame number, for the CSV
+        GLuint number;
+        ProfilerFrame() : usedQueries(0), pending(false), number(0) {}
+    };
+
+    // ring of recorded frames
+    vector<ProfilerFrame> frames;
+    GLuint currentFrame;
+    GLuint frameNumber;
+    // indices (in the records of the current frame) of the open scopes
+    vector<GLuint> openScopes;
+    // scope names, and their ids
+    vector<string> scopeNames;
+    map<string, GLuint> scopeIds;
+    // times (ms) of the collected frames: one value for each scope, negative if the scope was not used
+    deque< vector<GLfloat> > history;
+    deque<GLuint> historyFrames;
+
+    //////////////////////////////////////////
+    GLuint ScopeId(const string &name)
+    {
+        map<string, GLuint>::iterator it = this->scopeIds.find(name);
+        if(it != this->scopeIds.end())
+            return it->second;
+        GLuint id = this->scopeNames.size();
+        this->scopeNames.push_back(name);
+        this->scopeIds[name] = id;
+        return id;
+    }
+
+    //////////////////////////////////////////
+    // we take the next free query of the frame, creating it if needed
+    GLuint NextQuery(ProfilerFrame &frame)
+    {
+        if(frame.usedQueries == frame.queries.size())
+        {
+            GLuint query;
+            glGenQueries(1, &query);
+            frame.queries.push_back(query);
+        }
+        return frame.usedQueries++;
+    }
+
+    //////////////////////////////////////////
+    // we read the timestamps of a recorded frame, if the GPU has already written them. Otherwise the frame is dropped.
+    void Collect(ProfilerFrame &frame)
+    {
+        // queries complete in order: if the last one is available, all of them are
+        GLuint available = 0;
+        glGetQueryObjectuiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(!available)
+            return;
+
+        vector<GLfloat> times(this->scopeNames.size(), -1.0f);
+        for(GLuint i = 0; i < frame.records.size(); i++)
+        {
+            ProfilerRecord &record = frame.records[i];
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(frame.queries[record.beginQuery], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[record.endQuery], GL_QUERY_RESULT, &end);
+            GLfloat ms = (end - begin) / 1000000.0f;
+            if(times[record.scope] < 0.0f)
+                times[record.scope] = ms;
+            else
+                times[record.scope] += ms;
+        }
+
+        this->history.push_back(times);
+        this->historyFrames.push_back(frame.number);
+        while(this->history.size() > this->historySize)
+        {
+            this->history.pop_front();
+            this->historyFrames.pop_front();
+        }
+    }
+};
@@ -0,0 +1,81 @@
+/*
+Grid mesh generation
+- procedural creation of a flat grid Mesh with the same layout of the grid exported from Blender (models/grid500m100x100.obj)
+
+The grid lies on the XZ plane, centered in the origin, with normals pointing along +Y.
+UV coordinates go from (0,1) on the near edge (+Z) to (1,0) on the far edge (-Z), matching the OBJ grid after aiProcess_FlipUVs.
+Being procedural, the grid density can be changed at runtime (e.g. for benchmarks or for terrain chunks with different levels of detail).
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+
+// GL Includes
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// the Mesh class (v2) allocates VAO, VBO and EBO for the generated data
+#include <utils/model_v2.h>
+
+//////////////////////////////////////////
+// we create a grid of (columns x rows) vertices, "width" units wide along X and "length" units long along Z
+// N.B.) the caller is responsible for calling Delete() on the returned Mesh
+Mesh CreateGridMesh(GLuint columns, GLuint rows, GLfloat width, GLfloat length)
+{
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    vector<Texture> textures;
+
+    vertices.reserve(columns * rows);
+    indices.reserve((columns - 1) * (rows - 1) * 6);
+
+    GLfloat uStep = 1.0f / (GLfloat)(columns - 1);
+    GLfloat vStep = 1.0f / (GLfloat)(rows - 1);
+    for(GLuint row = 0; row < rows; row++)
+    {
+        for(GLuint col = 0; col < columns; col++)
+        {
+            Vertex vertex;
+            GLfloat u = col * uStep;
+            GLfloat v = row * vStep;
+            vertex.Position = glm::vec3((u - 0.5f) * width, 0.0f, (0.5f - v) * length);
+            vertex.Normal = glm::vec3(0.0f, 1.0f, 0.0f);
+            // the first row is the near one, with V = 1 (see the flipped UVs of the OBJ grid)
+            vertex.TexCoords = glm::vec2(u, 1.0f - v);
+            vertex.Tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+            vertex.Bitangent = glm::vec3(0.0f, 0.0f, -1.0f);
+            vertices.push_back(vertex);
+        }
+    }
+
+    // two triangles for each quad of the grid
+    for(GLuint row = 0; row < rows - 1; row++)
+    {
+        for(GLuint col = 0; col < columns - 1; col++)
+        {
+            GLuint i0 = row * columns + col;
+            GLuint i1 = i0 + 1;
+            GLuint i2 = i0 + columns;
+            GLuint i3 = i2 + 1;
+            indices.push_back(i0);
+            indices.push_back(i1);
+            indices.push_back(i3);
+            indices.push_back(i0);
+            indices.push_back(i3);
+            indices.push_back(i2);
+        }
+    }
+
+    return Mesh(vertices, indices, textures);
+}
+
+//////////////////////////////////////////
+// square grid of (resolution x resolution) vertices, with a side of "size" units
+Mesh CreateGridMesh(GLuint resolution, GLfloat size)
+{
+    return CreateGridMesh(resolution, resolution, size, size);
+}
@@ -0,0 +1,153 @@
+/*
+GridNoise class
+- pre-computation ("baking") of the fractal noise used to displace the neon grid into a float texture
+- the texture is regenerated only when the noise zoom changes
+- any other region of the noise field can be baked in a user texture (e.g. for the terrain chunks)
+
+The noise field of the grid only scrolls row by row, so we can evaluate the fbm once, store it in a R32F texture, and let the vertex shader fetch it with an offset equal to the scrolled rows.
+The texture covers the whole grid width (U in [0,1]) and "period" grid lengths along V. To avoid a visible seam when the scrolling wraps around, the bake shader cross-fades the field with its copy one period behind, so the texture is tileable along V (GL_REPEAT on T).
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <iostream>
+
+// GL Includes
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <utils/shader_v1.h>
+#include <utils/render_stats.h>
+#include <utils/gl_state.h>
+
+//////////////////////////////////////////
+// we create a R32F texture to store a baked noise field
+GLuint CreateNoiseTexture(GLint width, GLint height, GLint wrapT)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glState.BindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+    glState.BindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+/////////////////// GRIDNOISE class ///////////////////////
+class GridNoise
+{
+public:
+    // the baked noise texture
+    GLuint texture;
+    // texture dimensions
+    GLint width, height;
+    // number of grid lengths (along V) covered by the texture
+    GLfloat period;
+
+    //////////////////////////////////////////
+    // constructor: we allocate the texture and the framebuffer used to render into it
+    // N.B.) the shader files are loaded from the working directory, like all the other shaders of the application
+    GridNoise(GLint width = 256, GLint height = 1024, GLfloat period = 4.0f)
+        : width(width), height(height), period(period),
+          bakeShader("fullscreen.vert", "gridNoiseBake.frag"), bakedZoom(-1.0f)
+    {
+        // U covers exactly the grid width, while V is wrapped during scrolling
+        this->texture = CreateNoiseTexture(this->width, this->height, GL_REPEAT);
+
+        glGenFramebuffers(1, &this->FBO);
+
+        // the fullscreen triangle is generated in the vertex shader, but the Core profile needs a VAO bound to draw
+        glGenVertexArrays(1, &this->VAO);
+    }
+
+    //////////////////////////////////////////
+    // we bake the noise field for the given zoom. If the zoom did not change since the last bake, nothing is done.
+    // it returns true if the texture has been regenerated
+    bool Bake(GLfloat zoom)
+    {
+        if(zoom == this->bakedZoom)
+            return false;
+
+        this->BakeRegion(this->texture, this->width, this->height, glm::vec2(0.0f), glm::vec2(1.0f, this->period), zoom, true);
+
+        this->bakedZoom = zoom;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // we bake in "target" the noise region starting at "origin" and spanning "extent", both in grid UV units.
+    // If tileable, texels are sampled at their centers and cross-faded along V (see Bake).
+    // Otherwise, the first and last texels of each row/column are placed exactly on the region edges, so adjacent regions share the values on their borders.
+    void BakeRegion(GLuint target, GLint w, GLint h, glm::vec2 origin, glm::vec2 extent, GLfloat zoom, bool tileable)
+    {
+        // we save the framebuffer and viewport changed by the bake pass (the other states are set through the GLState: the render graph sets again the states of its passes)
+        GLint framebuffer;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLuint polygonMode = glState.PolygonModeValue();
+
+        glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::GRIDNOISE:: Framebuffer is not complete" << endl;
+        glViewport(0, 0, w, h);
+        glState.PolygonMode(GL_FILL);
+        glState.Disable(GL_DEPTH_TEST);
+        glState.Disable(GL_STENCIL_TEST);
+        glState.Disable(GL_BLEND);
+
+        this->bakeShader.Use();
+        this->bakeShader.Uniform1f("zoom", zoom);
+        this->bakeShader.Uniform2f("origin", origin.x, origin.y);
+        this->bakeShader.Uniform2f("extent", extent.x, extent.y);
+        this->bakeShader.Uniform2f("resolution", (GLfloat)w, (GLfloat)h);
+        this->bakeShader.Uniform1i("tileable", tileable);
+        glState.BindVertexArray(this->VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        CountDraw(GL_TRIANGLES, 3);
+
+        // we restore the previous state
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        // the polygon mode is not a state of the passes (e.g., the wireframe mode is set once per frame)
+        if(polygonMode != GLState::UNKNOWN)
+            glState.PolygonMode(polygonMode);
+    }
+
+    //////////////////////////////////////////
+    // we bind the noise texture to the given texture unit, and we set the sampler and period uniforms of the grid shader
+    void Bind(Shader &shader, GLuint unit)
+    {
+        glState.ActiveTexture(GL_TEXTURE0 + unit);
+        glState.BindTexture(GL_TEXTURE_2D, this->texture);
+        shader.Uniform1i("noiseTexture", unit);
+        shader.Uniform1f("noisePeriod", this->period);
+    }
+
+    //////////////////////////////////////////
+    // resources are deallocated when application ends
+    void Delete()
+    {
+        this->bakeShader.Delete();
+        glState.DeleteVertexArray(this->VAO);
+        glDeleteFramebuffers(1, &this->FBO);
+        glState.DeleteTexture(this->texture);
+    }
+
+private:
+    // Shader Program used to evaluate the fbm in each texel
+    Shader bakeShader;
+    // framebuffer used to render in the noise textures
+    GLuint FBO;
+    // empty VAO for the fullscreen triangle
+    GLuint VAO;
+    // zoom used for the last bake (negative if the texture was never baked)
+    GLfloat bakedZoom;
+};
@@ -0,0 +1,392 @@
+/*
+JobSystem class
+- pool of worker threads executing small CPU jobs (audio analysis, matrices of the instances, culling, entity updates, decoding of the assets)
+- work stealing: each worker has its own queue (the jobs it creates are pushed and taken at the back, the most recent ones first), and an idle worker steals the oldest job from the front of the other queues
+- jobs form a graph: a job starts only when all its dependencies are finished. ParallelFor splits a range in jobs, and returns a job finished when all of them are finished
+- continuations on the main thread (RunOnMain), for the work needing the OpenGL context: they are executed by Wait and RunMainJobs, called by the main thread
+- the thread waiting for a job (Wait) executes the queued jobs meanwhile, so the application works also without workers (e.g. on a single core)
+- each job is a CPU profiler zone with the name of the job, and the time spent in the jobs by each worker gives its utilization, computed at each frame (see BeginFrame)
+
+Usage:
+    JobSystem jobs;
+    JobHandle decode = jobs.ParallelFor("Decode", count, 1, [&](GLuint first, GLuint last){ ... });
+    JobHandle upload = jobs.RunOnMain("Upload", [&](){ ... OpenGL calls ... }, {decode});
+    ... other work on the main thread ...
+    jobs.Wait(upload);
+
+N.B.) job names must be string literals (see CPUProfiler). The data used by a job must not be changed by other threads until the job is finished
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// GL Includes (only for the types)
+#include <glad/glad.h>
+
+#include <utils/cpu_profiler.h>
+
+// a job of the graph (see JobSystem)
+struct Job {
+    const char* name;
+    function<void()> work;
+    // the job needs the main thread
+    bool mainThread;
+    // dependencies not finished yet (+1 until the job is submitted)
+    atomic<GLint> pending;
+    // jobs waiting for this one, and finished state (protected by lock)
+    mutex lock;
+    vector<shared_ptr<Job> > continuations;
+    atomic<bool> finished;
+
+    Job() : name(""), mainThread(false), pending(1), finished(false) {}
+};
+
+typedef shared_ptr<Job> JobHandle;
+
+// activity of a thread in the last frame
+struct JobWorkerStats {
+    string name;
+    // fraction of the frame time spent executing jobs
+    GLfloat utilization;
+    GLuint jobs;
+    // jobs taken from the queue of another thread
+    GLuint steals;
+};
+
+/////////////////// JOBSYSTEM class ///////////////////////
+class JobSystem
+{
+public:
+    // activity of the workers (and, as last element, of the main thread) in the last frame
+    vector<JobWorkerStats> stats;
+
+    //////////////////////////////////////////
+    // constructor: "workers" threads (0 = one for each hardware thread, except the main one)
+    JobSystem(GLuint workers = 0)
+        : running(true), queued(0), mainQueued(0)
+    {
+        if(workers == 0)
+        {
+            GLuint hardware = thread::hardware_concurrency();
+            workers = hardware > 1 ? hardware - 1 : 0;
+        }
+        this->mainThread = this_thread::get_id();
+        // one queue for each worker, and the last one for the jobs created by the other threads
+        this->queues.resize(workers + 1);
+        for(GLuint i = 0; i <= workers; i++)
+            this->queues[i].reset(new WorkerQueue());
+        this->stats.resize(workers + 1);
+        for(GLuint i = 0; i < workers; i++)
+            this->stats[i].name = "worker " + to_string(i);
+        this->stats[workers].name = "main";
+        this->frameStart = CPUProfiler::Now();
+
+        // the buffer of the calling (main) thread is registered before the workers start: it is the first one of the trace
+        CPUProfiler::SetThreadName("main");
+        for(GLuint i = 0; i < workers; i++)
+            this->threads.push_back(thread(&JobSystem::WorkerLoop, this, i));
+    }
+
+    //////////////////////////////////////////
+    // the workers finish their current job and they are stopped (the jobs still queued are not executed)
+    ~JobSystem()
+    {
+        {
+            lock_guard<mutex> lock(this->sleepLock);
+            this->running = false;
+        }
+        this->wake.notify_all();
+        for(GLuint i = 0; i < this->threads.size(); i++)
+            this->threads[i].join();
+    }
+
+    //////////////////////////////////////////
+    // number of worker threads
+    GLuint Workers()
+    {
+        return this->threads.size();
+    }
+
+    //////////////////////////////////////////
+    // we create a job, executed by a worker when all the dependencies are finished
+    JobHandle Run(const char* name, const function<void()> &work, const vector<JobHandle> &dependencies = vector<JobHandle>())
+    {
+        return this->Create(name, work, false, dependencies);
+    }
+
+    // a job executed by the main thread (in Wait or RunMainJobs), e.g. to upload to OpenGL the data prepared by the workers
+    JobHandle RunOnMain(const char* name, const function<void()> &work, const vector<JobHandle> &dependencies = vector<JobHandle>())
+    {
+        return this->Create(name, work, true, dependencies);
+    }
+
+    //////////////////////////////////////////
+    // we split [0, count) in ranges of "grain" elements, each one executed by a job. The returned job is finished when all the ranges are done
+    JobHandle ParallelFor(const char* name, GLuint count, GLuint grain, const function<void(GLuint, GLuint)> &work, const vector<JobHandle> &dependencies = vector<JobHandle>())
+    {
+        if(grain == 0)
+            grain = 1;
+        vector<JobHandle> parts;
+        for(GLuint first = 0; first < count; first += grain)
+        {
+            GLuint last = count - first > grain ? first + grain : count;
+            parts.push_back(this->Run(name, [work, first, last](){ work(first, last); }, dependencies));
+        }
+        if(parts.empty())
+            parts = dependencies;
+        return this->Run(name, [](){}, parts);
+    }
+
+    //////////////////////////////////////////
+    bool Finished(const JobHandle &job)
+    {
+        return job->finished.load(memory_order_acquire);
+    }
+
+    //////////////////////////////////////////
+    // we wait for a job, executing the queued jobs meanwhile (the main thread executes also its continuations)
+    void Wait(const JobHandle &job)
+    {
+        CPU_ZONE("JobSystem::Wait");
+        bool isMain = this_thread::get_id() == this->mainThread;
+        GLuint slot = this->Slot();
+        while(!this->Finished(job))
+        {
+            JobHandle next;
+            if(isMain)
+                next = this->TakeMainJob();
+            if(!next)
+                next = this->TakeJob(slot);
+            if(next)
+            {
+                this->Execute(next, slot);
+                continue;
+            }
+            // nothing to do: we sleep until a job is finished or queued
+            unique_lock<mutex> lock(this->sleepLock);
+            this->wake.wait(lock, [&](){ return this->Finished(job) || this->queued.load() > 0 || (isMain && this->mainQueued.load() > 0); });
+        }
+    }
+
+    //////////////////////////////////////////
+    // the main thread executes the continuations already ready
+    void RunMainJobs()
+    {
+        JobHandle next;
+        while((next = this->TakeMainJob()))
+            this->Execute(next, this->Slot());
+    }
+
+    //////////////////////////////////////////
+    // called once per frame: we compute the activity of the threads in the last frame
+    void BeginFrame()
+    {
+        long long now = CPUProfiler::Now();
+        GLfloat frame = (GLfloat)(now - this->frameStart);
+        this->frameStart = now;
+        for(GLuint i = 0; i < this->queues.size(); i++)
+        {
+            WorkerQueue &q = *this->queues[i];
+            this->stats[i].utilization = frame > 0.0f ? (GLfloat)q.busy.exchange(0) / frame : 0.0f;
+            this->stats[i].jobs = q.executed.exchange(0);
+            this->stats[i].steals = q.steals.exchange(0);
+        }
+    }
+
+private:
+    // queue of a thread, and its counters in the current frame
+    struct WorkerQueue {
+        mutex lock;
+        deque<JobHandle> ready;
+        atomic<long long> busy;
+        atomic<GLuint> executed, steals;
+        WorkerQueue() : busy(0), executed(0), steals(0) {}
+    };
+
+    vector<thread> threads;
+    vector<unique_ptr<WorkerQueue> > queues;
+    // continuations for the main thread
+    mutex mainLock;
+    deque<JobHandle> mainJobs;
+    thread::id mainThread;
+
+    // idle threads sleep until a job is queued or finished
+    mutex sleepLock;
+    condition_variable wake;
+    bool running;
+    // jobs in the queues of the workers, and in the one of the main thread
+    atomic<GLint> queued, mainQueued;
+    long long frameStart;
+
+    //////////////////////////////////////////
+    // index of the worker running the calling thread (-1 for the other threads)
+    static GLint& WorkerIndex()
+    {
+        thread_local GLint index = -1;
+        return index;
+    }
+
+    // queue and counters of the calling thread (the last slot is shared by all the threads that are not workers)
+    GLuint Slot()
+    {
+        GLint index = WorkerIndex();
+        return index >= 0 ? (GLuint)index : this->queues.size() - 1;
+    }
+
+    //////////////////////////////////////////
+    JobHandle Create(const char* name, const function<void()> &work, bool mainThread, const vector<JobHandle> &dependencies)
+    {
+        JobHandle job = make_shared<Job>();
+        job->name = name;
+        job->work = work;
+        job->mainThread = mainThread;
+        job->pending.store(1 + dependencies.size());
+        for(GLuint i = 0; i < dependencies.size(); i++)
+        {
+            Job &dependency = *dependencies[i];
+            lock_guard<mutex> lock(dependency.lock);
+            if(dependency.finished.load())
+                job->pending.fetch_sub(1);
+            else
+                dependency.continuations.push_back(job);
+        }
+        // the job is submitted: it is queued now if it has no dependencies left
+        if(job->pending.fetch_sub(1) == 1)
+            this->Schedule(job);
+        return job;
+    }
+
+    //////////////////////////////////////////
+    // a job is ready: a worker pushes it in its own queue
+    void Schedule(const JobHandle &job)
+    {
+        if(job->mainThread)
+        {
+            lock_guard<mutex> lock(this->mainLock);
+            this->mainJobs.push_back(job);
+            this->mainQueued.fetch_add(1);
+        }
+        else
+        {
+            WorkerQueue &q = *this->queues[this->Slot()];
+            lock_guard<mutex> lock(q.lock);
+            q.ready.push_back(job);
+            this->queued.fetch_add(1);
+        }
+        this->Notify();
+    }
+
+    // the lock avoids losing the notification between the check and the wait of a sleeping thread
+    void Notify()
+    {
+        {
+            lock_guard<mutex> lock(this->sleepLock);
+        }
+        this->wake.notify_all();
+    }
+
+    //////////////////////////////////////////
+    // a job from the queue of the thread (the most recent one), otherwise the oldest job of another queue
+    JobHandle TakeJob(GLuint slot)
+    {
+        if(this->queued.load() <= 0)
+            return JobHandle();
+        GLuint count = this->queues.size();
+        for(GLuint k = 0; k < count; k++)
+        {
+            GLuint i = (slot + k) % count;
+            WorkerQueue &q = *this->queues[i];
+            lock_guard<mutex> lock(q.lock);
+            if(q.ready.empty())
+                continue;
+            JobHandle job;
+            if(k == 0)
+            {
+                job = q.ready.back();
+                q.ready.pop_back();
+            }
+            else
+            {
+                job = q.ready.front();
+                q.ready.pop_front();
+                this->queues[slot]->steals.fetch_add(1);
+            }
+            this->queued.fetch_sub(1);
+            return job;
+        }
+        return JobHandle();
+    }
+
+    JobHandle TakeMainJob()
+    {
+        if(this->mainQueued.load() <= 0)
+            return JobHandle();
+        lock_guard<mutex> lock(this->mainLock);
+        if(this->mainJobs.empty())
+            return JobHandle();
+        JobHandle job = this->mainJobs.front();
+        this->mainJobs.pop_front();
+        this->mainQueued.fetch_sub(1);
+        return job;
+    }
+
+    //////////////////////////////////////////
+    // we execute a job, then the jobs waiting only for it become ready
+    void Execute(const JobHandle &job, GLuint slot)
+    {
+        long long begin = CPUProfiler::Now();
+        {
+            CPU_ZONE(job->name);
+            job->work();
+        }
+        WorkerQueue &q = *this->queues[slot];
+        q.busy.fetch_add(CPUProfiler::Now() - begin);
+        q.executed.fetch_add(1);
+
+        vector<JobHandle> continuations;
+        {
+            lock_guard<mutex> lock(job->lock);
+            job->finished.store(true, memory_order_release);
+            continuations.swap(job->continuations);
+        }
+        for(GLuint i = 0; i < continuations.size(); i++)
+            if(continuations[i]->pending.fetch_sub(1) == 1)
+                this->Schedule(continuations[i]);
+        // the threads waiting for this job
+        this->Notify();
+    }
+
+    //////////////////////////////////////////
+    void WorkerLoop(GLuint index)
+    {
+        WorkerIndex() = index;
+#ifdef CPU_PROFILER_ENABLED
+        CPUProfiler::SetThreadName("worker " + to_string(index));
+#endif
+        for(;;)
+        {
+            JobHandle job = this->TakeJob(index);
+            if(job)
+            {
+                this->Execute(job, index);
+                continue;
+            }
+            unique_lock<mutex> lock(this->sleepLock);
+            this->wake.wait(lock, [&](){ return !this->running || this->queued.load() > 0; });
+            if(!this->running)
+                return;
+        }
+    }
+};
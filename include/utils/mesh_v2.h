@@ -9,7 +9,15 @@ See https://learnopengl.com/#!Getting-started/Hello-Triangle for details.
 
 N.B. 1) in this version of the class, textures are loaded and applied
 
-N.B. 2) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
+N.B. 2) with DrawInstanced, the model-view and normal matrices of each instance are read from a buffer (vertex attributes 5 to 11, see SetInstanceMatrices)
+
+N.B. 3) the textures are applied by a Material: the names of the samplers (texture_diffuseN, ...) are built once, and for each Shader Program the sampler units are set once.
+Drawing binds only a list of (unit, texture) pairs: the binds of the textures already bound on their unit are filtered by the GLState (see utils/gl_state.h)
+
+N.B. 4) a Mesh can also be a range of a GeometryArena (see utils/geometry_arena.h): in this case, VAO and buffers are shared with the other meshes of the arena, and the draw calls use the base vertex of the range.
+The instanced draws use a second VAO of the arena (instancedVAO): the instance attributes never change the VAO used by the other meshes
+
+N.B. 5) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/mesh.h
 
 author: Davide Gadia
 
@@ -34,6 +42,11 @@ using namespace std;
 // we use GLM data structures to write data in the VBO, VAO and EBO buffers
 #include <glm/glm.hpp>
 
+// draw calls and triangles are counted for the render statistics
+#include <utils/render_stats.h>
+// VAO and texture binds go through the state cache
+#include <utils/gl_state.h>
+
 // data structure for vertices
 struct Vertex {
     // vertex coordinates
@@ -55,83 +68,205 @@ struct Texture {
     aiString path;
 };
 
+// texture units available to the materials
+const GLuint MATERIAL_TEXTURE_UNITS = 16;
+
+// a texture of a material, and the unit it is bound to
+struct TextureBinding {
+    GLuint unit;
+    GLuint texture;
+};
+
+/////////////////// MATERIAL class ///////////////////////
+class Material {
+public:
+    // textures, and the names of their samplers in the shaders
+    vector<Texture> textures;
+    vector<string> samplers;
+
+    //////////////////////////////////////////
+    Material() {}
+
+    // the sampler of each texture is named after its type, with a sequential number for each type (e.g., texture_diffuse1, texture_diffuse2, texture_specular1)
+    Material(const vector<Texture> &textures) : textures(textures)
+    {
+        GLuint diffuseNr = 1;
+        GLuint specularNr = 1;
+        GLuint normalNr = 1;
+        GLuint heightNr = 1;
+        for(GLuint i = 0; i < this->textures.size(); i++)
+        {
+            const string &name = this->textures[i].type;
+            GLuint number = 0;
+            if(name == "texture_diffuse")
+                number = diffuseNr++;
+            else if(name == "texture_specular")
+                number = specularNr++;
+            else if(name == "texture_normal")
+                number = normalNr++;
+            else if(name == "texture_height")
+                number = heightNr++;
+            this->samplers.push_back(name + to_string(number));
+        }
+    }
+
+    //////////////////////////////////////////
+    // we bind the textures used by the Shader Program (which must be active). The sampler units of a new program are resolved and set once
+    void Bind(Shader &shader)
+    {
+        const vector<TextureBinding> &bindings = this->Resolve(shader);
+        for(GLuint i = 0; i < bindings.size(); i++)
+        {
+            glState.ActiveTexture(GL_TEXTURE0 + bindings[i].unit);
+            glState.BindTexture(GL_TEXTURE_2D, bindings[i].texture);
+        }
+    }
+
+private:
+    // the bindings of the material for a Shader Program (identified by its generation)
+    struct ProgramBindings {
+        GLuint generation;
+        vector<TextureBinding> bindings;
+    };
+    vector<ProgramBindings> programs;
+
+    //////////////////////////////////////////
+    // the textures whose sampler is not used by the program are not bound. Each sampler name has always the same unit, so different materials never set different units for the same sampler of a program
+    const vector<TextureBinding>& Resolve(Shader &shader)
+    {
+        for(GLuint p = 0; p < this->programs.size(); p++)
+            if(this->programs[p].generation == shader.Generation)
+                return this->programs[p].bindings;
+
+        ProgramBindings program;
+        program.generation = shader.Generation;
+        for(GLuint i = 0; i < this->textures.size(); i++)
+        {
+            GLint location = shader.Uniform(this->samplers[i]);
+            if(location < 0)
+                continue;
+            GLuint unit = SamplerUnit(this->samplers[i]);
+            if(unit >= MATERIAL_TEXTURE_UNITS)
+            {
+                cout << "ERROR::MATERIAL:: No texture unit for " << this->samplers[i] << endl;
+                continue;
+            }
+            shader.Uniform1i(this->samplers[i], unit);
+            TextureBinding binding;
+            binding.unit = unit;
+            binding.texture = this->textures[i].id;
+            program.bindings.push_back(binding);
+        }
+        this->programs.push_back(program);
+        return this->programs.back().bindings;
+    }
+
+    //////////////////////////////////////////
+    // units are assigned to the sampler names in the order of their first use
+    static GLuint SamplerUnit(const string &sampler)
+    {
+        static vector<string> names;
+        for(GLuint i = 0; i < names.size(); i++)
+            if(names[i] == sampler)
+                return i;
+        names.push_back(sampler);
+        return names.size() - 1;
+    }
+};
+
 /////////////////// MESH class ///////////////////////
 class Mesh {
 public:
     // data structures for vertices, and indices of vertices (for faces)
     vector<Vertex> vertices;
     vector<GLuint> indices;
-    // data structures for textures
-    vector<Texture> textures;
+    // textures, and their bindings
+    Material material;
 
-    // VAO
-    GLuint VAO;
+    // VAO, and VAO of the instanced draws (the same one, except for the meshes in a GeometryArena)
+    GLuint VAO, instancedVAO;
+    // indices drawn, and their position in the EBO (first index and base vertex are not 0 for the meshes in a GeometryArena)
+    GLuint indexCount, firstIndex;
+    GLint baseVertex;
 
     //////////////////////////////////////////
     // Constructor
     Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures)
+        : indexCount(indices.size()), firstIndex(0), baseVertex(0), ownsBuffers(true)
     {
         this->vertices = vertices;
         this->indices = indices;
-        this->textures = textures;
+        this->material = Material(textures);
 
         // initialization of OpenGL buffers
         this->setupMesh();
+        this->instancedVAO = this->VAO;
+    }
+
+    // mesh stored in a range of the buffers of a GeometryArena (vertices and indices are in the arena, the VAOs are the ones of the arena)
+    Mesh(GLuint VAO, GLuint instancedVAO, GLuint indexCount, GLuint firstIndex, GLint baseVertex, vector<Texture> textures)
+        : VAO(VAO), instancedVAO(instancedVAO), indexCount(indexCount), firstIndex(firstIndex), baseVertex(baseVertex), VBO(0), EBO(0), ownsBuffers(false)
+    {
+        this->material = Material(textures);
     }
 
     //////////////////////////////////////////
 
     // rendering of mesh
-    void Draw(Shader shader)
+    void Draw(Shader &shader)
     {
-        // Bind appropriate textures
-        GLuint diffuseNr = 1;
-        GLuint specularNr = 1;
-        GLuint normalNr = 1;
-        GLuint heightNr = 1;
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i); // Active proper texture unit before binding
-            // Retrieve texture number (the N in diffuse_textureN)
-            stringstream ss;
-            string number;
-            string name = this->textures[i].type;
-            if(name == "texture_diffuse")
-                ss << diffuseNr++; // Transfer GLuint to stream
-            else if(name == "texture_specular")
-                ss << specularNr++; // Transfer GLuint to stream
-            else if(name == "texture_normal")
-                ss << normalNr++; // Transfer GLuint to stream
-             else if(name == "texture_height")
-                ss << heightNr++; // Transfer GLuint to stream
-            number = ss.str();
-            // Now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-            // And finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-        }
+        this->material.Bind(shader);
 
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-        // rendering of data in the VAO
-        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-        // VAO is "detached"
-        glBindVertexArray(0);
+        // VAO is made "active" (it stays bound after the draw: the next mesh with the same VAO does not bind it again)
+        glState.BindVertexArray(this->VAO);
+        // rendering of data in the VAO (the indices of the mesh are relative to its base vertex)
+        glDrawElementsBaseVertex(GL_TRIANGLES, this->indexCount, GL_UNSIGNED_INT, (GLvoid*)(size_t)(this->firstIndex * sizeof(GLuint)), this->baseVertex);
+        CountDraw(GL_TRIANGLES, this->indexCount);
+    }
+
+    //////////////////////////////////////////
+
+    // rendering of "instances" copies of the mesh in a single draw call, with the matrices set by SetInstanceMatrices
+    void DrawInstanced(Shader &shader, GLuint instances)
+    {
+        this->material.Bind(shader);
 
-        // Always good practice to set everything back to defaults once configured.
-        for (GLuint i = 0; i < this->textures.size(); i++)
+        glState.BindVertexArray(this->instancedVAO);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, this->indexCount, GL_UNSIGNED_INT, (GLvoid*)(size_t)(this->firstIndex * sizeof(GLuint)), instances, this->baseVertex);
+        CountInstancedDraw(GL_TRIANGLES, this->indexCount, instances);
+    }
+
+    //////////////////////////////////////////
+
+    // the per-instance matrices are read from "buffer", starting at "offset", with "stride" bytes for each instance:
+    // the model-view matrix (4 columns, locations 5 to 8) followed by the normal matrix (3 columns, locations 9 to 11). See TransformInstance in utils/transforms.h
+    void SetInstanceMatrices(GLuint buffer, GLuint offset, GLuint stride)
+    {
+        glState.BindVertexArray(this->instancedVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for(GLuint c = 0; c < 4; c++)
         {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
+            glEnableVertexAttribArray(5 + c);
+            glVertexAttribPointer(5 + c, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(size_t)(offset + c * 4 * sizeof(GLfloat)));
+            glVertexAttribDivisor(5 + c, 1);
         }
+        for(GLuint c = 0; c < 3; c++)
+        {
+            glEnableVertexAttribArray(9 + c);
+            glVertexAttribPointer(9 + c, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(size_t)(offset + (16 + c * 3) * sizeof(GLfloat)));
+            glVertexAttribDivisor(9 + c, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
     //////////////////////////////////////////
 
-    // buffers are deallocated when application ends
+    // buffers are deallocated when application ends (the buffers of a GeometryArena are deleted by the arena)
     void Delete()
     {
-        glDeleteVertexArrays(1, &VAO);
+        if(!this->ownsBuffers)
+            return;
+        glState.DeleteVertexArray(this->VAO);
         glDeleteBuffers(1, &VBO);
         glDeleteBuffers(1, &EBO);
     }
@@ -139,6 +274,8 @@ public:
 private:
   // VBO and EBO
   GLuint VBO, EBO;
+  // false for the meshes in a GeometryArena
+  bool ownsBuffers;
 
   //////////////////////////////////////////
   // buffer objects\arrays are initialized
@@ -154,7 +291,7 @@ private:
       glGenBuffers(1, &this->EBO);
 
       // VAO is made "active"
-      glBindVertexArray(this->VAO);
+      glState.BindVertexArray(this->VAO);
       // we copy data in the VBO - we must set the data dimension, and the pointer to the structure cointaining the data
       glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
       glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
@@ -162,6 +299,17 @@ private:
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
       glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
 
+      SetVertexAttributes();
+
+      // VAO is "detached" (the following binds of element buffers must not change it)
+      glState.BindVertexArray(0);
+  }
+
+public:
+  //////////////////////////////////////////
+  // we set in the active VAO the pointers to the vertex attributes in the active VBO (shared with GeometryArena)
+  static void SetVertexAttributes()
+  {
       // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
       // vertex positions
       glEnableVertexAttribArray(0);
@@ -178,7 +326,5 @@ private:
       // Bitangent
       glEnableVertexAttribArray(4);
       glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
-
-      glBindVertexArray(0);
   }
 };
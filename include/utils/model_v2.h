@@ -5,7 +5,12 @@ Model class - v2
 
 N.B. 1) in this version of the class, eventual textures defined in the model (exported by modeling SWs) are loaded and applied
 
-N.B. 2) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/model.h
+N.B. 2) loading can be split in two phases: Load (file parsing and image decoding, without OpenGL calls, so it can run on a worker thread) and Upload (creation of the OpenGL buffers and textures, on the thread of the context)
+
+N.B. 3) the meshes of the file with the same textures (the only material data used by the Mesh class) are merged at loading, so each material is drawn with a single call.
+With a GeometryArena, the meshes are ranges of the shared buffers of the arena, and the whole model can be drawn with a single call (see DrawUntextured)
+
+N.B. 4) adaptation of https://github.com/JoeyDeVries/LearnOpenGL/blob/master/includes/learnopengl/model.h
 
 author: Davide Gadia
 
@@ -42,9 +47,19 @@ using namespace std;
 
 // we include the Mesh class (v2), which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
 #include <utils/mesh_v2.h>
+// shared buffers for the static geometry of all the models
+#include <utils/geometry_arena.h>
 
 // function used to load image data
 GLint TextureFromFile(const char* path, string directory);
+// decoded image, waiting to be uploaded
+struct TextureImage {
+    unsigned char* pixels;
+    int width, height, channels;
+};
+// image decoding (no OpenGL calls), and creation of the OpenGL texture (the pixels are deallocated)
+TextureImage DecodeTexture(const char* path, string directory);
+GLint TextureFromImage(TextureImage &image);
 
 
 /////////////////// MODEL class ///////////////////////
@@ -57,20 +72,65 @@ public:
     vector<Mesh> meshes;
     // the folder on disk of the model (needed for the loading of textures, if model is provided of textures)
     string directory;
+    // meshes in the file, before the merge of the ones with the same material
+    GLuint submeshes;
+    // radius of the bounding sphere centered in the origin of the model space (the vertices are not kept on the CPU by the meshes in an arena)
+    GLfloat radius;
 
     //////////////////////////////////////////
 
     // constructor
     Model(const string& path)
+        : submeshes(0), radius(0.0f), arena(NULL), firstCommand(0)
+    {
+        this->Load(path);
+        this->Upload();
+    }
+
+    // empty model, loaded later with Load and Upload
+    Model() : submeshes(0), radius(0.0f), arena(NULL), firstCommand(0) {}
+
+    //////////////////////////////////////////
+
+    // first loading phase: parsing of the file and decoding of the textures. No OpenGL calls
+    void Load(const string& path)
     {
         this->loadModel(path);
     }
 
     //////////////////////////////////////////
 
+    // second loading phase, on the thread of the OpenGL context: creation of the textures and of the buffers of the meshes.
+    // With an arena, the meshes are added to its buffers (created later, by GeometryArena::Upload)
+    void Upload(GeometryArena* arena = NULL)
+    {
+        for(GLuint i = 0; i < this->textures_loaded.size(); i++)
+            this->textures_loaded[i].id = TextureFromImage(this->images[i]);
+        this->images.clear();
+        this->arena = arena;
+        for(GLuint i = 0; i < this->meshData.size(); i++)
+        {
+            vector<Texture> textures;
+            for(GLuint t = 0; t < this->meshData[i].textures.size(); t++)
+                textures.push_back(this->textures_loaded[this->meshData[i].textures[t]]);
+            if(arena)
+            {
+                ArenaRange range = arena->Add(this->meshData[i].vertices, this->meshData[i].indices);
+                if(i == 0)
+                    this->firstCommand = range.command;
+                this->meshes.push_back(Mesh(arena->VAO, arena->instancedVAO, range.indexCount, range.firstIndex, range.baseVertex, textures));
+            }
+            else
+                this->meshes.push_back(Mesh(this->meshData[i].vertices, this->meshData[i].indices, textures));
+        }
+        this->meshData.clear();
+    }
+
+    //////////////////////////////////////////
+
     // model rendering: calls rendering methods of each instance of Mesh class in the vector.
     // In this case, we pass also the Shader class instance, because it will be used for the textures
-    void Draw(Shader shader)
+    void Draw(Shader &shader)
     {
         for(GLuint i = 0; i < this->meshes.size(); i++)
             this->meshes[i].Draw(shader);
@@ -78,6 +138,29 @@ public:
 
     //////////////////////////////////////////
 
+    // rendering without the textures of the model (e.g., outlines): with an arena, all the meshes are drawn with a single call (see GeometryArena::MultiDraw)
+    void DrawUntextured(Shader &shader)
+    {
+        if(this->arena)
+            this->arena->MultiDraw(this->firstCommand, this->meshes.size());
+        else
+            this->Draw(shader);
+    }
+
+    //////////////////////////////////////////
+
+    // instanced rendering: "instances" copies of the model, with the matrices read from "buffer" starting at "offset" (see Mesh::SetInstanceMatrices)
+    void DrawInstanced(Shader &shader, GLuint instances, GLuint buffer, GLuint offset, GLuint stride)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+        {
+            this->meshes[i].SetInstanceMatrices(buffer, offset, stride);
+            this->meshes[i].DrawInstanced(shader, instances);
+        }
+    }
+
+    //////////////////////////////////////////
+
     // destructor. when application closes, we deallocate memory allocated by the instances of Mesh class
     virtual ~Model()
     {
@@ -87,6 +170,17 @@ public:
 
 
 private:
+    // meshes and decoded images of the textures, between Load and Upload (textures are indices in textures_loaded)
+    struct MeshData {
+        vector<Vertex> vertices;
+        vector<GLuint> indices;
+        vector<GLuint> textures;
+    };
+    vector<MeshData> meshData;
+    vector<TextureImage> images;
+    // arena containing the meshes (NULL if they have their own buffers), and draw command of the first mesh
+    GeometryArena* arena;
+    GLuint firstCommand;
 
     //////////////////////////////////////////
     // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
@@ -112,6 +206,38 @@ private:
 
         // we start the recursive processing of nodes in the Assimp data structure
         this->processNode(scene->mRootNode, scene);
+        this->submeshes = this->meshData.size();
+        for(GLuint i = 0; i < this->meshData.size(); i++)
+            for(GLuint v = 0; v < this->meshData[i].vertices.size(); v++)
+                this->radius = glm::max(this->radius, glm::length(this->meshData[i].vertices[v].Position));
+        // meshes with the same material are drawn together
+        this->mergeMeshes();
+    }
+
+    //////////////////////////////////////////
+
+    // we merge the meshes with the same textures (in the order of their first appearance): the vertices are appended, and the indices moved after the vertices of the previous meshes.
+    // N.B.) the node transformations are not applied by processNode, so all the meshes are already in the same space
+    void mergeMeshes()
+    {
+        vector<MeshData> merged;
+        for(GLuint i = 0; i < this->meshData.size(); i++)
+        {
+            MeshData &mesh = this->meshData[i];
+            GLuint m = 0;
+            while(m < merged.size() && merged[m].textures != mesh.textures)
+                m++;
+            if(m == merged.size())
+            {
+                merged.push_back(MeshData());
+                merged[m].textures = mesh.textures;
+            }
+            GLuint base = merged[m].vertices.size();
+            merged[m].vertices.insert(merged[m].vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            for(GLuint j = 0; j < mesh.indices.size(); j++)
+                merged[m].indices.push_back(base + mesh.indices[j]);
+        }
+        this->meshData.swap(merged);
     }
 
     //////////////////////////////////////////
@@ -126,8 +252,8 @@ private:
             // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             // we start processing of the Assimp mesh using processMesh method.
-            // the result (an istance of the Mesh class) is added to the vector
-            this->meshes.push_back(this->processMesh(mesh, scene));
+            // the result (the data of a Mesh class instance, created in Upload) is added to the vector
+            this->meshData.push_back(this->processMesh(mesh, scene));
         }
         // we then recursively process each of the children nodes
         for(GLuint i = 0; i < node->mNumChildren; i++)
@@ -139,16 +265,17 @@ private:
 
     //////////////////////////////////////////
 
-    // Processing of the Assimp mesh in order to obtain an "OpenGL mesh"
-    // = we create and allocate the buffers used to send mesh data to the GPU
+    // Processing of the Assimp mesh in order to obtain the data of an "OpenGL mesh"
+    // (the buffers used to send mesh data to the GPU are created in Upload)
     // In this case, we pass also aiScene instance, because we need to set the materials once loaded the textures 
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+    MeshData processMesh(aiMesh* mesh, const aiScene* scene)
     {
       // data structures for vertices and indices of vertices (for faces)
-        vector<Vertex> vertices;
-        vector<GLuint> indices;
-        // vector with all the model textures
-        vector<Texture> textures;
+        MeshData data;
+        vector<Vertex> &vertices = data.vertices;
+        vector<GLuint> &indices = data.indices;
+        // indices of the model textures used by the mesh
+        vector<GLuint> &textures = data.textures;
 
         for(GLuint i = 0; i < mesh->mNumVertices; i++)
         {
@@ -216,27 +343,27 @@ private:
             // Normal: texture_normalN
 
             // 1. Diffuse maps
-            vector<Texture> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+            vector<GLuint> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
             textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
             // 2. Specular maps
-            vector<Texture> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+            vector<GLuint> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
             textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
             // 3. Normal maps
-            std::vector<Texture> normalMaps = this->loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+            std::vector<GLuint> normalMaps = this->loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
             textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
             // 4. Height maps
-            std::vector<Texture> heightMaps = this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+            std::vector<GLuint> heightMaps = this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
             textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
         }
 
-        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
-        return Mesh(vertices, indices, textures);
+        // we return the vertices and faces data structures we have created above (the Mesh class instance is created in Upload).
+        return data;
     }
 
-    // Load (if not yet loaded) the textures defined in the model materials (if defined)
-    vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+    // Load (if not yet loaded) the textures defined in the model materials (if defined): their indices in textures_loaded are returned
+    vector<GLuint> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
     {
-        vector<Texture> textures;
+        vector<GLuint> textures;
         for(GLuint i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
@@ -247,19 +374,20 @@ private:
             {
                 if(textures_loaded[j].path == str)
                 {
-                    textures.push_back(textures_loaded[j]);
+                    textures.push_back(j);
                     skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
                     break;
                 }
             }
             if(!skip)
-            {   // If texture hasn't been loaded already, load it
+            {   // If texture hasn't been loaded already, load it (the OpenGL texture is created in Upload)
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = 0;
                 texture.type = typeName;
                 texture.path = str;
-                textures.push_back(texture);
+                textures.push_back(this->textures_loaded.size());
                 this->textures_loaded.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+                this->images.push_back(DecodeTexture(str.C_Str(), this->directory));
             }
         }
         return textures;
@@ -269,21 +397,34 @@ private:
 // we load texture from disk, and we create OpenGL Texture Unit
 GLint TextureFromFile(const char* path, string directory)
 {
-     //Generate texture ID and load texture data
+    TextureImage image = DecodeTexture(path, directory);
+    return TextureFromImage(image);
+}
+
+// we load texture from disk (no OpenGL calls)
+TextureImage DecodeTexture(const char* path, string directory)
+{
     string filename = string(path);
     filename = directory + '/' + filename;
+    TextureImage image;
+    image.pixels = stbi_load(filename.c_str(), &image.width, &image.height, &image.channels, STBI_rgb);
+    return image;
+}
+
+// we create OpenGL Texture Unit from the decoded image
+GLint TextureFromImage(TextureImage &image)
+{
+     //Generate texture ID and load texture data
     GLuint textureID;
     glGenTextures(1, &textureID);
-    int width,height,channels;
-    unsigned char* image = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb);
 
     // Assign texture to ID
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    glState.BindTexture(GL_TEXTURE_2D, textureID);
     // 3 channels = RGB ; 4 channel = RGBA
-    if (channels==3)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    else if (channels==4)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    if (image.channels==3)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.pixels);
+    else if (image.channels==4)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
     glGenerateMipmap(GL_TEXTURE_2D);
 
     // we set how to consider UVs outside [0,1] range
@@ -292,8 +433,9 @@ GLint TextureFromFile(const char* path, string directory)
     // we set the filtering for minification and magnification
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
     glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    glState.BindTexture(GL_TEXTURE_2D, 0);
     // we free the memory once we have created an OpenGL texture
-    stbi_image_free(image);
+    stbi_image_free(image.pixels);
+    image.pixels = NULL;
     return textureID;
 }
@@ -0,0 +1,145 @@
+/*
+ExplosionParticles class
+- GPU particle effect for the explosions of the powerups hit by the car, drawn with a single instanced draw call of camera-facing quads
+- the application adds the exploding powerups each frame (center, time since the explosion, kind); particles are never stored or updated on the CPU
+- each particle moves along a fixed direction (a Fibonacci lattice on the sphere), computed in the vertex shader from its index (see explosion.vert)
+
+Instance data is advanced once per explosion (glVertexAttribDivisor = particlesPerExplosion), so gl_InstanceID % particlesPerExplosion is the index of the particle inside its explosion.
+The instance data are written directly in the StreamBuffer of the frame (see utils/stream_buffer.h), so the driver never waits for the previous frames and no copy is made.
+N.B.) Clear and Add allocate and write in the stream buffer: they must be called before its Commit, and not while draw calls are using it (without persistent mapping, the buffer is mapped until the Commit)
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+
+// GL Includes
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <utils/shader_v1.h>
+#include <utils/render_stats.h>
+#include <utils/stream_buffer.h>
+#include <utils/gl_state.h>
+
+/////////////////// EXPLOSIONPARTICLES class ///////////////////////
+class ExplosionParticles
+{
+public:
+    // particles of each explosion
+    GLuint particlesPerExplosion;
+    // maximum number of explosions drawn in a frame
+    GLuint maxExplosions;
+    // duration of an explosion (seconds), speed of the particles (units per second) and size of the quads (units)
+    GLfloat lifetime;
+    GLfloat speed;
+    GLfloat size;
+
+    //////////////////////////////////////////
+    // constructor: the instance data are allocated in "stream" at each frame
+    ExplosionParticles(GLuint particlesPerExplosion, GLuint maxExplosions, StreamBuffer &stream)
+        : particlesPerExplosion(particlesPerExplosion), maxExplosions(maxExplosions), lifetime(1.0f), speed(6.0f), size(0.08f), stream(stream), count(0)
+    {
+        this->instances.data = NULL;
+        this->instances.offset = 0;
+
+        // corners of the quad, drawn as a triangle strip
+        GLfloat corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->quadVBO);
+
+        glState.BindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+
+        // per explosion: center and elapsed time (location 1), kind (location 2). The pointers are set at each frame (see Draw)
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, particlesPerExplosion);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, particlesPerExplosion);
+
+        glState.BindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+    // we start collecting the explosions of a new frame, in space allocated for all of them
+    void Clear()
+    {
+        this->count = 0;
+        this->instances = this->stream.Allocate(this->maxExplosions * sizeof(ExplosionInstance));
+    }
+
+    //////////////////////////////////////////
+    // we add an explosion started "elapsed" seconds ago. Explosions already over are skipped
+    void Add(const glm::vec3 &center, GLfloat elapsed, bool speedUp)
+    {
+        if(elapsed >= this->lifetime || this->count >= this->maxExplosions || !this->instances.data)
+            return;
+        ExplosionInstance &instance = ((ExplosionInstance*)this->instances.data)[this->count++];
+        instance.center = center;
+        instance.elapsed = elapsed;
+        instance.kind = speedUp ? 1.0f : -1.0f;
+    }
+
+    //////////////////////////////////////////
+    // we draw all the particles of the collected explosions (the stream buffer must be committed).
+    // Particles are blended additively and they do not write depth and stencil (set through the GLState: the render graph sets again the state of the next pass)
+    void Draw(Shader &shader, glm::mat4 &projection, glm::mat4 &view, GLfloat time)
+    {
+        if(this->count == 0)
+            return;
+
+        shader.Use();
+        shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+        shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
+        shader.Uniform1i("particlesPerExplosion", this->particlesPerExplosion);
+        shader.Uniform1f("lifetime", this->lifetime);
+        shader.Uniform1f("speed", this->speed);
+        shader.Uniform1f("size", this->size);
+        shader.Uniform1f("u_time", time);
+
+        glState.DepthMask(GL_FALSE);
+        glState.StencilMask(0x00);
+        glState.BlendFunc(GL_SRC_ALPHA, GL_ONE);
+
+        GLuint instances = this->count * this->particlesPerExplosion;
+        glState.BindVertexArray(this->VAO);
+        // the instance data of this frame, in the stream buffer
+        glBindBuffer(GL_ARRAY_BUFFER, this->stream.buffer);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(ExplosionInstance), (GLvoid*)(size_t)this->instances.offset);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(ExplosionInstance), (GLvoid*)(size_t)(this->instances.offset + 4 * sizeof(GLfloat)));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances);
+        CountInstancedDraw(GL_TRIANGLE_STRIP, 4, instances);
+    }
+
+    //////////////////////////////////////////
+    // buffers are deallocated when application ends
+    void Delete()
+    {
+        glState.DeleteVertexArray(this->VAO);
+        glDeleteBuffers(1, &this->quadVBO);
+    }
+
+private:
+    // instance data of an explosion (5 floats)
+    struct ExplosionInstance {
+        glm::vec3 center;
+        GLfloat elapsed;
+        GLfloat kind;
+    };
+
+    GLuint VAO, quadVBO;
+    // instance data of the current frame, and number of explosions written
+    StreamBuffer &stream;
+    StreamAllocation instances;
+    GLuint count;
+};
@@ -0,0 +1,211 @@
+/*
+PostStack class
+- stack of post-processing effects applied in a single fullscreen pass: the effects are declared as modules, and the enabled ones are compiled into one uber fragment shader,
+  so the frame is read and written once, instead of once per effect
+- each module is a GLSL file included by the uber shader, with its code guarded by a define (e.g. POST_VIGNETTE), and a line of GLSL code applying it in main.
+  The stack generates the defines of the enabled modules, and the chains of their code for each stage (POST_HDR_CHAIN, POST_LDR_CHAIN), in the order they are declared
+- the stages of the uber shader: POST_STAGE_FETCH (an expression reading the scene at uv: the last enabled one replaces the plain read),
+  POST_STAGE_HDR (statements changing the linear HDR color), POST_STAGE_LDR (statements changing the color after the tonemapping)
+- each effect is toggled by a boolean of the application (e.g. a GUI checkbox): the permutation is chosen again at each Use
+- each combination of enabled effects is a permutation of the uber shader, loaded through the ShaderCache (and watched by the hot reload) the first time it is used:
+  while the driver compiles it, the last linked permutation is used
+- the uniforms of an effect are set by its callback, only when the effect is enabled (the uniforms of the disabled modules are not in the program)
+
+Usage:
+    PostStack post(cache, reload, "fullscreen.vert", "post.frag");
+    post.Add("Vignette", "POST_VIGNETTE", POST_STAGE_LDR, "color = Vignette(color, uv);", vignetteEnabled, [&](Shader &s){ s.Uniform1f("vignette", amount); });
+    post.Load();                 // permutation of the initial toggles, compiled with the other shaders
+    ... in the pass ...
+    Shader &shader = post.Use(); // the uniforms of the enabled effects are set
+    ... inputs of the uber shader (e.g. the scene texture) ...
+    fullscreen.Draw();
+
+At most 32 effects can be declared (the enabled ones are the bits of the key of a permutation).
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <iostream>
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/shader_v1.h>
+#include <utils/shader_cache.h>
+#include <utils/shader_reload.h>
+#include <utils/shader_preprocessor.h>
+
+// where the code of an effect is applied in the uber shader
+enum PostStage {
+    POST_STAGE_FETCH,
+    POST_STAGE_HDR,
+    POST_STAGE_LDR
+};
+
+// maximum number of effects of a stack
+const GLuint POST_MAX_EFFECTS = 32;
+
+// an effect of the stack
+struct PostEffect {
+    string name;
+    // define guarding the code of the module
+    string define;
+    PostStage stage;
+    // GLSL code applied in the uber shader (see PostStage)
+    string code;
+    // toggle of the application
+    bool* enabled;
+    function<void(Shader&)> setUniforms;
+};
+
+/////////////////// POSTSTACK class ///////////////////////
+class PostStack
+{
+public:
+    //////////////////////////////////////////
+    PostStack(ShaderCache &cache, ShaderHotReload &reload, const string &vertexPath, const string &fragmentPath)
+        : cache(cache), reload(reload), vertexPath(vertexPath), fragmentPath(fragmentPath), last(NO_PERMUTATION)
+    {
+    }
+
+    //////////////////////////////////////////
+    // we declare an effect, enabled while "enabled" is true. N.B.) the boolean must live as long as the stack
+    void Add(const string &name, const string &define, PostStage stage, const string &code, bool &enabled, function<void(Shader&)> setUniforms)
+    {
+        if(this->effects.size() == POST_MAX_EFFECTS)
+        {
+            cout << "ERROR::POSTSTACK:: Too many effects, " << name << " is ignored" << endl;
+            return;
+        }
+        PostEffect e;
+        e.name = name;
+        e.define = define;
+        e.stage = stage;
+        e.code = code;
+        e.enabled = &enabled;
+        e.setUniforms = setUniforms;
+        this->effects.push_back(e);
+    }
+
+    //////////////////////////////////////////
+    // we start the compilation of the permutation of the enabled effects, if it is not loaded yet (without waiting for the driver)
+    void Load()
+    {
+        GLuint key = this->Key();
+        if(this->permutations.find(key) != this->permutations.end())
+            return;
+        ShaderDefines defines = this->Defines();
+        Permutation &p = this->permutations.insert(make_pair(key, Permutation(this->cache.Load(this->vertexPath, this->fragmentPath, defines)))).first->second;
+        // the Shader is stored in the map: its address does not change
+        this->reload.Watch(p.shader, this->vertexPath, this->fragmentPath, defines);
+    }
+
+    //////////////////////////////////////////
+    // we use the permutation of the enabled effects (or the last linked one, if it is still compiling or it has errors), and we set the uniforms of its effects
+    Shader &Use()
+    {
+        this->Load();
+        GLuint key = this->Key();
+        Permutation &p = this->permutations.find(key)->second;
+        // the first permutation is waited for: there is nothing else to use
+        if(p.pending && (this->last == NO_PERMUTATION || this->cache.Ready(p.shader.Program)))
+        {
+            p.pending = false;
+            p.linked = this->cache.Finish(p.shader.Program);
+            p.generation = p.shader.Generation;
+            if(!p.linked)
+                cout << "ERROR::POSTSTACK:: The permutation of the enabled effects is not linked, the previous one is used" << endl;
+        }
+        // a failed permutation is replaced by the hot reload only when the new program is linked
+        if(!p.pending && !p.linked && p.shader.Generation != p.generation)
+            p.linked = true;
+        if(p.linked)
+            this->last = key;
+
+        GLuint used = this->last == NO_PERMUTATION ? key : this->last;
+        Shader &shader = this->permutations.find(used)->second.shader;
+        shader.Use();
+        for(GLuint i = 0; i < this->effects.size(); i++)
+            if((used >> i) & 1u && this->effects[i].setUniforms)
+                this->effects[i].setUniforms(shader);
+        return shader;
+    }
+
+    //////////////////////////////////////////
+    // permutations loaded so far
+    GLuint Permutations() { return this->permutations.size(); }
+
+    //////////////////////////////////////////
+    // the programs are deleted when application ends (after the hot reload, see ShaderHotReload::Delete)
+    void Delete()
+    {
+        for(map<GLuint, Permutation>::iterator it = this->permutations.begin(); it != this->permutations.end(); ++it)
+            it->second.shader.Delete();
+        this->permutations.clear();
+    }
+
+private:
+    // a permutation of the uber shader: it can be still compiling, or not linked
+    struct Permutation {
+        Shader shader;
+        bool pending;
+        bool linked;
+        // Generation of the Shader when the link failed: it changes when the hot reload replaces the program
+        GLuint generation;
+        Permutation(const Shader &shader) : shader(shader), pending(true), linked(false), generation(0) {}
+    };
+
+    static const GLuint NO_PERMUTATION = 0xFFFFFFFF;
+
+    ShaderCache &cache;
+    ShaderHotReload &reload;
+    string vertexPath, fragmentPath;
+    // effects in the order they are applied (inside their stage)
+    vector<PostEffect> effects;
+    map<GLuint, Permutation> permutations;
+    // key of the last linked permutation used
+    GLuint last;
+
+    //////////////////////////////////////////
+    // bit i is set if effect i is enabled
+    GLuint Key()
+    {
+        GLuint key = 0;
+        for(GLuint i = 0; i < this->effects.size(); i++)
+            if(*this->effects[i].enabled)
+                key |= 1u << i;
+        return key;
+    }
+
+    //////////////////////////////////////////
+    // the guards of the enabled modules, and the generated code of each stage
+    ShaderDefines Defines()
+    {
+        ShaderDefines defines;
+        string hdr, ldr;
+        for(GLuint i = 0; i < this->effects.size(); i++)
+        {
+            const PostEffect &e = this->effects[i];
+            if(!*e.enabled)
+                continue;
+            defines.Set(e.define, 1);
+            if(e.stage == POST_STAGE_FETCH)
+                defines.Set("POST_FETCH", e.code);
+            else if(e.stage == POST_STAGE_HDR)
+                hdr += e.code + " ";
+            else
+                ldr += e.code + " ";
+        }
+        // the chains are single-line macros
+        defines.Set("POST_HDR_CHAIN", hdr);
+        defines.Set("POST_LDR_CHAIN", ldr);
+        return defines;
+    }
+};
@@ -0,0 +1,494 @@
+/*
+RenderGraph class
+- declarative description of the rendering of a frame: a list of passes, each one with the render target it writes, the targets it reads (as textures) and its depth / stencil / blending state
+- the graph is compiled once (and again only when a pass is enabled or disabled) into the list of the passes to execute: disabled passes, and passes whose output is never used, are skipped
+- transient render targets (e.g. the buffers of a post-process) are allocated by the graph: targets with the same description and not overlapping lifetimes share the same framebuffer (aliasing).
+  Multisampled targets use renderbuffers: they cannot be sampled, and they are resolved by a pass blitting their Framebuffer in a single-sampled target
+- at execution, the graph binds the framebuffer of each pass, clears the targets at their first use in the frame, sets the state of the pass through the GLState (which filters the states equal to the current ones), and opens a CPU zone and a GPU profiler scope with the name of the pass
+
+Passes are executed in the order they are added: a pass can read only the targets written by the previous passes.
+Imported targets (the window, or the offscreen target of the benchmark) are the outputs of the frame: the passes writing them are never culled.
+
+N.B.) the callback of a pass can change the state through the GLState (see utils/gl_state.h): the complete state of each pass is set again before its execution
+N.B.) the names of the passes are kept by the CPU profiler: all the passes must be added before the first Execute
+
+Usage:
+    RenderGraph graph(gpuProfiler);
+    GLuint screen = graph.ImportTarget("screen", 0, width, height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    GLuint grid = graph.AddPass("NEONGRID", [&](){ ... draw calls ... });
+    graph.Write(grid, screen);
+    ... in the render loop ...
+    graph.Execute();
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <functional>
+#include <iostream>
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/gpu_profiler.h>
+#include <utils/cpu_profiler.h>
+#include <utils/gl_state.h>
+
+// invalid pass or target
+const GLuint RENDER_GRAPH_NONE = 0xFFFFFFFF;
+
+// depth, stencil and blending state of a pass (default: the state set by the application at startup, without stencil writes)
+struct RenderState {
+    GLboolean depthTest;
+    GLenum depthFunc;
+    GLboolean depthWrite;
+    GLboolean stencilTest;
+    GLenum stencilFunc;
+    GLint stencilRef;
+    GLuint stencilReadMask;
+    GLuint stencilWriteMask;
+    GLboolean blend;
+    GLenum blendSrc, blendDst;
+
+    RenderState()
+        : depthTest(GL_TRUE), depthFunc(GL_LESS), depthWrite(GL_TRUE),
+          stencilTest(GL_TRUE), stencilFunc(GL_ALWAYS), stencilRef(1), stencilReadMask(0xFF), stencilWriteMask(0x00),
+          blend(GL_TRUE), blendSrc(GL_SRC_ALPHA), blendDst(GL_ONE_MINUS_SRC_ALPHA) {}
+};
+
+// state of the fullscreen passes (post-processing): each pixel is written once, without depth and stencil tests and without blending
+RenderState FullscreenState()
+{
+    RenderState state;
+    state.depthTest = GL_FALSE;
+    state.depthWrite = GL_FALSE;
+    state.stencilTest = GL_FALSE;
+    state.blend = GL_FALSE;
+    return state;
+}
+
+// description of a transient render target: color texture (if colorFormat is not 0) and depth / stencil buffer
+struct RenderTargetDesc {
+    GLint width, height;
+    // internal format of the color texture (e.g. GL_RGBA16F), 0 for none
+    GLenum colorFormat;
+    bool depthStencil;
+    // MSAA samples (more than 1: color and depth / stencil are multisampled renderbuffers)
+    GLint samples;
+
+    RenderTargetDesc(GLint width = 0, GLint height = 0, GLenum colorFormat = GL_RGBA8, bool depthStencil = false, GLint samples = 1)
+        : width(width), height(height), colorFormat(colorFormat), depthStencil(depthStencil), samples(samples) {}
+
+    bool operator==(const RenderTargetDesc &other) const
+    {
+        return this->width == other.width && this->height == other.height && this->colorFormat == other.colorFormat && this->depthStencil == other.depthStencil &&
+               this->samples == other.samples;
+    }
+};
+
+/////////////////// RENDERGRAPH class ///////////////////////
+class RenderGraph
+{
+public:
+    //////////////////////////////////////////
+    RenderGraph(GPUProfiler &profiler)
+        : profiler(profiler), dirty(true), executedPasses(0) {}
+
+    //////////////////////////////////////////
+    // a target owned by the application (e.g. the default framebuffer): "clearMask" buffers are cleared at its first use in the frame
+    GLuint ImportTarget(const string &name, GLuint framebuffer, GLint width, GLint height, GLbitfield clearMask)
+    {
+        GraphTarget t;
+        t.name = name;
+        t.imported = true;
+        t.framebuffer = framebuffer;
+        t.desc = RenderTargetDesc(width, height, 0, false);
+        t.clearMask = clearMask;
+        this->targets.push_back(t);
+        return this->targets.size() - 1;
+    }
+
+    // the imported framebuffer can change (e.g. window resize)
+    void SetImportedTarget(GLuint target, GLuint framebuffer, GLint width, GLint height)
+    {
+        this->targets[target].framebuffer = framebuffer;
+        this->targets[target].desc.width = width;
+        this->targets[target].desc.height = height;
+    }
+
+    //////////////////////////////////////////
+    // a target allocated by the graph, valid only between the passes that use it
+    GLuint CreateTarget(const string &name, const RenderTargetDesc &desc, GLbitfield clearMask)
+    {
+        GraphTarget t;
+        t.name = name;
+        t.imported = false;
+        t.framebuffer = 0;
+        t.physical = RENDER_GRAPH_NONE;
+        t.desc = desc;
+        t.clearMask = clearMask;
+        this->targets.push_back(t);
+        this->dirty = true;
+        return this->targets.size() - 1;
+    }
+
+    // a transient target with a new size: it will be allocated again at the next compilation
+    void ResizeTarget(GLuint target, GLint width, GLint height)
+    {
+        if(this->targets[target].desc.width == width && this->targets[target].desc.height == height)
+            return;
+        this->targets[target].desc.width = width;
+        this->targets[target].desc.height = height;
+        this->dirty = true;
+    }
+
+    //////////////////////////////////////////
+    // we add a pass, executed after the ones already added
+    GLuint AddPass(const string &name, const function<void()> &execute)
+    {
+        GraphPass p;
+        p.name = name;
+        p.execute = execute;
+        p.enabled = true;
+        p.output = RENDER_GRAPH_NONE;
+        this->passes.push_back(p);
+        this->dirty = true;
+        return this->passes.size() - 1;
+    }
+
+    // the pass renders in "target"
+    void Write(GLuint pass, GLuint target)
+    {
+        this->passes[pass].output = target;
+        this->dirty = true;
+    }
+
+    // the pass samples the color texture of "target" (see Texture)
+    void Read(GLuint pass, GLuint target)
+    {
+        this->passes[pass].inputs.push_back(target);
+        this->dirty = true;
+    }
+
+    // the targets read by the pass are declared again (e.g. the input of the pass depends on a setting)
+    void ClearReads(GLuint pass)
+    {
+        this->passes[pass].inputs.clear();
+        this->dirty = true;
+    }
+
+    void SetState(GLuint pass, const RenderState &state)
+    {
+        this->passes[pass].state = state;
+    }
+
+    // passes can be enabled and disabled at each frame: the graph is compiled again only if something changed
+    void SetEnabled(GLuint pass, bool enabled)
+    {
+        if(this->passes[pass].enabled != enabled)
+        {
+            this->passes[pass].enabled = enabled;
+            this->dirty = true;
+        }
+    }
+
+    //////////////////////////////////////////
+    // color texture of a target, to be sampled by the passes reading it (0 for the imported and the multisampled ones,
+    // and for the transient targets not used by the executed passes, which have no framebuffer)
+    GLuint Texture(GLuint target)
+    {
+        if(this->dirty)
+            this->Compile();
+        const GraphTarget &t = this->targets[target];
+        if(t.imported || t.physical == RENDER_GRAPH_NONE)
+            return 0;
+        return this->physical[t.physical].texture;
+    }
+
+    // framebuffer of a target (e.g. the source of a glBlitFramebuffer). 0 for the transient targets not used by the executed passes
+    GLuint Framebuffer(GLuint target)
+    {
+        if(this->dirty)
+            this->Compile();
+        const GraphTarget &t = this->targets[target];
+        if(t.imported)
+            return t.framebuffer;
+        return t.physical == RENDER_GRAPH_NONE ? 0 : this->physical[t.physical].framebuffer;
+    }
+
+    //////////////////////////////////////////
+    // we compute the passes to execute, the lifetimes of the transient targets and their framebuffers
+    void Compile()
+    {
+        this->dirty = false;
+        this->order.clear();
+
+        // from the last pass to the first one: a pass is needed if it writes an imported target, or a target read by a needed pass
+        vector<bool> needed(this->targets.size(), false);
+        for(GLuint t = 0; t < this->targets.size(); t++)
+            needed[t] = this->targets[t].imported;
+        vector<bool> live(this->passes.size(), false);
+        for(GLint p = (GLint)this->passes.size() - 1; p >= 0; p--)
+        {
+            GraphPass &pass = this->passes[p];
+            if(!pass.enabled || (pass.output != RENDER_GRAPH_NONE && !needed[pass.output]))
+                continue;
+            live[p] = true;
+            for(GLuint i = 0; i < pass.inputs.size(); i++)
+                needed[pass.inputs[i]] = true;
+        }
+
+        // first and last pass using each target
+        for(GLuint t = 0; t < this->targets.size(); t++)
+        {
+            this->targets[t].firstUse = RENDER_GRAPH_NONE;
+            this->targets[t].lastUse = 0;
+        }
+        for(GLuint p = 0; p < this->passes.size(); p++)
+        {
+            if(!live[p])
+                continue;
+            GLuint index = this->order.size();
+            this->order.push_back(p);
+            GraphPass &pass = this->passes[p];
+            for(GLuint i = 0; i < pass.inputs.size(); i++)
+            {
+                GraphTarget &t = this->targets[pass.inputs[i]];
+                if(t.firstUse == RENDER_GRAPH_NONE)
+                    cout << "ERROR::RENDERGRAPH:: Pass " << pass.name << " reads " << t.name << " before it is written" << endl;
+                t.lastUse = index;
+            }
+            if(pass.output != RENDER_GRAPH_NONE)
+            {
+                GraphTarget &t = this->targets[pass.output];
+                if(t.firstUse == RENDER_GRAPH_NONE)
+                    t.firstUse = index;
+                t.lastUse = index;
+            }
+        }
+
+        // transient targets share the framebuffers of the targets already dead, with the same description
+        for(GLuint f = 0; f < this->physical.size(); f++)
+            this->physical[f].freeAfter = 0;
+        vector<bool> assigned(this->physical.size(), false);
+        for(GLuint index = 0; index < this->order.size(); index++)
+        {
+            for(GLuint t = 0; t < this->targets.size(); t++)
+            {
+                GraphTarget &target = this->targets[t];
+                if(target.imported || target.firstUse != index)
+                    continue;
+                target.physical = RENDER_GRAPH_NONE;
+                for(GLuint f = 0; f < this->physical.size(); f++)
+                {
+                    if(this->physical[f].desc == target.desc && (!assigned[f] || this->physical[f].freeAfter < index))
+                    {
+                        target.physical = f;
+                        break;
+                    }
+                }
+                if(target.physical == RENDER_GRAPH_NONE)
+                {
+                    this->physical.push_back(this->CreateFramebuffer(target.desc));
+                    assigned.push_back(false);
+                    target.physical = this->physical.size() - 1;
+                }
+                assigned[target.physical] = true;
+                this->physical[target.physical].freeAfter = target.lastUse;
+            }
+        }
+
+        // framebuffers not used anymore (e.g. after a resize) are deleted
+        for(GLuint f = 0; f < this->physical.size(); )
+        {
+            if(assigned[f])
+            {
+                f++;
+                continue;
+            }
+            this->DeleteFramebuffer(this->physical[f]);
+            this->physical.erase(this->physical.begin() + f);
+            assigned.erase(assigned.begin() + f);
+            for(GLuint t = 0; t < this->targets.size(); t++)
+                if(!this->targets[t].imported && this->targets[t].physical != RENDER_GRAPH_NONE && this->targets[t].physical > f)
+                    this->targets[t].physical--;
+        }
+    }
+
+    //////////////////////////////////////////
+    // we execute the passes of the frame
+    void Execute()
+    {
+        if(this->dirty)
+            this->Compile();
+
+        GLuint boundFramebuffer = RENDER_GRAPH_NONE;
+        for(GLuint index = 0; index < this->order.size(); index++)
+        {
+            GraphPass &pass = this->passes[this->order[index]];
+            CPU_ZONE_BEGIN(pass.name.c_str());
+            this->profiler.Begin(pass.name);
+
+            if(pass.output != RENDER_GRAPH_NONE)
+            {
+                GraphTarget &target = this->targets[pass.output];
+                GLuint framebuffer = target.imported ? target.framebuffer : this->physical[target.physical].framebuffer;
+                if(framebuffer != boundFramebuffer)
+                {
+                    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                    glViewport(0, 0, target.desc.width, target.desc.height);
+                    boundFramebuffer = framebuffer;
+                }
+                if(target.firstUse == index && target.clearMask)
+                {
+                    // the write masks must be enabled to clear depth and stencil
+                    glState.DepthMask(GL_TRUE);
+                    glState.StencilMask(0xFF);
+                    glClear(target.clearMask);
+                }
+            }
+            this->Apply(pass.state);
+
+            pass.execute();
+
+            this->profiler.End();
+            CPU_ZONE_END();
+        }
+        this->executedPasses = this->order.size();
+    }
+
+    //////////////////////////////////////////
+    // passes executed in the last frame, and framebuffers allocated for the transient targets
+    GLuint ExecutedPasses() { return this->executedPasses; }
+    GLuint PassCount() { return this->passes.size(); }
+    GLuint FramebufferCount() { return this->physical.size(); }
+
+    //////////////////////////////////////////
+    // the framebuffers of the transient targets are deleted when application ends
+    void Delete()
+    {
+        for(GLuint f = 0; f < this->physical.size(); f++)
+            this->DeleteFramebuffer(this->physical[f]);
+        this->physical.clear();
+        this->dirty = true;
+    }
+
+private:
+    struct GraphPass {
+        string name;
+        function<void()> execute;
+        bool enabled;
+        GLuint output;
+        vector<GLuint> inputs;
+        RenderState state;
+    };
+
+    struct GraphTarget {
+        string name;
+        bool imported;
+        // imported framebuffer
+        GLuint framebuffer;
+        RenderTargetDesc desc;
+        GLbitfield clearMask;
+        // first and last position in the execution order, and framebuffer of a transient target
+        GLuint firstUse, lastUse;
+        GLuint physical;
+    };
+
+    // framebuffer of one or more transient targets (the color is a texture, or a renderbuffer if multisampled)
+    struct PhysicalTarget {
+        RenderTargetDesc desc;
+        GLuint framebuffer, texture, colorBuffer, depthStencil;
+        // last pass (in the execution order) using it
+        GLuint freeAfter;
+    };
+
+    GPUProfiler &profiler;
+    vector<GraphPass> passes;
+    vector<GraphTarget> targets;
+    vector<PhysicalTarget> physical;
+    // passes to execute
+    vector<GLuint> order;
+    bool dirty;
+    GLuint executedPasses;
+
+    //////////////////////////////////////////
+    // we set the complete state of the pass: the GLState issues only the states changed by the previous passes
+    void Apply(const RenderState &s)
+    {
+        glState.Set(GL_DEPTH_TEST, s.depthTest);
+        glState.DepthFunc(s.depthFunc);
+        glState.DepthMask(s.depthWrite);
+        glState.Set(GL_STENCIL_TEST, s.stencilTest);
+        glState.StencilFunc(s.stencilFunc, s.stencilRef, s.stencilReadMask);
+        glState.StencilMask(s.stencilWriteMask);
+        glState.Set(GL_BLEND, s.blend);
+        glState.BlendFunc(s.blendSrc, s.blendDst);
+    }
+
+    //////////////////////////////////////////
+    PhysicalTarget CreateFramebuffer(const RenderTargetDesc &desc)
+    {
+        PhysicalTarget f;
+        f.desc = desc;
+        f.texture = 0;
+        f.colorBuffer = 0;
+        f.depthStencil = 0;
+        f.freeAfter = 0;
+        glGenFramebuffers(1, &f.framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, f.framebuffer);
+        if(desc.colorFormat && desc.samples > 1)
+        {
+            glGenRenderbuffers(1, &f.colorBuffer);
+            glBindRenderbuffer(GL_RENDERBUFFER, f.colorBuffer);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, desc.colorFormat, desc.width, desc.height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, f.colorBuffer);
+        }
+        else if(desc.colorFormat)
+        {
+            glGenTextures(1, &f.texture);
+            glState.BindTexture(GL_TEXTURE_2D, f.texture);
+            // the format and type of the data are ignored (no data), but they must be valid for the internal format
+            glTexImage2D(GL_TEXTURE_2D, 0, desc.colorFormat, desc.width, desc.height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glState.BindTexture(GL_TEXTURE_2D, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, f.texture, 0);
+        }
+        else
+            glDrawBuffer(GL_NONE);
+        if(desc.depthStencil)
+        {
+            glGenRenderbuffers(1, &f.depthStencil);
+            glBindRenderbuffer(GL_RENDERBUFFER, f.depthStencil);
+            if(desc.samples > 1)
+                glRenderbufferStorageMultisample(GL_RENDERBUFFER, desc.samples, GL_DEPTH24_STENCIL8, desc.width, desc.height);
+            else
+                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, desc.width, desc.height);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, f.depthStencil);
+        }
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::RENDERGRAPH:: Framebuffer is not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return f;
+    }
+
+    void DeleteFramebuffer(PhysicalTarget &f)
+    {
+        glDeleteFramebuffers(1, &f.framebuffer);
+        if(f.texture)
+            glState.DeleteTexture(f.texture);
+        if(f.colorBuffer)
+            glDeleteRenderbuffers(1, &f.colorBuffer);
+        if(f.depthStencil)
+            glDeleteRenderbuffers(1, &f.depthStencil);
+    }
+};
@@ -0,0 +1,77 @@
+/*
+Render statistics
+- per-frame counters of the work submitted by the application: draw calls (and how many of them are instanced), primitives, program and texture binds, uniform uploads,
+  bytes written in the buffers, stencil state changes, and objects skipped by the culling
+- the counters are updated by the utils classes where the work is issued: the draw functions (Mesh, GeometryArena, Terrain, GridNoise, ExplosionParticles) call CountDraw or
+  CountInstancedDraw, the GLState counts the program, texture and stencil changes actually issued (the filtered ones are not counted), the uniform setters of Shader (Uniform1f, ...) count the uniform uploads,
+  StreamBuffer::Allocate counts the bytes allocated for the CPU writes. The culled objects are counted by the application
+- the counters are reset by the application at the beginning of each frame
+
+Triangles are counted as submitted by the draw calls (before culling and before any geometry shader).
+Uniform uploads are the values sent to the driver by the uniform setters of Shader: the uniforms not in the program (location -1) are not counted, and looking up a location (Shader::Uniform) is never counted.
+*/
+
+#pragma once
+
+// GL Includes
+#include <glad/glad.h>
+
+struct RenderStats {
+    // draw calls issued in the frame, and how many of them are instanced
+    GLuint drawCalls;
+    GLuint instancedDraws;
+    // triangles submitted in the frame
+    GLuint64 triangles;
+    // vertices processed in the frame (all the primitive types)
+    GLuint64 vertices;
+    // glUseProgram and glBindTexture calls issued to the driver
+    GLuint programBinds;
+    GLuint textureBinds;
+    // uniform values set
+    GLuint uniformUploads;
+    // bytes allocated in the buffers for the data written by the CPU in the frame
+    GLuint64 bufferBytes;
+    // stencil function, operation and write mask changes issued to the driver
+    GLuint stencilChanges;
+    // objects not drawn because outside of the view frustum
+    GLuint culledObjects;
+
+    RenderStats() { this->Reset(); }
+
+    void Reset()
+    {
+        this->drawCalls = 0;
+        this->instancedDraws = 0;
+        this->triangles = 0;
+        this->vertices = 0;
+        this->programBinds = 0;
+        this->textureBinds = 0;
+        this->uniformUploads = 0;
+        this->bufferBytes = 0;
+        this->stencilChanges = 0;
+        this->culledObjects = 0;
+    }
+};
+
+// counters of the current frame
+RenderStats renderStats;
+
+//////////////////////////////////////////
+// we count a draw call of "count" vertices (or indices) with the given primitive mode
+void CountDraw(GLenum mode, GLuint count, GLuint instances = 1)
+{
+    renderStats.drawCalls++;
+    renderStats.vertices += (GLuint64)count * instances;
+    if(mode == GL_TRIANGLES)
+        renderStats.triangles += (GLuint64)(count / 3) * instances;
+    else if((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count > 2)
+        renderStats.triangles += (GLuint64)(count - 2) * instances;
+}
+
+//////////////////////////////////////////
+// we count an instanced draw call (glDraw*Instanced*) of "instances" copies
+void CountInstancedDraw(GLenum mode, GLuint count, GLuint instances)
+{
+    renderStats.instancedDraws++;
+    CountDraw(mode, count, instances);
+}
@@ -0,0 +1,287 @@
+/*
+Session record and replay
+- InputRecorder class: it writes, frame by frame, everything the gameplay depends on (frame time, key events, scroll speed and street width set from the GUI, music restarted or changed from the GUI), together with the hash of the simulation state
+- InputReplayer class: it reads a recording and feeds it back to the application, checking that the simulation reaches the same states
+- HashFile: hash of the music track, so a session is replayed only with the same audio
+
+The recording is a text file. The header stores the format version, the seed of the simulation, its rate and the music track.
+Then there is one line for each frame:
+    F <deltaTime> <scrollSpeed> <streetBorder> <stateHash> <number of key events> [<key> <action>]...
+preceded, in the frames where the music is restarted or changed, by the line of the new track:
+    M <trackHash> <trackPath>
+Floats are written in hexadecimal notation (e.g. 0x1.1111p-6), so they are read back bit-exactly.
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <stdint.h>
+
+// GL Includes (only for the types)
+#include <glad/glad.h>
+
+const GLuint REPLAY_VERSION = 4;
+
+//////////////////////////////////////////
+// FNV-1a hash of the content of a file (0 if the file cannot be read)
+uint64_t HashFile(const string &path)
+{
+    ifstream file(path.c_str(), ios::binary);
+    if(!file.is_open())
+        return 0;
+    uint64_t hash = 14695981039346656037ULL;
+    char buffer[4096];
+    while(file.read(buffer, sizeof(buffer)) || file.gcount() > 0)
+    {
+        for(streamsize i = 0; i < file.gcount(); i++)
+        {
+            hash ^= (unsigned char)buffer[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+// a key event received by the GLFW callback
+struct ReplayKeyEvent {
+    GLint key;
+    GLint action;
+};
+
+// what the gameplay received in a frame, and the state it reached
+struct ReplayFrame {
+    GLfloat deltaTime;
+    GLfloat scrollSpeed;
+    GLfloat streetBorder;
+    uint32_t stateHash;
+    vector<ReplayKeyEvent> keys;
+    // the music was restarted (or changed) in the frame, before the simulation step
+    bool musicChanged;
+    string musicPath;
+    uint64_t musicHash;
+};
+
+// header of a recording
+struct ReplayHeader {
+    uint64_t seed;
+    GLfloat simulationRate;
+    string trackPath;
+    uint64_t trackHash;
+};
+
+/////////////////// INPUTRECORDER class ///////////////////////
+class InputRecorder
+{
+public:
+    //////////////////////////////////////////
+    InputRecorder() : frames(0) {}
+
+    //////////////////////////////////////////
+    // we open the file and we write the header. It returns false if the file cannot be written
+    bool Open(const string &path, const ReplayHeader &header)
+    {
+        this->file.open(path.c_str());
+        if(!this->file.is_open())
+        {
+            cout << "ERROR::INPUTRECORDER:: Cannot write " << path << endl;
+            return false;
+        }
+        this->file << "RETROWAVE_REPLAY " << REPLAY_VERSION << "\n";
+        this->file << "seed " << header.seed << "\n";
+        this->file << "rate " << hexfloat << header.simulationRate << defaultfloat << "\n";
+        this->file << "track " << header.trackHash << " " << header.trackPath << "\n";
+        return true;
+    }
+
+    bool IsOpen()
+    {
+        return this->file.is_open();
+    }
+
+    //////////////////////////////////////////
+    // key events are stored until the end of the frame
+    void RecordKey(GLint key, GLint action)
+    {
+        ReplayKeyEvent event;
+        event.key = key;
+        event.action = action;
+        this->keys.push_back(event);
+    }
+
+    //////////////////////////////////////////
+    // the music is restarted (or changed) in the current frame: the line is written before the one of the frame
+    void RecordMusic(const string &path, uint64_t hash)
+    {
+        if(!this->file.is_open())
+            return;
+        this->file << "M " << hash << " " << path << "\n";
+    }
+
+    //////////////////////////////////////////
+    // we write the line of the frame
+    void EndFrame(GLfloat deltaTime, GLfloat scrollSpeed, GLfloat streetBorder, uint32_t stateHash)
+    {
+        if(!this->file.is_open())
+            return;
+        this->file << "F " << hexfloat << deltaTime << " " << scrollSpeed << " " << streetBorder << defaultfloat
+                   << " " << stateHash << " " << this->keys.size();
+        for(GLuint i = 0; i < this->keys.size(); i++)
+            this->file << " " << this->keys[i].key << " " << this->keys[i].action;
+        this->file << "\n";
+        this->keys.clear();
+        this->frames++;
+    }
+
+    //////////////////////////////////////////
+    void Close()
+    {
+        if(!this->file.is_open())
+            return;
+        this->file.close();
+        cout << "Session recorded: " << this->frames << " frames" << endl;
+    }
+
+private:
+    ofstream file;
+    vector<ReplayKeyEvent> keys;
+    GLuint frames;
+};
+
+/////////////////// INPUTREPLAYER class ///////////////////////
+class InputReplayer
+{
+public:
+    ReplayHeader header;
+
+    //////////////////////////////////////////
+    InputReplayer() : next(0), firstMismatch(-1), mismatches(0) {}
+
+    //////////////////////////////////////////
+    // we read the whole recording. It returns false if the file cannot be read or it is not a valid recording
+    bool Load(const string &path)
+    {
+        ifstream file(path.c_str());
+        if(!file.is_open())
+        {
+            cout << "ERROR::INPUTREPLAYER:: Cannot read " << path << endl;
+            return false;
+        }
+
+        string line, tag;
+        GLuint version = 0;
+        // music line, applied in the next frame
+        ReplayFrame music;
+        music.musicChanged = false;
+        music.musicHash = 0;
+        getline(file, line);
+        istringstream(line) >> tag >> version;
+        if(tag != "RETROWAVE_REPLAY" || version != REPLAY_VERSION)
+        {
+            cout << "ERROR::INPUTREPLAYER:: " << path << " is not a recording (version " << REPLAY_VERSION << ")" << endl;
+            return false;
+        }
+
+        while(getline(file, line))
+        {
+            istringstream stream(line);
+            stream >> tag;
+            if(tag == "seed")
+                stream >> this->header.seed;
+            else if(tag == "rate")
+                this->header.simulationRate = this->ReadFloat(stream);
+            else if(tag == "track")
+            {
+                stream >> this->header.trackHash;
+                stream.get();
+                getline(stream, this->header.trackPath);
+            }
+            else if(tag == "M")
+            {
+                music.musicChanged = true;
+                stream >> music.musicHash;
+                stream.get();
+                getline(stream, music.musicPath);
+            }
+            else if(tag == "F")
+            {
+                ReplayFrame frame = music;
+                music.musicChanged = false;
+                GLuint keyCount = 0;
+                frame.deltaTime = this->ReadFloat(stream);
+                frame.scrollSpeed = this->ReadFloat(stream);
+                frame.streetBorder = this->ReadFloat(stream);
+                stream >> frame.stateHash >> keyCount;
+                frame.keys.resize(keyCount);
+                for(GLuint i = 0; i < keyCount; i++)
+                    stream >> frame.keys[i].key >> frame.keys[i].action;
+                this->frames.push_back(frame);
+            }
+        }
+        cout << "Replaying " << path << ": " << this->frames.size() << " frames" << endl;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    bool Finished()
+    {
+        return this->next >= this->frames.size();
+    }
+
+    //////////////////////////////////////////
+    // the frame to be replayed now
+    const ReplayFrame& Current()
+    {
+        return this->frames[this->next];
+    }
+
+    //////////////////////////////////////////
+    // we compare the state reached by the simulation with the recorded one, and we move to the next frame
+    void EndFrame(uint32_t stateHash)
+    {
+        if(this->Finished())
+            return;
+        if(stateHash != this->frames[this->next].stateHash)
+        {
+            if(this->firstMismatch < 0)
+            {
+                this->firstMismatch = this->next;
+                cout << "Replay diverged at frame " << this->next << endl;
+            }
+            this->mismatches++;
+        }
+        this->next++;
+    }
+
+    //////////////////////////////////////////
+    // summary of the comparison
+    void Report()
+    {
+        if(this->firstMismatch < 0)
+            cout << "Replay matched the recording for " << this->next << " frames" << endl;
+        else
+            cout << "Replay diverged from frame " << this->firstMismatch << " (" << this->mismatches << " of " << this->next << " frames differ)" << endl;
+    }
+
+private:
+    vector<ReplayFrame> frames;
+    GLuint next;
+    GLint firstMismatch;
+    GLuint mismatches;
+
+    //////////////////////////////////////////
+    // hexadecimal floats are parsed with strtof (stream extraction does not support them everywhere)
+    GLfloat ReadFloat(istringstream &stream)
+    {
+        string token;
+        stream >> token;
+        return strtof(token.c_str(), NULL);
+    }
+};
@@ -0,0 +1,395 @@
+/*
+ShaderCache class
+- creation of the Shader Programs of the application through a disk cache of program binaries (glGetProgramBinary / glProgramBinary)
+- the key of a program is the hash of the sources of its stages (and of the captured outputs), together with the vendor, renderer and version strings of the driver: a new driver or a changed source invalidates the cached binary
+- the sources are expanded by the ShaderPreprocessor (#include of the shared files, #define values of the permutation): each permutation of a program is a different entry of the cache
+- the source files can be read from a source root (e.g. the project directory, instead of the copies in the build directory, see SetSourceRoot): a file missing there is read from the working directory
+- programs not in the cache are compiled and linked without waiting: link status is checked later, in Finish(), so all the programs compile concurrently in the driver (with GL_KHR_parallel_shader_compile, on its own threads)
+
+Usage:
+    ShaderCache cache("shader_cache");
+    Shader a = cache.Load("a.vert", "a.frag");
+    Shader b = cache.Load("b.vert", "b.frag", ShaderDefines().Set("QUALITY", 2));
+    ... other work (e.g. model loading) while the driver compiles ...
+    cache.Finish();
+
+If the driver does not support program binaries (GL_NUM_PROGRAM_BINARY_FORMATS is 0, or the functions are not available), programs are always compiled from source.
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <stdint.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+#else
+    #include <sys/stat.h>
+#endif
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/shader_v1.h>
+#include <utils/shader_preprocessor.h>
+
+// GL_KHR_parallel_shader_compile is not loaded by glad: the application passes the function pointer (see EnableParallelCompile)
+#ifndef GL_COMPLETION_STATUS_KHR
+    #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+/////////////////// SHADERCACHE class ///////////////////////
+class ShaderCache
+{
+public:
+    // programs loaded from the cache, and compiled from source
+    GLuint hits, misses;
+
+    //////////////////////////////////////////
+    // constructor: the binaries are stored in "directory" (created if needed).
+    // N.B.) it must be created after the OpenGL context
+    ShaderCache(const string &directory)
+        : hits(0), misses(0), directory(directory), parallel(false)
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        this->binarySupported = formats > 0 && glGetProgramBinary && glProgramBinary && glProgramParameteri;
+
+        // the driver strings are part of the key of each program
+        const GLubyte* strings[] = {glGetString(GL_VENDOR), glGetString(GL_RENDERER), glGetString(GL_VERSION)};
+        for(GLuint i = 0; i < 3; i++)
+            if(strings[i])
+                this->driver += string((const char*)strings[i]) + "\n";
+
+#ifdef _WIN32
+        _mkdir(directory.c_str());
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+        this->start = chrono::steady_clock::now();
+    }
+
+    //////////////////////////////////////////
+    // the driver compiles on as many threads as it wants (GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile).
+    // The application checks the extension and passes glMaxShaderCompilerThreadsKHR (or the ARB version)
+    void EnableParallelCompile(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads)
+    {
+        if(!maxShaderCompilerThreads)
+            return;
+        // 0xFFFFFFFF: implementation-dependent maximum
+        maxShaderCompilerThreads(0xFFFFFFFF);
+        this->parallel = true;
+    }
+
+    //////////////////////////////////////////
+    // the relative paths of the sources are searched first in "root" (with or without the final separator); an empty root uses only the working directory
+    void SetSourceRoot(const string &root)
+    {
+        this->sourceRoot = root;
+        if(!root.empty() && root[root.size() - 1] != '/' && root[root.size() - 1] != '\\')
+            this->sourceRoot += "/";
+    }
+
+    //////////////////////////////////////////
+    // path of a source file: inside the source root if the file is there, otherwise the path itself (relative to the working directory)
+    string Resolve(const string &path)
+    {
+        if(this->sourceRoot.empty() || path.empty() || path[0] == '/' || path[0] == '\\' || path.find(':') != string::npos)
+            return path;
+        string rooted = this->sourceRoot + path;
+        ifstream file(rooted.c_str());
+        return file.is_open() ? rooted : path;
+    }
+
+    //////////////////////////////////////////
+    // Shader Program with vertex and fragment stages. The defines are added to all the stages
+    Shader Load(const string &vertexPath, const string &fragmentPath, const ShaderDefines &defines = ShaderDefines())
+    {
+        vector<ShaderStage> stages;
+        this->AddStage(stages, GL_VERTEX_SHADER, vertexPath, defines);
+        this->AddStage(stages, GL_FRAGMENT_SHADER, fragmentPath, defines);
+        return this->Create(stages, vector<const GLchar*>());
+    }
+
+    // Shader Program with vertex, geometry and fragment stages
+    Shader Load(const string &vertexPath, const string &geometryPath, const string &fragmentPath, const ShaderDefines &defines = ShaderDefines())
+    {
+        vector<ShaderStage> stages;
+        this->AddStage(stages, GL_VERTEX_SHADER, vertexPath, defines);
+        this->AddStage(stages, GL_GEOMETRY_SHADER, geometryPath, defines);
+        this->AddStage(stages, GL_FRAGMENT_SHADER, fragmentPath, defines);
+        return this->Create(stages, vector<const GLchar*>());
+    }
+
+    // Shader Program with only the vertex stage, whose outputs are captured with Transform Feedback
+    Shader Load(const string &vertexPath, const vector<const GLchar*> &feedbackVaryings, const ShaderDefines &defines = ShaderDefines())
+    {
+        vector<ShaderStage> stages;
+        this->AddStage(stages, GL_VERTEX_SHADER, vertexPath, defines);
+        return this->Create(stages, feedbackVaryings);
+    }
+
+    //////////////////////////////////////////
+    // true if the driver finished all the pending programs (always true without parallel compilation, where the check would block)
+    bool Ready()
+    {
+        if(!this->parallel)
+            return true;
+        for(GLuint i = 0; i < this->pending.size(); i++)
+        {
+            GLint done = GL_FALSE;
+            glGetProgramiv(this->pending[i].program, GL_COMPLETION_STATUS_KHR, &done);
+            if(!done)
+                return false;
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // true if the status of a single program can be checked without waiting
+    bool Ready(GLuint program)
+    {
+        if(!this->parallel)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+
+    //////////////////////////////////////////
+    // we check a single program created by Load (see Finish). It returns false if the program cannot be used
+    bool Finish(GLuint program)
+    {
+        for(GLuint i = 0; i < this->pending.size(); i++)
+        {
+            if(this->pending[i].program == program)
+            {
+                bool linked = this->Complete(this->pending[i]);
+                this->pending.erase(this->pending.begin() + i);
+                return linked;
+            }
+        }
+        // programs loaded from the cache are already linked
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // we check the link status of the pending programs (waiting for the driver, if needed), we report the errors and we store the binaries of the linked programs
+    void Finish()
+    {
+        for(GLuint i = 0; i < this->pending.size(); i++)
+            this->Complete(this->pending[i]);
+        this->pending.clear();
+
+        GLfloat ms = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - this->start).count();
+        cout << "Shaders: " << this->hits << " programs from cache, " << this->misses << " compiled"
+             << (this->parallel ? " in parallel" : "") << " (" << ms << " ms)" << endl;
+    }
+
+private:
+    struct ShaderStage {
+        GLenum type;
+        string path;
+        string source;
+    };
+
+    // a program compiled from source, not checked yet
+    struct PendingProgram {
+        GLuint program;
+        vector<GLuint> shaders;
+        vector<string> paths;
+        uint64_t key;
+    };
+
+    string directory;
+    string sourceRoot;
+    string driver;
+    bool binarySupported;
+    bool parallel;
+    vector<PendingProgram> pending;
+    chrono::steady_clock::time_point start;
+
+    //////////////////////////////////////////
+    // link status of a compiled program: errors are reported, and the binary is stored if the program is linked
+    bool Complete(PendingProgram &p)
+    {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(p.program, GL_LINK_STATUS, &linked);
+        if(!linked)
+        {
+            // compilation errors of the stages, then the linking error
+            for(GLuint s = 0; s < p.shaders.size(); s++)
+                this->CheckCompileErrors(p.shaders[s], p.paths[s]);
+            GLchar infoLog[1024];
+            glGetProgramInfoLog(p.program, 1024, NULL, infoLog);
+            cout << "ERROR::SHADERCACHE:: Linking of " << p.paths[0] << " failed\n" << infoLog << endl;
+        }
+        else
+            this->Store(p.program, p.key);
+
+        for(GLuint s = 0; s < p.shaders.size(); s++)
+        {
+            glDetachShader(p.program, p.shaders[s]);
+            glDeleteShader(p.shaders[s]);
+        }
+        return linked == GL_TRUE;
+    }
+
+    //////////////////////////////////////////
+    // we read and expand the source of a stage. The included files are listed in the path, to find them in the error messages
+    void AddStage(vector<ShaderStage> &stages, GLenum type, const string &path, const ShaderDefines &defines)
+    {
+        ShaderStage stage;
+        stage.type = type;
+        stage.path = this->Resolve(path);
+        vector<string> files;
+        ShaderPreprocessor::Load(stage.path, defines, stage.source, files);
+        if(files.size() > 1)
+        {
+            stage.path += " (files:";
+            for(GLuint i = 0; i < files.size(); i++)
+                stage.path += " " + to_string(i) + "=" + files[i];
+            stage.path += ")";
+        }
+        stages.push_back(stage);
+    }
+
+    //////////////////////////////////////////
+    // we load the program from the cache, or we start its compilation
+    Shader Create(const vector<ShaderStage> &stages, const vector<const GLchar*> &feedbackVaryings)
+    {
+        uint64_t key = this->Key(stages, feedbackVaryings);
+        GLuint program = glCreateProgram();
+
+        if(this->binarySupported && this->LoadBinary(program, key))
+        {
+            this->hits++;
+            return Shader(program);
+        }
+
+        PendingProgram p;
+        p.program = program;
+        p.key = key;
+        for(GLuint i = 0; i < stages.size(); i++)
+        {
+            const GLchar* code = stages[i].source.c_str();
+            GLuint shader = glCreateShader(stages[i].type);
+            glShaderSource(shader, 1, &code, NULL);
+            glCompileShader(shader);
+            glAttachShader(program, shader);
+            p.shaders.push_back(shader);
+            p.paths.push_back(stages[i].path);
+        }
+        if(!feedbackVaryings.empty())
+            glTransformFeedbackVaryings(program, feedbackVaryings.size(), &feedbackVaryings[0], GL_INTERLEAVED_ATTRIBS);
+        if(this->binarySupported)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        // no status queries here: they would wait for the compilation
+        glLinkProgram(program);
+        this->pending.push_back(p);
+        this->misses++;
+        return Shader(program);
+    }
+
+    //////////////////////////////////////////
+    // FNV-1a hash of the driver strings, of the type and source of each stage, and of the captured outputs
+    uint64_t Key(const vector<ShaderStage> &stages, const vector<const GLchar*> &feedbackVaryings)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        this->HashString(hash, this->driver);
+        for(GLuint i = 0; i < stages.size(); i++)
+        {
+            this->HashString(hash, to_string(stages[i].type));
+            this->HashString(hash, stages[i].source);
+        }
+        for(GLuint i = 0; i < feedbackVaryings.size(); i++)
+            this->HashString(hash, feedbackVaryings[i]);
+        return hash;
+    }
+
+    void HashString(uint64_t &hash, const string &data)
+    {
+        // the length separates consecutive strings
+        string bytes = data + "#" + to_string(data.size());
+        for(GLuint i = 0; i < bytes.size(); i++)
+        {
+            hash ^= (unsigned char)bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    //////////////////////////////////////////
+    string Path(uint64_t key)
+    {
+        stringstream path;
+        path << this->directory << "/" << hex << setw(16) << setfill('0') << key << ".bin";
+        return path.str();
+    }
+
+    //////////////////////////////////////////
+    // the file contains the binary format, followed by the binary. It returns false if there is no valid binary (e.g. the driver rejects it after an update)
+    bool LoadBinary(GLuint program, uint64_t key)
+    {
+        ifstream file(this->Path(key).c_str(), ios::binary);
+        if(!file.is_open())
+            return false;
+        GLenum format;
+        file.read((char*)&format, sizeof(format));
+        vector<char> binary((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        if(!file.good() && !file.eof())
+            return false;
+        if(binary.empty())
+            return false;
+
+        glProgramBinary(program, format, &binary[0], binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    //////////////////////////////////////////
+    void Store(GLuint program, uint64_t key)
+    {
+        if(!this->binarySupported)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+            return;
+        vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(program, length, NULL, &format, &binary[0]);
+
+        ofstream file(this->Path(key).c_str(), ios::binary);
+        if(!file.is_open())
+        {
+            cout << "ERROR::SHADERCACHE:: Cannot write " << this->Path(key) << endl;
+            return;
+        }
+        file.write((const char*)&format, sizeof(format));
+        file.write(&binary[0], binary.size());
+    }
+
+    //////////////////////////////////////////
+    void CheckCompileErrors(GLuint shader, const string &path)
+    {
+        GLint success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if(!success)
+        {
+            GLchar infoLog[1024];
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            cout << "ERROR::SHADERCACHE:: Compilation of " << path << " failed\n" << infoLog << endl;
+        }
+    }
+};
@@ -0,0 +1,189 @@
+/*
+Shader preprocessor
+- ShaderDefines class: the #define values of a shader permutation (e.g. number of frequency bands, fbm octaves, quality level, instancing)
+- ShaderPreprocessor class: expansion of the #include "file" directives of a GLSL source (paths relative to the including file), and insertion of the #define values after the #version line
+
+Each file is included only once in a stage, so shared files can include each other freely.
+#line directives are inserted around each included file: in the compilation errors, the number before the line is the index of the file (0 is the stage file, see the "files" list).
+The defines change the expanded source, so each permutation has its own key in the ShaderCache.
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+// GL Includes (only for the types)
+#include <glad/glad.h>
+
+/////////////////// SHADERDEFINES class ///////////////////////
+class ShaderDefines
+{
+public:
+    //////////////////////////////////////////
+    // we set the value of a define (replacing the previous value). The calls can be chained
+    ShaderDefines &Set(const string &name, const string &value)
+    {
+        for(GLuint i = 0; i < this->values.size(); i++)
+        {
+            if(this->values[i].first == name)
+            {
+                this->values[i].second = value;
+                return *this;
+            }
+        }
+        this->values.push_back(make_pair(name, value));
+        return *this;
+    }
+
+    ShaderDefines &Set(const string &name, GLint value)
+    {
+        return this->Set(name, to_string(value));
+    }
+
+    //////////////////////////////////////////
+    // the #define directives, one per line
+    string Directives() const
+    {
+        string directives;
+        for(GLuint i = 0; i < this->values.size(); i++)
+            directives += "#define " + this->values[i].first + " " + this->values[i].second + "\n";
+        return directives;
+    }
+
+private:
+    vector<pair<string, string> > values;
+};
+
+/////////////////// SHADERPREPROCESSOR class ///////////////////////
+class ShaderPreprocessor
+{
+public:
+    //////////////////////////////////////////
+    // we expand the source of the file "path": the included files are appended to "files" (after "path" itself).
+    // It returns false if an included file cannot be read
+    static bool Process(const string &source, const string &path, const ShaderDefines &defines, string &output, vector<string> &files)
+    {
+        files.clear();
+        files.push_back(path);
+        output.clear();
+        return Expand(source, 0, defines.Directives(), output, files);
+    }
+
+    //////////////////////////////////////////
+    // we read and expand a file: the defines are inserted after the #version line
+    static bool Load(const string &path, const ShaderDefines &defines, string &output, vector<string> &files)
+    {
+        string source;
+        if(!Read(path, source))
+        {
+            cout << "ERROR::SHADERPREPROCESSOR:: Cannot read " << path << endl;
+            files.assign(1, path);
+            return false;
+        }
+        return Process(source, path, defines, output, files);
+    }
+
+    //////////////////////////////////////////
+    // all the files used by a stage (the stage file and the included ones), e.g. to watch them for changes
+    static vector<string> Files(const string &path)
+    {
+        string output;
+        vector<string> files;
+        Load(path, ShaderDefines(), output, files);
+        return files;
+    }
+
+    //////////////////////////////////////////
+    static bool Read(const string &path, string &source)
+    {
+        ifstream file(path.c_str(), ios::binary);
+        if(!file.is_open())
+            return false;
+        stringstream stream;
+        stream << file.rdbuf();
+        source = stream.str();
+        return true;
+    }
+
+private:
+    //////////////////////////////////////////
+    // we copy the lines of files[index] to the output, replacing the #include lines with the content of the files
+    static bool Expand(const string &source, GLuint index, const string &directives, string &output, vector<string> &files)
+    {
+        bool ok = true;
+        bool versionFound = false;
+        istringstream lines(source);
+        string line;
+        GLuint number = 0;
+        while(getline(lines, line))
+        {
+            number++;
+            size_t start = line.find_first_not_of(" \t");
+            string directive = start == string::npos ? string() : line.substr(start);
+
+            if(index == 0 && !versionFound && directive.compare(0, 8, "#version") == 0)
+            {
+                // the defines must follow the #version line
+                versionFound = true;
+                output += line + "\n" + directives;
+                output += "#line " + to_string(number + 1) + " 0\n";
+                continue;
+            }
+            if(directive.compare(0, 8, "#include") != 0)
+            {
+                output += line + "\n";
+                continue;
+            }
+
+            size_t open = directive.find('"');
+            size_t close = open == string::npos ? string::npos : directive.find('"', open + 1);
+            if(close == string::npos)
+            {
+                cout << "ERROR::SHADERPREPROCESSOR:: Malformed #include in " << files[index] << " (line " << number << ")" << endl;
+                ok = false;
+                output += "\n";
+                continue;
+            }
+            string included = Directory(files[index]) + directive.substr(open + 1, close - open - 1);
+
+            // each file is included once
+            if(find(files.begin(), files.end(), included) == files.end())
+            {
+                string includedSource;
+                if(!Read(included, includedSource))
+                {
+                    cout << "ERROR::SHADERPREPROCESSOR:: Cannot read " << included << " (included by " << files[index] << ")" << endl;
+                    ok = false;
+                }
+                else
+                {
+                    GLuint includedIndex = files.size();
+                    files.push_back(included);
+                    output += "#line 1 " + to_string(includedIndex) + "\n";
+                    ok = Expand(includedSource, includedIndex, directives, output, files) && ok;
+                }
+            }
+            output += "#line " + to_string(number + 1) + " " + to_string(index) + "\n";
+        }
+        // without #version, the defines are placed at the beginning
+        if(index == 0 && !versionFound && !directives.empty())
+            output = directives + "#line 1 0\n" + output;
+        return ok;
+    }
+
+    //////////////////////////////////////////
+    // directory of a path, with the final separator (empty for the files in the working directory)
+    static string Directory(const string &path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == string::npos ? string() : path.substr(0, slash + 1);
+    }
+};
@@ -0,0 +1,307 @@
+/*
+ShaderHotReload class
+- reloading of the Shader Programs while the application is running, when their source files change
+- the source files are found as the ShaderCache loads them (inside its source root, if set): editing the files of the project reloads the programs, not only editing the copies in the working directory
+- the directories of the registered source files (and of the files they include, see ShaderPreprocessor) are watched with inotify (Linux); on the other platforms, the modification times of the files are checked twice per second
+- a changed program is compiled through the ShaderCache without waiting: the driver compiles it in background (with GL_KHR_parallel_shader_compile), and its status is polled in the next frames
+- if the new program is linked, it replaces the old one in the Shader (the cached uniform locations are resolved again); otherwise the error is reported and the old program is kept
+
+Usage:
+    ShaderHotReload reload(cache);
+    reload.Watch(shader, "a.vert", "a.frag");
+    ... in the render loop ...
+    reload.Update();
+
+N.B.) the Shader objects must not move after Watch (the class keeps their addresses)
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <string>
+#include <vector>
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+    #include <sys/inotify.h>
+    #include <unistd.h>
+    #include <errno.h>
+#endif
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/shader_v1.h>
+#include <utils/shader_cache.h>
+#include <utils/shader_preprocessor.h>
+
+/////////////////// SHADERHOTRELOAD class ///////////////////////
+class ShaderHotReload
+{
+public:
+    // number of successful reloads, and of the failed ones
+    GLuint reloads, failures;
+
+    //////////////////////////////////////////
+    ShaderHotReload(ShaderCache &cache)
+        : reloads(0), failures(0), cache(cache), watcher(-1)
+    {
+        this->lastPoll = chrono::steady_clock::now();
+#ifdef __linux__
+        this->watcher = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if(this->watcher < 0)
+            cout << "ERROR::SHADERHOTRELOAD:: inotify not available, the files are polled" << endl;
+#endif
+    }
+
+    //////////////////////////////////////////
+    // we register a Shader Program with vertex and fragment stages, compiled with the given defines
+    void Watch(Shader &shader, const string &vertexPath, const string &fragmentPath, const ShaderDefines &defines = ShaderDefines())
+    {
+        WatchedProgram p(shader, defines);
+        p.stages.push_back(vertexPath);
+        p.stages.push_back(fragmentPath);
+        this->Add(p);
+    }
+
+    // Shader Program with vertex, geometry and fragment stages
+    void Watch(Shader &shader, const string &vertexPath, const string &geometryPath, const string &fragmentPath, const ShaderDefines &defines = ShaderDefines())
+    {
+        WatchedProgram p(shader, defines);
+        p.stages.push_back(vertexPath);
+        p.stages.push_back(geometryPath);
+        p.stages.push_back(fragmentPath);
+        this->Add(p);
+    }
+
+    // Shader Program with only the vertex stage, and captured outputs
+    void Watch(Shader &shader, const string &vertexPath, const vector<const GLchar*> &feedbackVaryings, const ShaderDefines &defines = ShaderDefines())
+    {
+        WatchedProgram p(shader, defines);
+        p.stages.push_back(vertexPath);
+        p.varyings = feedbackVaryings;
+        this->Add(p);
+    }
+
+    //////////////////////////////////////////
+    // called once per frame: we check the changed files, we start the compilation of the changed programs, and we swap the ones the driver has finished
+    void Update()
+    {
+        this->CheckFiles();
+
+        for(GLuint i = 0; i < this->programs.size(); i++)
+        {
+            WatchedProgram &p = this->programs[i];
+            // a change during a compilation is handled when the compilation ends
+            if(p.dirty && !p.pending)
+            {
+                p.dirty = false;
+                // the included files can be different
+                this->UpdateFiles(p);
+                p.pending = this->Load(p);
+            }
+            if(p.pending && this->cache.Ready(p.pending))
+            {
+                GLuint program = p.pending;
+                p.pending = 0;
+                if(this->cache.Finish(program))
+                {
+                    GLuint old = p.shader->Program;
+                    p.shader->SetProgram(program);
+                    glState.DeleteProgram(old);
+                    this->reloads++;
+                    cout << "Shader reloaded: " << p.stages.back() << endl;
+                }
+                else
+                {
+                    glDeleteProgram(program);
+                    this->failures++;
+                    cout << "ERROR::SHADERHOTRELOAD:: " << p.stages.back() << " not reloaded, the previous program is kept" << endl;
+                }
+            }
+        }
+    }
+
+    //////////////////////////////////////////
+    // we stop watching the files. The programs still compiling are deleted
+    void Delete()
+    {
+        for(GLuint i = 0; i < this->programs.size(); i++)
+        {
+            if(this->programs[i].pending)
+            {
+                this->cache.Finish(this->programs[i].pending);
+                glDeleteProgram(this->programs[i].pending);
+                this->programs[i].pending = 0;
+            }
+        }
+#ifdef __linux__
+        if(this->watcher >= 0)
+            close(this->watcher);
+#endif
+        this->watcher = -1;
+    }
+
+private:
+    // a registered program: its Shader, the paths of its stages (and the captured outputs, and the defines), and the state of the reload
+    struct WatchedProgram {
+        Shader* shader;
+        vector<string> stages;
+        vector<const GLchar*> varyings;
+        ShaderDefines defines;
+        // stages and included files, with their modification times (used when files are polled)
+        vector<string> files;
+        vector<time_t> stamps;
+        bool dirty;
+        // program being compiled (0 if none)
+        GLuint pending;
+        WatchedProgram(Shader &shader, const ShaderDefines &defines) : shader(&shader), defines(defines), dirty(false), pending(0) {}
+    };
+
+    // a watched directory (inotify watch descriptor)
+    struct WatchedDirectory {
+        string path;
+        int descriptor;
+    };
+
+    ShaderCache &cache;
+    vector<WatchedProgram> programs;
+    vector<WatchedDirectory> directories;
+    int watcher;
+    chrono::steady_clock::time_point lastPoll;
+
+    //////////////////////////////////////////
+    void Add(WatchedProgram &p)
+    {
+        this->UpdateFiles(p);
+        this->programs.push_back(p);
+    }
+
+    //////////////////////////////////////////
+    // we collect the files of the stages (with the included ones), and we watch their directories
+    void UpdateFiles(WatchedProgram &p)
+    {
+        p.files.clear();
+        for(GLuint s = 0; s < p.stages.size(); s++)
+        {
+            vector<string> files = ShaderPreprocessor::Files(this->cache.Resolve(p.stages[s]));
+            for(GLuint f = 0; f < files.size(); f++)
+                if(find(p.files.begin(), p.files.end(), files[f]) == p.files.end())
+                    p.files.push_back(files[f]);
+        }
+        for(GLuint f = 0; f < p.files.size(); f++)
+            this->WatchDirectory(Directory(p.files[f]));
+        p.stamps = this->Stamps(p);
+    }
+
+    //////////////////////////////////////////
+    // we add a directory to the inotify watches, once. Editors often save by writing a new file and renaming it, so both events are watched
+    void WatchDirectory(const string &directory)
+    {
+        for(GLuint i = 0; i < this->directories.size(); i++)
+            if(this->directories[i].path == directory)
+                return;
+        WatchedDirectory d;
+        d.path = directory;
+        d.descriptor = -1;
+#ifdef __linux__
+        if(this->watcher >= 0)
+        {
+            d.descriptor = inotify_add_watch(this->watcher, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+            if(d.descriptor < 0)
+                cout << "ERROR::SHADERHOTRELOAD:: cannot watch " << directory << endl;
+        }
+#endif
+        this->directories.push_back(d);
+    }
+
+    //////////////////////////////////////////
+    // we mark as dirty the programs using a changed file
+    void CheckFiles()
+    {
+#ifdef __linux__
+        if(this->watcher >= 0)
+        {
+            // the buffer is aligned as the events it contains
+            char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            for(;;)
+            {
+                ssize_t length = read(this->watcher, buffer, sizeof(buffer));
+                // EAGAIN: no more events
+                if(length <= 0)
+                    break;
+                for(char* ptr = buffer; ptr < buffer + length; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len)
+                {
+                    const struct inotify_event* event = (const struct inotify_event*)ptr;
+                    if(event->len == 0)
+                        continue;
+                    for(GLuint i = 0; i < this->directories.size(); i++)
+                        if(this->directories[i].descriptor == event->wd)
+                            this->Changed(this->directories[i].path, event->name);
+                }
+            }
+            return;
+        }
+#endif
+        // without inotify, we compare the modification times of the files
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if(chrono::duration<GLfloat>(now - this->lastPoll).count() < 0.5f)
+            return;
+        this->lastPoll = now;
+        for(GLuint i = 0; i < this->programs.size(); i++)
+            if(this->Stamps(this->programs[i]) != this->programs[i].stamps)
+                this->programs[i].dirty = true;
+    }
+
+    //////////////////////////////////////////
+    void Changed(const string &directory, const string &name)
+    {
+        for(GLuint i = 0; i < this->programs.size(); i++)
+            for(GLuint f = 0; f < this->programs[i].files.size(); f++)
+                if(Directory(this->programs[i].files[f]) == directory && Name(this->programs[i].files[f]) == name)
+                    this->programs[i].dirty = true;
+    }
+
+    //////////////////////////////////////////
+    // we start the compilation of a program (see ShaderCache::Load)
+    GLuint Load(WatchedProgram &p)
+    {
+        if(!p.varyings.empty())
+            return this->cache.Load(p.stages[0], p.varyings, p.defines).Program;
+        if(p.stages.size() == 3)
+            return this->cache.Load(p.stages[0], p.stages[1], p.stages[2], p.defines).Program;
+        return this->cache.Load(p.stages[0], p.stages[1], p.defines).Program;
+    }
+
+    //////////////////////////////////////////
+    vector<time_t> Stamps(const WatchedProgram &p)
+    {
+        vector<time_t> stamps;
+        for(GLuint f = 0; f < p.files.size(); f++)
+        {
+            struct stat info;
+            stamps.push_back(stat(p.files[f].c_str(), &info) == 0 ? info.st_mtime : 0);
+        }
+        return stamps;
+    }
+
+    //////////////////////////////////////////
+    // directory and name of a path ("." for the files in the working directory)
+    static string Directory(const string &path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == string::npos ? string(".") : path.substr(0, slash);
+    }
+
+    static string Name(const string &path)
+    {
+        size_t slash = path.find_last_of("/\\");
+        return slash == string::npos ? path : path.substr(slash + 1);
+    }
+};
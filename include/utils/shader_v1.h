@@ -21,15 +21,23 @@ using namespace std;
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+#include <unordered_map>
 
 // GL Includes
 #include <glad/glad.h> // Contains all the necessery OpenGL includes
 
+#include <utils/shader_preprocessor.h>
+// redundant program changes are filtered
+#include <utils/gl_state.h>
+
 /////////////////// SHADER class ///////////////////////
 class Shader
 {
 public:
     GLuint Program;
+    // unique number of the current Shader Program: it changes with SetProgram, so the data resolved for a program (e.g. by Material) are not reused for a new one with the same name
+    GLuint Generation = NextGeneration();
 
     //////////////////////////////////////////
 
@@ -74,6 +82,10 @@ public:
 			cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
 		}
 
+		// we expand the #include directives (see ShaderPreprocessor)
+		vertexCode = expandIncludes(vertexCode, vertexPath);
+		geometryCode = expandIncludes(geometryCode, geometryPath);
+		fragmentCode = expandIncludes(fragmentCode, fragmentPath);
 
 		// converto le stringhe in puntatori a char
 		const GLchar* vShaderCode = vertexCode.c_str();
@@ -151,6 +163,10 @@ public:
 			cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
 		}
 
+		// we expand the #include directives (see ShaderPreprocessor)
+		vertexCode = expandIncludes(vertexCode, vertexPath);
+		fragmentCode = expandIncludes(fragmentCode, fragmentPath);
+
 		// converto le stringhe in puntatori a char
 		const GLchar* vShaderCode = vertexCode.c_str();
 		const GLchar * fShaderCode = fragmentCode.c_str();
@@ -185,17 +201,162 @@ public:
 		glDeleteShader(fragment);
 	}
 
+	// Shader Program with only the vertex stage, whose outputs are captured in a buffer using Transform Feedback.
+	// The names of the captured outputs must be set before linking, and they are written interleaved in the same buffer.
+	Shader(const GLchar* vertexPath, const vector<const GLchar*> &feedbackVaryings)
+	{
+		// Step 1: we retrieve shader source code from provided filepath
+		string vertexCode;
+		ifstream vShaderFile;
+
+		// ensure ifstream objects can throw exceptions:
+		vShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
+		try
+		{
+			vShaderFile.open(vertexPath);
+			stringstream vShaderStream;
+			vShaderStream << vShaderFile.rdbuf();
+			vShaderFile.close();
+			vertexCode = vShaderStream.str();
+		}
+		catch (const ifstream::failure &e)
+		{
+			cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
+		}
+
+		vertexCode = expandIncludes(vertexCode, vertexPath);
+		const GLchar* vShaderCode = vertexCode.c_str();
+
+		// Step 2: we compile the shader
+		GLuint vertex = glCreateShader(GL_VERTEX_SHADER);
+		glShaderSource(vertex, 1, &vShaderCode, NULL);
+		glCompileShader(vertex);
+		// check compilation errors
+		checkCompileErrors(vertex, "VERTEX");
+
+		// Step 3: Shader Program creation, with the outputs to capture
+		this->Program = glCreateProgram();
+		glAttachShader(this->Program, vertex);
+		glTransformFeedbackVaryings(this->Program, feedbackVaryings.size(), &feedbackVaryings[0], GL_INTERLEAVED_ATTRIBS);
+		glLinkProgram(this->Program);
+		// check linking errors
+		checkCompileErrors(this->Program, "PROGRAM");
+
+		// Step 4: we delete the shader because it is linked to the Shader Program
+		glDeleteShader(vertex);
+	}
+
+	// Shader Program already created and linked elsewhere (e.g. by ShaderCache)
+	explicit Shader(GLuint program) : Program(program) {}
+
     //////////////////////////////////////////
 
     // We activate the Shader Program as part of the current rendering process
-    void Use() { glUseProgram(this->Program); }
+    void Use() { glState.UseProgram(this->Program); }
 
     // We delete the Shader Program when application closes
-    void Delete() {    glDeleteProgram(this->Program); }
+    void Delete() {    glState.DeleteProgram(this->Program); }
+
+	// Location of a uniform: it is asked to the driver only the first time, then it is cached
+	GLint Uniform(const string &name)
+	{
+		unordered_map<string, GLint>::iterator it = this->uniformLocations.find(name);
+		if(it != this->uniformLocations.end())
+			return it->second;
+		GLint location = glGetUniformLocation(this->Program, name.c_str());
+		this->uniformLocations[name] = location;
+		return location;
+	}
+
+	// We set the value of a uniform of the Shader Program in use (same parameters of the glUniform functions, with the name instead of the location).
+	// The uniforms not in the program (location -1, e.g. removed by the compiler) are skipped: the values sent to the driver are counted in the render statistics
+	void Uniform1i(const string &name, GLint value)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniform1i(location, value);
+	}
+
+	void Uniform1f(const string &name, GLfloat value)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniform1f(location, value);
+	}
+
+	void Uniform2f(const string &name, GLfloat x, GLfloat y)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniform2f(location, x, y);
+	}
+
+	void Uniform1fv(const string &name, GLsizei count, const GLfloat* values)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniform1fv(location, count, values);
+	}
+
+	void Uniform3fv(const string &name, GLsizei count, const GLfloat* values)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniform3fv(location, count, values);
+	}
+
+	void UniformMatrix3fv(const string &name, GLsizei count, GLboolean transpose, const GLfloat* values)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniformMatrix3fv(location, count, transpose, values);
+	}
+
+	void UniformMatrix4fv(const string &name, GLsizei count, GLboolean transpose, const GLfloat* values)
+	{
+		GLint location = this->UploadLocation(name);
+		if(location != -1)
+			glUniformMatrix4fv(location, count, transpose, values);
+	}
+
+	// We replace the Shader Program (e.g. after a hot reload): the cached uniform locations are resolved again
+	void SetProgram(GLuint program)
+	{
+		this->Program = program;
+		this->Generation = NextGeneration();
+		this->uniformLocations.clear();
+	}
 
 private:
+	// cached uniform locations (see Uniform)
+	unordered_map<string, GLint> uniformLocations;
+
+	// location of a uniform to set, counted as an upload if it is in the program
+	GLint UploadLocation(const string &name)
+	{
+		GLint location = this->Uniform(name);
+		if(location != -1)
+			renderStats.uniformUploads++;
+		return location;
+	}
+
+	static GLuint NextGeneration()
+	{
+		static GLuint generation = 0;
+		return ++generation;
+	}
+
     //////////////////////////////////////////
 
+    // Source code with the included files
+    string expandIncludes(const string &code, const GLchar* path)
+    {
+        string expanded;
+        vector<string> files;
+        ShaderPreprocessor::Process(code, path, ShaderDefines(), expanded, files);
+        return expanded;
+    }
+
     // Check compilation and linking errors
     void checkCompileErrors(GLuint shader, string type)
 	{
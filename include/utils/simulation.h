@@ -0,0 +1,439 @@
+/*
+Simulation class
+- gameplay state of Retrowave (palms, powerups, car, speed and blink) updated with a fixed timestep, independently of the rendering frame rate
+- the last two states are kept, so the renderer can interpolate between them
+- no OpenGL calls: the simulation can run without a context (e.g. for speed runs of the gameplay)
+- random choices use a seeded generator (PCG32) owned by the simulation: the same seed and inputs give the same states on every platform
+- powerups are stored as a structure of arrays (see utils/entity_store.h), updated by vectorized kernels
+- collisions are tested only with the powerups near the car along Z (see utils/broadphase.h)
+- beats spawn the waiting powerups through a pool: a beat is queued, and each step spawns at most one powerup for the oldest queued beat
+- with a JobSystem, large sets of palms and powerups are updated in parallel ranges (each entity is independent, so the states do not change)
+
+Each frame, the real elapsed time is accumulated and consumed in steps of exactly "step" seconds.
+The remainder (a fraction of a step) is returned as the interpolation factor between the previous and the current state.
+With small and constant steps, the car cannot tunnel through a powerup after a long frame: the hitch is simulated as many short steps (up to maxSteps per frame, then the time is dropped).
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+
+// GL Includes (only for the types)
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <utils/entity_store.h>
+#include <utils/broadphase.h>
+#include <utils/job_system.h>
+
+struct Car{
+    glm::vec3 position;
+    glm::vec3 size;
+};
+
+// player commands sampled by the application before each frame
+struct SimulationInput {
+    bool left;
+    bool right;
+    // scripted slalom across the street, used by the benchmark
+    bool autopilot;
+};
+
+// a powerup hit by the car during a step (the application plays the sound effects)
+struct SimulationEvent {
+    GLuint powerUp;
+    bool speedUp;
+};
+
+// the whole gameplay state at a given simulation time
+struct GameState {
+    GLfloat time;
+    GLfloat scrollSpeed;
+    vector<GLfloat> palmZ;
+    PowerUpStore powerUps;
+    Car car;
+    GLfloat carTurnAngle;
+    // car blink: 1 after a speed up, -1 after a speed down, 0 otherwise
+    GLint blink;
+    GLfloat blinkStart;
+};
+
+/////////////////// RANDOM class ///////////////////////
+// PCG32 generator (see https://www.pcg-random.org): small state, and unlike rand() its sequence does not depend on the C library
+class Random
+{
+public:
+    Random(uint64_t seed = 0)
+    {
+        this->Seed(seed);
+    }
+
+    void Seed(uint64_t seed)
+    {
+        this->state = 0;
+        this->Next();
+        this->state += seed;
+        this->Next();
+    }
+
+    uint32_t Next()
+    {
+        uint64_t old = this->state;
+        this->state = old * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = (uint32_t)(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // integer in [0, n)
+    GLint Range(GLint n)
+    {
+        return n > 0 ? (GLint)(this->Next() % (uint32_t)n) : 0;
+    }
+
+private:
+    uint64_t state;
+};
+
+/////////////////// SIMULATION class ///////////////////////
+class Simulation
+{
+public:
+    // states at the end of the last two steps
+    GameState previous, current;
+    // fixed timestep (seconds)
+    GLfloat step;
+    // maximum number of steps in a single frame
+    GLuint maxSteps;
+    // steps done since the beginning
+    GLuint stepCount;
+    // collisions happened during the last Advance
+    vector<SimulationEvent> events;
+    // generator of the random positions of the powerups
+    Random random;
+    // waiting powerups and queued beats
+    PowerUpPool pool;
+    // optional workers for the entity updates (NULL: everything on the calling thread), and entities updated by each job
+    JobSystem* jobs;
+    GLuint parallelGrain;
+
+    // gameplay parameters
+    // half width of the street (palms are placed on its borders, the car and the powerups stay inside)
+    GLfloat streetBorder;
+    GLfloat palmStartingZ, palmResetZ;
+    GLint respawnThreshold;
+    GLfloat pwUpStartingZ;
+    GLint randomZSpawnOffset;
+    GLfloat minOutlineScale, maxOutlineScale;
+    GLfloat maxTurnAngle;
+    GLfloat blinkDuration;
+
+    //////////////////////////////////////////
+    // constructor: "rate" is the number of steps per second
+    Simulation(GLuint palmAmount, GLuint powerUpAmount, GLfloat sphereScale, GLfloat carScale, GLfloat scrollSpeed, GLfloat streetBorder, GLfloat rate = 120.0f, uint64_t seed = 0)
+        : step(1.0f / rate), maxSteps(30), stepCount(0), random(seed), jobs(NULL), parallelGrain(16384), streetBorder(streetBorder),
+          palmStartingZ(-75.0f), palmResetZ(25.0f), respawnThreshold(30), pwUpStartingZ(-70.0f), randomZSpawnOffset(31),
+          minOutlineScale(1.05f), maxOutlineScale(5.0f), maxTurnAngle(2.0f), blinkDuration(0.8f), accumulator(0.0f)
+    {
+        GameState &state = this->current;
+        state.time = 0.0f;
+        state.scrollSpeed = scrollSpeed;
+
+        // palms are placed in pairs (left and right border), uniformly along the street
+        GLfloat zOffset = 100.0f / (GLfloat)palmAmount;
+        state.palmZ.resize(palmAmount);
+        for(GLuint i = 0; i < palmAmount; i++)
+            state.palmZ[i] = this->palmStartingZ + zOffset * (i - i % 2);
+
+        // powerups start near the camera, on a random X coordinate, and they are respawned far away once they pass it
+        PowerUpStore &pwUps = state.powerUps;
+        pwUps.Resize(powerUpAmount);
+        this->pool.Reset(powerUpAmount);
+        pwUps.radius = sphereScale;
+        for(GLuint i = 0; i < powerUpAmount; i++)
+        {
+            pwUps.x[i] = (GLfloat)(this->random.Range((GLint)streetBorder+(GLint)streetBorder + 1) - (GLint)streetBorder);
+            pwUps.z[i] = 25.0f;
+            pwUps.outlineScale[i] = this->maxOutlineScale;
+            pwUps.flags[i] = POWERUP_SPAWNING | (i % 2 == 0 ? POWERUP_SPEEDUP : 0);
+            this->broadphase.Insert(pwUps, i);
+        }
+
+        state.car.position = glm::vec3(0.0f, 0.0f, 19.0f);
+        state.car.size = glm::vec3(1.4f * carScale, 1.2f * carScale, 4.3f * carScale);
+        state.carTurnAngle = 0.0f;
+        state.blink = 0;
+        state.blinkStart = 0.0f;
+
+        this->previous = this->current;
+    }
+
+    //////////////////////////////////////////
+    // we consume the elapsed time in fixed steps. It returns the interpolation factor (in [0,1)) between the previous and the current state
+    GLfloat Advance(GLfloat elapsed, const SimulationInput &input)
+    {
+        this->events.clear();
+        this->accumulator += elapsed;
+
+        GLuint steps = 0;
+        while(this->accumulator >= this->step && steps < this->maxSteps)
+        {
+            this->previous = this->current;
+            this->Step(input);
+            this->accumulator -= this->step;
+            steps++;
+        }
+        // too many steps for a frame: the remaining time is dropped, to avoid falling behind more and more
+        if(steps == this->maxSteps && this->accumulator >= this->step)
+            this->accumulator = fmod(this->accumulator, this->step);
+
+        return this->accumulator / this->step;
+    }
+
+    //////////////////////////////////////////
+    // a beat of the music: it will spawn a waiting powerup in the next step (or later, if all the powerups are moving)
+    void Beat()
+    {
+        this->pool.QueueBeat();
+    }
+
+    //////////////////////////////////////////
+    // a single step of the gameplay
+    void Step(const SimulationInput &input)
+    {
+        GameState &state = this->current;
+        GLfloat dt = this->step;
+        state.time += dt;
+        this->stepCount++;
+
+        // palms, powerups and grid scroll at the same speed
+        GLfloat translationSpeed = state.scrollSpeed * 0.505f;
+
+        /////////////////// PALM ///////////////////
+        if(this->Parallel(state.palmZ.size()))
+        {
+            GLfloat* palmZ = &state.palmZ[0];
+            this->jobs->Wait(this->jobs->ParallelFor("Palm update", state.palmZ.size(), this->parallelGrain, [&](GLuint first, GLuint last){
+                ScrollAndWrap(palmZ + first, last - first, translationSpeed * dt, this->palmResetZ, this->palmStartingZ);
+            }));
+        }
+        else if(!state.palmZ.empty())
+            ScrollAndWrap(&state.palmZ[0], state.palmZ.size(), translationSpeed * dt, this->palmResetZ, this->palmStartingZ);
+
+        /////////////////// CAR ///////////////////
+        GLfloat rotationSpeed = 100.0f + state.scrollSpeed * 0.1f;
+        GLfloat turnSpeed = 2.0f + state.scrollSpeed * 0.05f;
+        Car &car = state.car;
+        if(input.autopilot)
+        {
+            // the car crosses the street, turning towards its direction of motion
+            car.position.x = sin(state.time * 0.7f) * (this->streetBorder - 1.0f);
+            state.carTurnAngle = -cos(state.time * 0.7f) * this->maxTurnAngle;
+        }
+        else
+        {
+            if(input.left && car.position.x >= (-this->streetBorder + 1.0f))
+            {
+                car.position.x -= dt * turnSpeed;
+                if(state.carTurnAngle <= this->maxTurnAngle)
+                    state.carTurnAngle += dt * rotationSpeed;
+            }
+            if(input.right && car.position.x <= (this->streetBorder - 1.0f))
+            {
+                car.position.x += dt * turnSpeed;
+                if(state.carTurnAngle >= -this->maxTurnAngle)
+                    state.carTurnAngle -= dt * rotationSpeed;
+            }
+            if(!input.left && !input.right && state.carTurnAngle != 0.0f)
+            {
+                if(state.carTurnAngle >= 0.0f)
+                    state.carTurnAngle -= dt * rotationSpeed;
+                else
+                    state.carTurnAngle += dt * rotationSpeed;
+            }
+        }
+
+        /////////////////// POWERUPS ///////////////////
+        PowerUpStore &pwUps = state.powerUps;
+        // the oldest queued beat spawns a waiting powerup: it starts moving along the street
+        GLuint spawned;
+        if(this->pool.queuedBeats > 0 && this->pool.Acquire(spawned))
+        {
+            pwUps.flags[spawned] |= POWERUP_SPAWNING;
+            this->broadphase.Insert(pwUps, spawned);
+            this->pool.queuedBeats--;
+        }
+        // spawning animation and translation along the grid of all the spawning powerups
+        GLfloat shrink = dt * (state.scrollSpeed * 0.05f);
+        if(this->Parallel(pwUps.Size()))
+            this->jobs->Wait(this->jobs->ParallelFor("PowerUp update", pwUps.Size(), this->parallelGrain, [&](GLuint first, GLuint last){
+                pwUps.Advance(translationSpeed * dt, shrink, this->minOutlineScale, first, last);
+            }));
+        else
+            pwUps.Advance(translationSpeed * dt, shrink, this->minOutlineScale);
+        // powerups beyond the respawn threshold (considered as Z axis position threshold) are repositioned on a random X coordinate and their state is reset
+        this->passed.clear();
+        pwUps.FindPassed((GLfloat)this->respawnThreshold, this->passed);
+        for(GLuint k = 0; k < this->passed.size(); k++)
+        {
+            this->broadphase.Remove(pwUps, this->passed[k]);
+            this->Respawn(this->passed[k]);
+            this->pool.Release(this->passed[k]);
+        }
+
+        // Collision check AABB - Sphere, only with the visible powerups overlapping the car along Z
+        glm::vec3 halfExtents(car.size.x / 2.0f, car.size.y / 2.0f, car.size.z / 2.0f);
+        this->candidates.clear();
+        this->broadphase.Query(pwUps, car.position.z - halfExtents.z - pwUps.radius, car.position.z + halfExtents.z + pwUps.radius, this->candidates);
+        GLuint visible = 0;
+        for(GLuint k = 0; k < this->candidates.size(); k++)
+            if((pwUps.flags[this->candidates[k]] & (POWERUP_SPAWNED | POWERUP_HIT)) == POWERUP_SPAWNED)
+                this->candidates[visible++] = this->candidates[k];
+        this->candidates.resize(visible);
+        this->hits.clear();
+        NarrowPhase(pwUps, this->candidates, car.position, halfExtents, this->hits);
+
+        for(GLuint k = 0; k < this->hits.size(); k++)
+        {
+            GLuint i = this->hits[k];
+            pwUps.flags[i] |= POWERUP_HIT;
+            bool speedUp = pwUps.Is(i, POWERUP_SPEEDUP);
+            if(speedUp)
+            {
+                state.scrollSpeed += state.scrollSpeed * 0.1f;
+                state.blink = 1;
+            }
+            else
+            {
+                state.scrollSpeed -= state.scrollSpeed * 0.1f;
+                if(state.scrollSpeed < 5.0f)
+                    state.scrollSpeed = 5.0f;
+                state.blink = -1;
+            }
+            state.blinkStart = state.time;
+            pwUps.explosionStart[i] = state.time;
+
+            SimulationEvent event;
+            event.powerUp = i;
+            event.speedUp = speedUp;
+            this->events.push_back(event);
+        }
+
+        // turn off the car blink after blinkDuration seconds
+        if(state.blink != 0 && state.time - state.blinkStart > this->blinkDuration)
+            state.blink = 0;
+    }
+
+    //////////////////////////////////////////
+    // interpolated values for rendering ("alpha" is the value returned by Advance)
+    GLfloat Time(GLfloat alpha)
+    {
+        return this->previous.time + (this->current.time - this->previous.time) * alpha;
+    }
+
+    GLfloat PalmZ(GLuint i, GLfloat alpha)
+    {
+        return this->Lerp(this->previous.palmZ[i], this->current.palmZ[i], alpha);
+    }
+
+    glm::vec3 PowerUpPosition(GLuint i, GLfloat alpha)
+    {
+        const PowerUpStore &prev = this->previous.powerUps;
+        const PowerUpStore &cur = this->current.powerUps;
+        glm::vec3 from(prev.x[i], prev.y[i], prev.z[i]);
+        glm::vec3 to(cur.x[i], cur.y[i], cur.z[i]);
+        // a respawned powerup jumps back: it is not interpolated
+        if(to.z < from.z)
+            return to;
+        return from + (to - from) * alpha;
+    }
+
+    glm::vec3 CarPosition(GLfloat alpha)
+    {
+        return this->previous.car.position + (this->current.car.position - this->previous.car.position) * alpha;
+    }
+
+    GLfloat CarTurnAngle(GLfloat alpha)
+    {
+        return this->previous.carTurnAngle + (this->current.carTurnAngle - this->previous.carTurnAngle) * alpha;
+    }
+
+    //////////////////////////////////////////
+    // FNV-1a hash of the current state, to compare runs frame by frame (see utils/replay.h)
+    uint32_t StateHash()
+    {
+        const GameState &state = this->current;
+        uint32_t hash = 2166136261u;
+        this->HashBytes(hash, &state.time, sizeof(state.time));
+        this->HashBytes(hash, &state.scrollSpeed, sizeof(state.scrollSpeed));
+        if(!state.palmZ.empty())
+            this->HashBytes(hash, &state.palmZ[0], state.palmZ.size() * sizeof(GLfloat));
+        const PowerUpStore &pwUps = state.powerUps;
+        if(pwUps.Size() > 0)
+        {
+            this->HashBytes(hash, &pwUps.x[0], pwUps.Size() * sizeof(GLfloat));
+            this->HashBytes(hash, &pwUps.y[0], pwUps.Size() * sizeof(GLfloat));
+            this->HashBytes(hash, &pwUps.z[0], pwUps.Size() * sizeof(GLfloat));
+            this->HashBytes(hash, &pwUps.outlineScale[0], pwUps.Size() * sizeof(GLfloat));
+            this->HashBytes(hash, &pwUps.flags[0], pwUps.Size());
+        }
+        this->HashBytes(hash, &state.car.position, sizeof(state.car.position));
+        this->HashBytes(hash, &state.carTurnAngle, sizeof(state.carTurnAngle));
+        this->HashBytes(hash, &state.blink, sizeof(state.blink));
+        this->HashBytes(hash, &this->pool.queuedBeats, sizeof(this->pool.queuedBeats));
+        return hash;
+    }
+
+private:
+    // time not yet simulated
+    GLfloat accumulator;
+    // moving powerups, sorted along Z
+    ZBroadphase broadphase;
+    // powerups to respawn, collision candidates and hits in the current step (kept to avoid allocations)
+    vector<GLuint> passed, candidates, hits;
+
+    //////////////////////////////////////////
+    // "count" entities are worth splitting between the workers
+    bool Parallel(GLuint count)
+    {
+        return this->jobs && this->jobs->Workers() > 0 && count > this->parallelGrain;
+    }
+
+    //////////////////////////////////////////
+    // the powerup waits far away, on a random X coordinate, until a beat spawns it again
+    void Respawn(GLuint i)
+    {
+        PowerUpStore &pwUps = this->current.powerUps;
+        GLint border = (GLint)this->streetBorder - 1;
+        // only the kind of powerup is kept
+        pwUps.flags[i] &= POWERUP_SPEEDUP;
+        pwUps.outlineScale[i] = this->maxOutlineScale;
+        pwUps.z[i] = this->pwUpStartingZ - this->random.Range(this->randomZSpawnOffset);
+        pwUps.x[i] = (GLfloat)(this->random.Range(border + border + 1) - border);
+    }
+
+    //////////////////////////////////////////
+    void HashBytes(uint32_t &hash, const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 16777619u;
+        }
+    }
+
+    //////////////////////////////////////////
+    // linear interpolation of a Z coordinate, skipped when the value wrapped around
+    GLfloat Lerp(GLfloat from, GLfloat to, GLfloat alpha)
+    {
+        if(to < from)
+            return to;
+        return from + (to - from) * alpha;
+    }
+};
@@ -0,0 +1,217 @@
+/*
+StreamBuffer class
+- a single buffer for the dynamic data written by the CPU at each frame (instance data, particles, ...), without re-specifying buffers with glBufferData
+- the buffer is split in STREAM_BUFFER_FRAMES regions, one for each frame in flight: at each frame, the data are sub-allocated in the next region
+- each region is protected by a fence (glFenceSync) placed after the last draw call of its frame: the region is written again only when the GPU has finished reading it
+- with GL_ARB_buffer_storage, the buffer is mapped once with a persistent and coherent mapping, and the allocations are pointers to the mapped memory (zero-copy).
+  Otherwise (OpenGL 3.3), the free part of the region of the frame is mapped with glMapBufferRange without synchronization (the fence already guarantees that the GPU is not using it), and unmapped by Commit.
+  Without persistent mapping, a mapped buffer cannot be used by draw calls (not even the parts outside the mapped range): all the allocations of the frame must be written, and committed, before the draw calls using the buffer
+
+Usage:
+    StreamBuffer stream(1 << 20, bufferStorage);    // bufferStorage: glBufferStorage, or NULL on OpenGL 3.3
+    ... in the render loop ...
+    stream.BeginFrame();
+    StreamAllocation instances = stream.Allocate(count * sizeof(glm::mat4));
+    ... write count matrices in instances.data ...
+    stream.Commit();
+    glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(size_t)instances.offset);
+    ... draw calls ...
+    stream.EndFrame();
+
+N.B.) the data of an allocation are valid only in the frame in which they are allocated
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <iostream>
+
+// GL Includes
+#include <glad/glad.h>
+
+#include <utils/render_stats.h>
+
+// GL_ARB_buffer_storage is not loaded by glad (OpenGL 4.4): the application passes the function pointer
+#ifndef GL_MAP_PERSISTENT_BIT
+    #define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+    #define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+// regions of the buffer (frames that can be in flight on the GPU)
+const GLuint STREAM_BUFFER_FRAMES = 3;
+
+// a sub-allocation: pointer for the CPU writes, and offset in the buffer for the OpenGL calls
+struct StreamAllocation {
+    void* data;
+    GLuint offset;
+};
+
+/////////////////// STREAMBUFFER class ///////////////////////
+class StreamBuffer
+{
+public:
+    GLuint buffer;
+    // bytes of each region
+    GLuint frameSize;
+    // persistent mapping (GL_ARB_buffer_storage), or mapping at each frame
+    bool persistent;
+    // bytes allocated in the last frame, frames waiting for the GPU, allocations not satisfied
+    GLuint used, stalls, overflows;
+
+    //////////////////////////////////////////
+    // constructor: "frameSize" bytes for each frame. With bufferStorage (glBufferStorage or glBufferStorageARB, if supported), the mapping is persistent
+    StreamBuffer(GLuint frameSize, PFNGLBUFFERSTORAGEPROC bufferStorage = NULL)
+        : frameSize(frameSize), persistent(bufferStorage != NULL), used(0), stalls(0), overflows(0), region(0), offset(0), mapped(NULL), mappedStart(0)
+    {
+        for(GLuint i = 0; i < STREAM_BUFFER_FRAMES; i++)
+            this->fences[i] = 0;
+        GLsizeiptr size = (GLsizeiptr)frameSize * STREAM_BUFFER_FRAMES;
+
+        glGenBuffers(1, &this->buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+        if(this->persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+            this->mapped = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+            if(!this->mapped)
+            {
+                cout << "ERROR::STREAMBUFFER:: Persistent mapping failed" << endl;
+                this->persistent = false;
+            }
+        }
+        // a buffer with immutable storage cannot be re-specified: without the persistent mapping, a new buffer is created
+        if(!this->persistent)
+        {
+            if(bufferStorage)
+            {
+                glDeleteBuffers(1, &this->buffer);
+                glGenBuffers(1, &this->buffer);
+                glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+            }
+            glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+    // we move to the region of the next frame, waiting (if needed) until the GPU has finished with it
+    void BeginFrame()
+    {
+        this->region = (this->region + 1) % STREAM_BUFFER_FRAMES;
+        this->offset = 0;
+        this->used = 0;
+        GLsync &fence = this->fences[this->region];
+        if(fence)
+        {
+            GLenum result = glClientWaitSync(fence, 0, 0);
+            if(result == GL_TIMEOUT_EXPIRED)
+            {
+                this->stalls++;
+                // the commands are flushed, otherwise the fence could never be signaled
+                while(result == GL_TIMEOUT_EXPIRED)
+                    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            }
+            if(result == GL_WAIT_FAILED)
+                cout << "ERROR::STREAMBUFFER:: Fence wait failed" << endl;
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+
+    //////////////////////////////////////////
+    // we sub-allocate "size" bytes in the region of the frame (offset multiple of "alignment", e.g. GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform blocks).
+    // The returned memory can be written directly. If the region is full (or size is 0), data is NULL
+    StreamAllocation Allocate(GLuint size, GLuint alignment = 16)
+    {
+        StreamAllocation allocation;
+        allocation.data = NULL;
+        allocation.offset = 0;
+        if(size == 0)
+            return allocation;
+        GLuint start = (this->offset + alignment - 1) / alignment * alignment;
+        if(start + size > this->frameSize)
+        {
+            this->overflows++;
+            return allocation;
+        }
+        if(!this->persistent && !this->mapped)
+        {
+            // the free part of the region is mapped: its previous content is not needed, and the fence already synchronized it.
+            // The allocations committed before in the frame are not mapped (and not invalidated), because draw calls can be using them
+            this->mappedStart = start;
+            glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+            this->mapped = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, this->region * this->frameSize + start, this->frameSize - start,
+                                                      GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            if(!this->mapped)
+            {
+                cout << "ERROR::STREAMBUFFER:: Mapping failed" << endl;
+                this->overflows++;
+                return allocation;
+            }
+        }
+        this->offset = start + size;
+        this->used = this->offset;
+        renderStats.bufferBytes += size;
+        allocation.offset = this->region * this->frameSize + start;
+        // the persistent mapping covers the whole buffer, the temporary one only the free part of the region of the frame
+        allocation.data = this->persistent ? this->mapped + allocation.offset : this->mapped + (start - this->mappedStart);
+        return allocation;
+    }
+
+    //////////////////////////////////////////
+    // the written data become visible to the following OpenGL commands (without persistent mapping, the region is unmapped: the next Allocate maps it again)
+    void Commit()
+    {
+        if(this->persistent || !this->mapped)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        this->mapped = NULL;
+    }
+
+    //////////////////////////////////////////
+    // after the last draw call using the data of the frame: the region is protected until the GPU has executed them
+    void EndFrame()
+    {
+        this->Commit();
+        this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    //////////////////////////////////////////
+    // buffer and fences are deleted when application ends
+    void Delete()
+    {
+        for(GLuint i = 0; i < STREAM_BUFFER_FRAMES; i++)
+        {
+            if(this->fences[i])
+                glDeleteSync(this->fences[i]);
+            this->fences[i] = 0;
+        }
+        if(this->persistent && this->mapped)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        this->mapped = NULL;
+        glDeleteBuffers(1, &this->buffer);
+    }
+
+private:
+    // region of the current frame, and first free byte in it
+    GLuint region;
+    GLuint offset;
+    GLsync fences[STREAM_BUFFER_FRAMES];
+    // mapped memory: the whole buffer (persistent), or the free part of the region of the frame (between Allocate and Commit), starting at mappedStart
+    GLubyte* mapped;
+    GLuint mappedStart;
+};
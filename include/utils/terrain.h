@@ -0,0 +1,452 @@
+/*
+Terrain class
+- infinite neon grid made of chunks (tiles of the grid) spawned ahead of the viewer and retired behind it
+- chunks are taken from, and given back to, a fixed-size pool: the memory used is bounded by the maximum horizon
+- the fbm displacement of each chunk is baked in a small texture only once, when the chunk is spawned (or when the noise zoom changes). Only the audio modulation is computed per frame in the vertex shader
+- distance-based density: each chunk is drawn with one of the LOD meshes, chosen from its distance to the viewer
+- grid update pass: once per frame, the displaced positions and normals of all the chunks are captured with Transform Feedback. All the following grid draws render from the captured buffers, without computing the displacement again
+- asynchronous readback of a low-resolution strip of heights across the grid, for gameplay code on the CPU
+
+All the chunks share the same LOD meshes, the per-chunk data is the position along Z, the noise texture and the captured vertex buffer.
+The chunk index grows along -Z and is used to place the chunk in the (infinite) noise field, so adjacent chunks are seamless.
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <deque>
+#include <cmath>
+
+// GL Includes
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <utils/grid_mesh.h>
+#include <utils/grid_noise.h>
+#include <utils/gl_state.h>
+
+// number of LOD levels: full density, half density, quarter density
+const GLuint TERRAIN_LODS = 3;
+// captured vertex: world position (3 floats), world normal (3 floats), grid UV (2 floats)
+const GLuint TERRAIN_VERTEX_FLOATS = 8;
+// number of readback buffers in flight for the height strip
+const GLuint TERRAIN_READBACKS = 3;
+// texels baked past each edge of a chunk: the normals at the edges are computed from the heights of the next vertices (up to 2^(TERRAIN_LODS-1) texels away),
+// which must be the same ones seen by the neighbouring chunk
+const GLuint TERRAIN_NOISE_BORDER = 1 << (TERRAIN_LODS - 1);
+
+// data of a single chunk
+struct TerrainChunk {
+    // world Z coordinate of the near edge (the chunk spans [z - length, z])
+    GLfloat z;
+    // position of the chunk in the noise field (0 is the first spawned chunk, it grows along -Z)
+    GLint index;
+    // baked fbm noise, (columns x rows+1) texels plus TERRAIN_NOISE_BORDER texels on each side
+    GLuint noiseTexture;
+    // displaced vertices captured by the grid update pass, and VAO to draw them
+    GLuint feedbackBuffer;
+    GLuint VAO;
+    // LOD used for the last capture
+    GLuint lod;
+};
+
+// a copy of one captured row of vertices, waiting to be read on the CPU
+struct TerrainReadback {
+    GLuint buffer;
+    // the copy is finished when the fence is signaled
+    GLsync fence;
+    // vertices in the copied row
+    GLuint columns;
+};
+
+/////////////////// TERRAIN class ///////////////////////
+class Terrain
+{
+public:
+    // grid width (X) in world units
+    GLfloat width;
+    // distance between two rows of the grid, in world units
+    GLfloat rowSpacing;
+    // vertices along X at full density
+    GLuint columns;
+    // rows of quads in each chunk
+    GLuint rowsPerChunk;
+    // distance ahead of the viewer covered by chunks (clamped to maxHorizon)
+    GLfloat horizon;
+    // maximum horizon, it sets the pool size
+    GLfloat maxHorizon;
+    // distance behind the viewer after which chunks are retired
+    GLfloat retireDistance;
+    // chunks farther than lodDistance[i] are drawn with the LOD i+1
+    GLfloat lodDistance[TERRAIN_LODS - 1];
+    // last height strip read from the GPU: heights (world Y) from X = -width/2 to X = width/2
+    vector<GLfloat> heightStrip;
+    // world Z of the strip
+    GLfloat heightStripZ;
+
+    //////////////////////////////////////////
+    // constructor: we create the LOD meshes and the pool of chunks
+    Terrain(GridNoise &noise, GLfloat width = 50.0f, GLfloat rowSpacing = 50.0f / 99.0f, GLuint columns = 100, GLuint rowsPerChunk = 32, GLfloat maxHorizon = 200.0f)
+        : width(width), rowSpacing(rowSpacing), columns(columns), rowsPerChunk(rowsPerChunk),
+          horizon(100.0f), maxHorizon(maxHorizon), retireDistance(5.0f), heightStripZ(0.0f),
+          noise(noise), bakedZoom(-1.0f), nextReadback(0)
+    {
+        this->lodDistance[0] = 40.0f;
+        this->lodDistance[1] = 80.0f;
+
+        GLfloat length = this->ChunkLength();
+        // LOD i has 1/2^i of the vertices along each direction
+        for(GLuint i = 0; i < TERRAIN_LODS; i++)
+        {
+            GLuint lodColumns = (this->columns - 1) / (1 << i) + 1;
+            GLuint lodRows = this->rowsPerChunk / (1 << i) + 1;
+            this->lods.push_back(CreateGridMesh(lodColumns, lodRows, this->width, length));
+            // the captured vertices are drawn with the same indices of the LOD mesh
+            // (no VAO bound: the element buffer binding is a state of the bound VAO)
+            GLuint EBO;
+            glGenBuffers(1, &EBO);
+            glState.BindVertexArray(0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->lods[i].indices.size() * sizeof(GLuint), &this->lods[i].indices[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+            this->lodEBOs.push_back(EBO);
+        }
+        GLsizeiptr capturedSize = this->lods[0].vertices.size() * TERRAIN_VERTEX_FLOATS * sizeof(GLfloat);
+
+        // the pool must cover the max horizon, the retire distance, and a chunk partially out of each end
+        GLuint poolSize = (GLuint)ceil((this->maxHorizon + this->retireDistance) / length) + 2;
+        for(GLuint i = 0; i < poolSize; i++)
+        {
+            TerrainChunk chunk;
+            chunk.z = 0.0f;
+            chunk.index = 0;
+            chunk.noiseTexture = CreateNoiseTexture(this->columns + 2 * TERRAIN_NOISE_BORDER, this->rowsPerChunk + 1 + 2 * TERRAIN_NOISE_BORDER, GL_CLAMP_TO_EDGE);
+            chunk.lod = 0;
+            // the captured buffer is sized for the full density LOD
+            glGenBuffers(1, &chunk.feedbackBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, chunk.feedbackBuffer);
+            glBufferData(GL_ARRAY_BUFFER, capturedSize, NULL, GL_DYNAMIC_COPY);
+            // the VAO reads the captured vertices with the same attribute locations of the Mesh class
+            glGenVertexArrays(1, &chunk.VAO);
+            glState.BindVertexArray(chunk.VAO);
+            GLsizei stride = TERRAIN_VERTEX_FLOATS * sizeof(GLfloat);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(3 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(6 * sizeof(GLfloat)));
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->lodEBOs[0]);
+            glState.BindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+            this->pool.push_back(chunk);
+            this->freeChunks.push_back(i);
+        }
+
+        // buffers for the height strip readback, each one can contain a full density row
+        for(GLuint i = 0; i < TERRAIN_READBACKS; i++)
+        {
+            TerrainReadback readback;
+            glGenBuffers(1, &readback.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, this->columns * TERRAIN_VERTEX_FLOATS * sizeof(GLfloat), NULL, GL_STREAM_READ);
+            readback.fence = 0;
+            readback.columns = 0;
+            this->readbacks.push_back(readback);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    //////////////////////////////////////////
+    // length of a chunk along Z, in world units
+    GLfloat ChunkLength() { return this->rowsPerChunk * this->rowSpacing; }
+
+    // number of chunks currently used, and size of the pool
+    GLuint ActiveChunks() { return this->activeChunks.size(); }
+    GLuint PoolSize() { return this->pool.size(); }
+
+    //////////////////////////////////////////
+    // we move the chunks toward the viewer by "scroll" world units, we retire the ones behind it and we spawn the new ones up to the horizon
+    void Update(GLfloat scroll, GLfloat zoom, GLfloat viewerZ)
+    {
+        GLfloat length = this->ChunkLength();
+        if(this->horizon > this->maxHorizon)
+            this->horizon = this->maxHorizon;
+
+        // the noise depends on the zoom: if it changed, we bake again the active chunks
+        if(zoom != this->bakedZoom)
+        {
+            this->bakedZoom = zoom;
+            for(GLuint i = 0; i < this->activeChunks.size(); i++)
+                this->BakeChunk(this->pool[this->activeChunks[i]]);
+        }
+
+        for(GLuint i = 0; i < this->activeChunks.size(); i++)
+            this->pool[this->activeChunks[i]].z += scroll;
+
+        // active chunks are ordered from the nearest to the farthest, so the ones to retire are at the front
+        while(!this->activeChunks.empty() && this->pool[this->activeChunks.front()].z - length > viewerZ + this->retireDistance)
+        {
+            this->freeChunks.push_back(this->activeChunks.front());
+            this->activeChunks.pop_front();
+        }
+
+        // first chunk: its near edge is placed at the retire distance
+        if(this->activeChunks.empty() && !this->freeChunks.empty())
+            this->Spawn(viewerZ + this->retireDistance, 0);
+
+        // we spawn new chunks after the farthest one, until the horizon is covered or the pool is exhausted
+        while(!this->freeChunks.empty())
+        {
+            TerrainChunk &last = this->pool[this->activeChunks.back()];
+            GLfloat farEdge = last.z - length;
+            if(farEdge < viewerZ - this->horizon)
+                break;
+            this->Spawn(farEdge, last.index + 1);
+        }
+    }
+
+    //////////////////////////////////////////
+    // grid update pass: we capture the displaced vertices of each active chunk in its buffer.
+    // The update shader must be already in use, with the music and displacement uniforms already set.
+    // The noise texture of each chunk is bound on the given texture unit.
+    void Capture(Shader &updateShader, GLfloat viewerZ, GLuint unit)
+    {
+        GLfloat length = this->ChunkLength();
+        updateShader.Uniform1i("chunkNoise", unit);
+        updateShader.Uniform2f("noiseResolution", (GLfloat)this->columns, (GLfloat)(this->rowsPerChunk + 1));
+        updateShader.Uniform1f("noiseBorder", (GLfloat)TERRAIN_NOISE_BORDER);
+        updateShader.Uniform1f("chunkRows", (GLfloat)this->rowsPerChunk);
+        updateShader.Uniform2f("chunkSize", this->width, length);
+
+        // only the vertex stage is needed
+        glState.Enable(GL_RASTERIZER_DISCARD);
+        glState.ActiveTexture(GL_TEXTURE0 + unit);
+        for(GLuint i = 0; i < this->activeChunks.size(); i++)
+        {
+            TerrainChunk &chunk = this->pool[this->activeChunks[i]];
+            // the LOD meshes are centered in the origin: we move them on the chunk position
+            GLfloat center = chunk.z - length * 0.5f;
+            glm::mat4 modelMatrix;
+            modelMatrix = glm::translate(modelMatrix, glm::vec3(0.0f, -0.5f, center));
+            updateShader.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(modelMatrix));
+
+            GLuint lod = this->LodLevel(fabs(center - viewerZ));
+            Mesh &mesh = this->lods[lod];
+            GLuint lodColumns = (this->columns - 1) / (1 << lod) + 1;
+            GLuint lodRows = this->rowsPerChunk / (1 << lod) + 1;
+            updateShader.Uniform2f("cellSize", 1.0f / (lodColumns - 1), 1.0f / (lodRows - 1));
+            glState.BindTexture(GL_TEXTURE_2D, chunk.noiseTexture);
+
+            // each vertex of the LOD mesh is processed once, as a point
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, chunk.feedbackBuffer);
+            glBeginTransformFeedback(GL_POINTS);
+            glState.BindVertexArray(mesh.VAO);
+            glDrawArrays(GL_POINTS, 0, mesh.vertices.size());
+            CountDraw(GL_POINTS, mesh.vertices.size());
+            glEndTransformFeedback();
+
+            // if the LOD changed, the chunk VAO must use the indices of the new LOD
+            if(lod != chunk.lod)
+            {
+                glState.BindVertexArray(chunk.VAO);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->lodEBOs[lod]);
+                chunk.lod = lod;
+            }
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glState.Disable(GL_RASTERIZER_DISCARD);
+    }
+
+    //////////////////////////////////////////
+    // rendering of the active chunks from the captured buffers (Capture must be called before, in the same frame).
+    // The shader must be already in use, with all its uniforms set: vertices are already displaced and in world coordinates.
+    void Draw()
+    {
+        for(GLuint i = 0; i < this->activeChunks.size(); i++)
+        {
+            TerrainChunk &chunk = this->pool[this->activeChunks[i]];
+            glState.BindVertexArray(chunk.VAO);
+            glDrawElements(GL_TRIANGLES, this->lods[chunk.lod].indices.size(), GL_UNSIGNED_INT, 0);
+            CountDraw(GL_TRIANGLES, this->lods[chunk.lod].indices.size());
+        }
+    }
+
+    //////////////////////////////////////////
+    // we start the copy of the captured row of vertices nearest to world Z = z, sampled later by ReadHeightStrip.
+    // The copy happens on the GPU, and the CPU reads it only when its fence is signaled, so the pipeline never stalls.
+    void RequestHeightStrip(GLfloat z)
+    {
+        GLfloat length = this->ChunkLength();
+        TerrainReadback &readback = this->readbacks[this->nextReadback];
+        // all the readback buffers are in flight: we skip this request
+        if(readback.fence != 0)
+            return;
+
+        for(GLuint i = 0; i < this->activeChunks.size(); i++)
+        {
+            TerrainChunk &chunk = this->pool[this->activeChunks[i]];
+            if(z > chunk.z || z < chunk.z - length)
+                continue;
+
+            // rows of the LOD meshes go from the near edge (row 0) to the far one
+            GLuint lodColumns = (this->columns - 1) / (1 << chunk.lod) + 1;
+            GLuint lodRows = this->rowsPerChunk / (1 << chunk.lod) + 1;
+            GLuint row = (GLuint)((chunk.z - z) / length * (lodRows - 1) + 0.5f);
+            GLsizeiptr rowSize = lodColumns * TERRAIN_VERTEX_FLOATS * sizeof(GLfloat);
+
+            glBindBuffer(GL_COPY_READ_BUFFER, chunk.feedbackBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, row * rowSize, 0, rowSize);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            readback.columns = lodColumns;
+            this->nextReadback = (this->nextReadback + 1) % TERRAIN_READBACKS;
+            return;
+        }
+    }
+
+    //////////////////////////////////////////
+    // we read the completed copies (without waiting), and we update the height strip with "samples" heights.
+    // The ring is walked in request order, from the oldest slot (nextReadback): only the newest completed copy is read, the older ones are discarded.
+    // it returns true if the strip has been updated
+    bool ReadHeightStrip(GLuint samples)
+    {
+        GLint newest = -1;
+        for(GLuint k = 0; k < TERRAIN_READBACKS; k++)
+        {
+            GLuint i = (this->nextReadback + k) % TERRAIN_READBACKS;
+            TerrainReadback &readback = this->readbacks[i];
+            if(readback.fence == 0)
+                continue;
+            GLenum status = glClientWaitSync(readback.fence, 0, 0);
+            if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                continue;
+            glDeleteSync(readback.fence);
+            readback.fence = 0;
+            newest = i;
+        }
+        if(newest < 0)
+            return false;
+
+        TerrainReadback &readback = this->readbacks[newest];
+        vector<GLfloat> row(readback.columns * TERRAIN_VERTEX_FLOATS);
+        glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, row.size() * sizeof(GLfloat), &row[0]);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+        // low resolution strip: we take the height (Y) of evenly spaced vertices of the row
+        this->heightStrip.resize(samples);
+        for(GLuint s = 0; s < samples; s++)
+        {
+            GLuint column = s * (readback.columns - 1) / (samples - 1);
+            this->heightStrip[s] = row[column * TERRAIN_VERTEX_FLOATS + 1];
+        }
+        this->heightStripZ = row[2];
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // height of the terrain (world Y) at world X, interpolated from the last height strip
+    GLfloat HeightAt(GLfloat x)
+    {
+        if(this->heightStrip.size() < 2)
+            return -0.5f;
+        GLfloat position = (x / this->width + 0.5f) * (this->heightStrip.size() - 1);
+        position = glm::clamp(position, 0.0f, (GLfloat)(this->heightStrip.size() - 1));
+        GLuint left = (GLuint)position;
+        GLuint right = glm::min(left + 1, (GLuint)this->heightStrip.size() - 1);
+        return glm::mix(this->heightStrip[left], this->heightStrip[right], position - left);
+    }
+
+    //////////////////////////////////////////
+    // true if the last height strip was read near world Z = z (within a row of the coarsest LOD).
+    // A strip far from z (e.g. copied from a chunk retired in the meantime) must not be used for gameplay at z
+    bool StripNear(GLfloat z)
+    {
+        return this->heightStrip.size() >= 2 && fabs(this->heightStripZ - z) <= this->rowSpacing * (1 << (TERRAIN_LODS - 1));
+    }
+
+    //////////////////////////////////////////
+    // resources are deallocated when application ends
+    void Delete()
+    {
+        for(GLuint i = 0; i < this->lods.size(); i++)
+            this->lods[i].Delete();
+        for(GLuint i = 0; i < this->lodEBOs.size(); i++)
+            glDeleteBuffers(1, &this->lodEBOs[i]);
+        for(GLuint i = 0; i < this->pool.size(); i++)
+        {
+            glState.DeleteTexture(this->pool[i].noiseTexture);
+            glDeleteBuffers(1, &this->pool[i].feedbackBuffer);
+            glState.DeleteVertexArray(this->pool[i].VAO);
+        }
+        for(GLuint i = 0; i < this->readbacks.size(); i++)
+        {
+            if(this->readbacks[i].fence != 0)
+                glDeleteSync(this->readbacks[i].fence);
+            glDeleteBuffers(1, &this->readbacks[i].buffer);
+        }
+    }
+
+private:
+    // used to bake the chunks noise
+    GridNoise &noise;
+    // shared meshes, one for each LOD, and copies of their indices used to draw the captured vertices
+    vector<Mesh> lods;
+    vector<GLuint> lodEBOs;
+    // all the chunks, allocated at construction
+    vector<TerrainChunk> pool;
+    // indices (in the pool) of the chunks currently used, from the nearest to the farthest
+    deque<GLuint> activeChunks;
+    // indices (in the pool) of the available chunks
+    vector<GLuint> freeChunks;
+    // zoom used to bake the active chunks
+    GLfloat bakedZoom;
+    // ring of readback buffers for the height strip
+    vector<TerrainReadback> readbacks;
+    GLuint nextReadback;
+
+    //////////////////////////////////////////
+    // we take a chunk from the pool, we place it and we bake its noise
+    void Spawn(GLfloat z, GLint index)
+    {
+        GLuint id = this->freeChunks.back();
+        this->freeChunks.pop_back();
+        TerrainChunk &chunk = this->pool[id];
+        chunk.z = z;
+        chunk.index = index;
+        this->BakeChunk(chunk);
+        this->activeChunks.push_back(id);
+    }
+
+    //////////////////////////////////////////
+    // chunk "index" covers the noise region from V = -(index+1) * rowsPerChunk / 99 (far edge) to V = -index * rowsPerChunk / 99 (near edge)
+    // N.B.) 99 is the number of rows in a grid length, as in FFTDisplacement.vert
+    // The region is extended by TERRAIN_NOISE_BORDER texels on each side, with the same spacing: the border texels of a chunk are the inner texels of its neighbours
+    void BakeChunk(TerrainChunk &chunk)
+    {
+        GLfloat chunkV = this->rowsPerChunk / 99.0f;
+        glm::vec2 spacing = glm::vec2(1.0f / (this->columns - 1), chunkV / this->rowsPerChunk) * (GLfloat)TERRAIN_NOISE_BORDER;
+        glm::vec2 origin = glm::vec2(0.0f, -(chunk.index + 1) * chunkV) - spacing;
+        glm::vec2 extent = glm::vec2(1.0f, chunkV) + 2.0f * spacing;
+        this->noise.BakeRegion(chunk.noiseTexture, this->columns + 2 * TERRAIN_NOISE_BORDER, this->rowsPerChunk + 1 + 2 * TERRAIN_NOISE_BORDER, origin, extent, this->bakedZoom, false);
+    }
+
+    //////////////////////////////////////////
+    GLuint LodLevel(GLfloat distance)
+    {
+        GLuint level = 0;
+        while(level < TERRAIN_LODS - 1 && distance > this->lodDistance[level])
+            level++;
+        return level;
+    }
+};
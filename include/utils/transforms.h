@@ -0,0 +1,251 @@
+/*
+TransformStore class
+- structure-of-arrays storage of the transforms of a set of entities: translation (separate x/y/z arrays), rotation around the Y axis (sine and cosine arrays) and uniform scale
+- Compute: model, model-view and normal matrices of a range of entities in a single batch, with the same view matrix for all of them
+- the matrices are built directly from translation, rotation and scale, without chains of glm::translate/rotate/scale and without matrix inversions:
+  with uniform scale s and a rigid view matrix (rotation and translation, like the one of the Camera), the normal matrix is the upper 3x3 of the model-view matrix divided by s*s
+- the model-view and normal matrices are written in an array of TransformInstance (e.g., memory allocated in a StreamBuffer), which can be read directly as instance attributes (see Mesh::SetInstanceMatrices)
+- Compute has a SSE version (4 entities for each iteration, transposed to the output layout) and a scalar version, which is the reference and the fallback when SSE is not available
+
+Usage:
+    TransformStore palms(palmAmount);
+    palms.Set(i, position, angle, scale);
+    ...
+    palms.Compute(0, palms.Size(), view, instances, models);    // instances and models can be NULL
+*/
+
+#pragma once
+
+using namespace std;
+
+// Std. Includes
+#include <vector>
+#include <cmath>
+
+// GL Includes
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #define TRANSFORM_SIMD
+    #include <xmmintrin.h>
+#endif
+
+// per-instance data: model-view matrix (column-major, vertex attributes 5 to 8) and normal matrix (column-major, 3 columns, vertex attributes 9 to 11)
+struct TransformInstance {
+    GLfloat modelView[16];
+    GLfloat normal[9];
+};
+
+/////////////////// TRANSFORMSTORE class ///////////////////////
+class TransformStore
+{
+public:
+    // translation, rotation around Y (sine and cosine of the angle), uniform scale
+    vector<GLfloat> x, y, z;
+    vector<GLfloat> sine, cosine;
+    vector<GLfloat> scale;
+
+    //////////////////////////////////////////
+    TransformStore(GLuint size = 0)
+    {
+        this->Resize(size);
+    }
+
+    //////////////////////////////////////////
+    GLuint Size() const
+    {
+        return this->x.size();
+    }
+
+    //////////////////////////////////////////
+    void Resize(GLuint size)
+    {
+        this->x.resize(size);
+        this->y.resize(size);
+        this->z.resize(size);
+        this->sine.resize(size);
+        this->cosine.resize(size);
+        this->scale.resize(size);
+    }
+
+    //////////////////////////////////////////
+    // transform of the i-th entity: translation, angle (in radians, like glm::rotate) around the Y axis, uniform scale
+    void Set(GLuint i, const glm::vec3 &position, GLfloat angle, GLfloat scale)
+    {
+        this->x[i] = position.x;
+        this->y[i] = position.y;
+        this->z[i] = position.z;
+        this->sine[i] = std::sin(angle);
+        this->cosine[i] = std::cos(angle);
+        this->scale[i] = scale;
+    }
+
+    //////////////////////////////////////////
+    // we keep (in the same order) only the entities of "source" with a non-zero mask (e.g., the visible ones), so that they can be computed and drawn as a contiguous range
+    void Select(const TransformStore &source, const vector<GLubyte> &mask)
+    {
+        this->Resize(0);
+        for(GLuint i = 0; i < source.Size(); i++)
+        {
+            if(!mask[i])
+                continue;
+            this->x.push_back(source.x[i]);
+            this->y.push_back(source.y[i]);
+            this->z.push_back(source.z[i]);
+            this->sine.push_back(source.sine[i]);
+            this->cosine.push_back(source.cosine[i]);
+            this->scale.push_back(source.scale[i]);
+        }
+    }
+
+    //////////////////////////////////////////
+    // model-view and normal matrices (in instances[first..last-1]) and model matrices (in models[first..last-1]) of the entities in [first, last).
+    // Each output is skipped if its pointer is NULL. "view" must be a rigid transformation (otherwise the normal matrices are not correct)
+    void Compute(GLuint first, GLuint last, const glm::mat4 &view, TransformInstance* instances, glm::mat4* models) const
+    {
+        GLuint i = first;
+#ifdef TRANSFORM_SIMD
+        // columns of the view matrix, each component broadcast in a register
+        __m128 v[4][4];
+        for(GLuint c = 0; c < 4; c++)
+            for(GLuint r = 0; r < 4; r++)
+                v[c][r] = _mm_set1_ps(view[c][r]);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        for(; i + 4 <= last; i += 4)
+        {
+            __m128 px = _mm_loadu_ps(&this->x[i]);
+            __m128 py = _mm_loadu_ps(&this->y[i]);
+            __m128 pz = _mm_loadu_ps(&this->z[i]);
+            __m128 sn = _mm_loadu_ps(&this->sine[i]);
+            __m128 cs = _mm_loadu_ps(&this->cosine[i]);
+            __m128 s = _mm_loadu_ps(&this->scale[i]);
+
+            if(models)
+            {
+                // model = T * R * S: the columns are s*(c, 0, -sn), s*(0, 1, 0), s*(sn, 0, c), and the translation
+                __m128 scs = _mm_mul_ps(cs, s);
+                __m128 ssn = _mm_mul_ps(sn, s);
+                StoreColumns(scs, zero, _mm_sub_ps(zero, ssn), zero, models, i, 0);
+                StoreColumns(zero, s, zero, zero, models, i, 1);
+                StoreColumns(ssn, zero, scs, zero, models, i, 2);
+                StoreColumns(px, py, pz, one, models, i, 3);
+            }
+            if(instances)
+            {
+                // rotated axes in view space: R0 = c*V0 - sn*V2, R2 = sn*V0 + c*V2 (R1 = V1)
+                __m128 r0[4], r2[4], mv0[4], mv1[4], mv2[4], mv3[4];
+                for(GLuint r = 0; r < 4; r++)
+                {
+                    r0[r] = _mm_sub_ps(_mm_mul_ps(cs, v[0][r]), _mm_mul_ps(sn, v[2][r]));
+                    r2[r] = _mm_add_ps(_mm_mul_ps(sn, v[0][r]), _mm_mul_ps(cs, v[2][r]));
+                    mv0[r] = _mm_mul_ps(r0[r], s);
+                    mv1[r] = _mm_mul_ps(v[1][r], s);
+                    mv2[r] = _mm_mul_ps(r2[r], s);
+                    mv3[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, v[0][r]), _mm_mul_ps(py, v[1][r])), _mm_add_ps(_mm_mul_ps(pz, v[2][r]), v[3][r]));
+                }
+                StoreInstanceColumns(mv0, instances, i, 0);
+                StoreInstanceColumns(mv1, instances, i, 4);
+                StoreInstanceColumns(mv2, instances, i, 8);
+                StoreInstanceColumns(mv3, instances, i, 12);
+
+                // normal matrix: upper 3x3 of the model-view matrix divided by s*s, i.e., the rotated axes divided by s
+                __m128 inv = _mm_div_ps(one, s);
+                __m128 n0[4], n1[4], n2[4];
+                for(GLuint r = 0; r < 3; r++)
+                {
+                    n0[r] = _mm_mul_ps(r0[r], inv);
+                    n1[r] = _mm_mul_ps(v[1][r], inv);
+                    n2[r] = _mm_mul_ps(r2[r], inv);
+                }
+                n0[3] = n1[3] = n2[3] = zero;
+                StoreNormalColumns(n0, n1, n2, instances, i);
+            }
+        }
+#endif
+        for(; i < last; i++)
+            this->ComputeScalar(i, view, instances, models);
+    }
+
+private:
+    //////////////////////////////////////////
+    // reference version, for a single entity (same operations of the SSE version)
+    void ComputeScalar(GLuint i, const glm::mat4 &view, TransformInstance* instances, glm::mat4* models) const
+    {
+        GLfloat s = this->scale[i], sn = this->sine[i], cs = this->cosine[i];
+        if(models)
+        {
+            glm::mat4 &m = models[i];
+            m[0] = glm::vec4(cs * s, 0.0f, 0.0f - sn * s, 0.0f);
+            m[1] = glm::vec4(0.0f, s, 0.0f, 0.0f);
+            m[2] = glm::vec4(sn * s, 0.0f, cs * s, 0.0f);
+            m[3] = glm::vec4(this->x[i], this->y[i], this->z[i], 1.0f);
+        }
+        if(instances)
+        {
+            TransformInstance &instance = instances[i];
+            GLfloat inv = 1.0f / s;
+            for(GLuint r = 0; r < 4; r++)
+            {
+                GLfloat r0 = cs * view[0][r] - sn * view[2][r];
+                GLfloat r2 = sn * view[0][r] + cs * view[2][r];
+                instance.modelView[r] = r0 * s;
+                instance.modelView[4 + r] = view[1][r] * s;
+                instance.modelView[8 + r] = r2 * s;
+                instance.modelView[12 + r] = (this->x[i] * view[0][r] + this->y[i] * view[1][r]) + (this->z[i] * view[2][r] + view[3][r]);
+                if(r < 3)
+                {
+                    instance.normal[r] = r0 * inv;
+                    instance.normal[3 + r] = view[1][r] * inv;
+                    instance.normal[6 + r] = r2 * inv;
+                }
+            }
+        }
+    }
+
+#ifdef TRANSFORM_SIMD
+    //////////////////////////////////////////
+    // the registers contain a component (row) of a column for 4 entities: after the transposition, each register contains the column of an entity
+    static void StoreColumns(__m128 r0, __m128 r1, __m128 r2, __m128 r3, glm::mat4* models, GLuint i, GLuint column)
+    {
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(&models[i][column][0], r0);
+        _mm_storeu_ps(&models[i + 1][column][0], r1);
+        _mm_storeu_ps(&models[i + 2][column][0], r2);
+        _mm_storeu_ps(&models[i + 3][column][0], r3);
+    }
+
+    //////////////////////////////////////////
+    static void StoreInstanceColumns(__m128 rows[4], TransformInstance* instances, GLuint i, GLuint offset)
+    {
+        __m128 r0 = rows[0], r1 = rows[1], r2 = rows[2], r3 = rows[3];
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(instances[i].modelView + offset, r0);
+        _mm_storeu_ps(instances[i + 1].modelView + offset, r1);
+        _mm_storeu_ps(instances[i + 2].modelView + offset, r2);
+        _mm_storeu_ps(instances[i + 3].modelView + offset, r3);
+    }
+
+    //////////////////////////////////////////
+    // the 3 columns of the normal matrices are packed: the 4th component written with a column is overwritten by the next one, and the last column is written with 3 floats (not to write after the instance)
+    static void StoreNormalColumns(__m128 n0[4], __m128 n1[4], __m128 n2[4], TransformInstance* instances, GLuint i)
+    {
+        __m128 c0[4] = {n0[0], n0[1], n0[2], n0[3]};
+        __m128 c1[4] = {n1[0], n1[1], n1[2], n1[3]};
+        __m128 c2[4] = {n2[0], n2[1], n2[2], n2[3]};
+        _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+        _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+        _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+        for(GLuint e = 0; e < 4; e++)
+        {
+            GLfloat* normal = instances[i + e].normal;
+            _mm_storeu_ps(normal, c0[e]);
+            _mm_storeu_ps(normal + 3, c1[e]);
+            _mm_storel_pi((__m64*)(normal + 6), c2[e]);
+            _mm_store_ss(normal + 8, _mm_movehl_ps(c2[e], c2[e]));
+        }
+    }
+#endif
+};
@@ -0,0 +1,87 @@
+/*
+FFTDisplacementFBM.vert: reference version of FFTDisplacement.vert, evaluating the fbm noise per vertex at each frame.
+It is not used for rendering anymore (the noise is baked in a texture by the GridNoise class), it is kept for the grid benchmark in the GUI.
+*/
+
+#version 330 core
+
+// vertex position in world coordinates
+layout (location = 0) in vec3 position;
+// vertex normal in world coordinate
+layout (location = 1) in vec3 normal;
+// UV texture coordinates
+layout (location = 2) in vec2 UV;
+
+// model matrix
+uniform mat4 modelMatrix;
+// view matrix
+uniform mat4 viewMatrix;
+// Projection matrix
+uniform mat4 projectionMatrix;
+// normal matrix
+uniform mat3 normalMatrix;
+
+uniform vec3 pointLightPosition;
+
+// frequency bands (BandValue): the grid is divided along V in one zone for each band
+#include "bands.glsl"
+
+uniform float time;
+uniform float scrollSpeed;
+// The amount of zoom applied to the UV coordinates is used to "zoom" in/out the noise
+uniform float zoom;
+uniform float dPower;
+uniform float streetSize;
+uniform float fade;
+
+// Interpolated UV coordinates to pass to the fragment shader
+out vec2 interp_UV;
+
+out vec3 lightDir;
+out vec3 vNormal;
+out vec3 vViewPosition;
+out vec3 vPosition;
+
+// rand, noise and fbm
+#include "noise.glsl"
+
+void main()
+{
+	float speed = time * scrollSpeed;
+	// translation for noise and grid scrolling animation
+	vec2 translate = vec2(0.0, speed);
+	
+	// speed used for vertex translation, this will let the vertex 
+	//move along the z axis and then return to its original position
+	float speedFrac = fract(speed) * 0.1;
+	
+	// The noise is also traslated by multiplying the floor of the translation 
+	// with an offset depending on the zoom value (offset = zoom * 10^-2).
+	// The resulting translation let the noise move row by row along the grid.
+	vec2 noisePos = UV * zoom - floor(translate) * (zoom / 99.0);
+	float noised = fbm(noisePos);
+	
+	// we add the street space into the grid by smoothing the noise
+	noised *= 1.0 - (smoothstep(0.5 - streetSize - fade, 0.5 - streetSize, UV.x) 
+				- smoothstep(0.5 + streetSize, 0.5 + streetSize + fade, UV.x));
+
+	float displacement = (noised * BandValue(UV.y)) * dPower;
+	
+	vec3 displacedPosition = position + displacement * normal;
+	// translate the vertex position in order to achieve the movement illusion
+	displacedPosition.z += speedFrac * 50;
+	vPosition = displacedPosition;
+	
+	vec4 modelView = viewMatrix * modelMatrix * vec4(displacedPosition, 1.0);
+	
+	vViewPosition = -modelView.xyz;
+	// transformations are applied to the normal
+	vNormal = normalize( normalMatrix * normal );
+
+	// light incidence direction (in view coordinate)
+	vec4 lightPos = viewMatrix  * vec4(pointLightPosition, 1.0);
+	lightDir = lightPos.xyz - modelView.xyz;
+	
+	interp_UV = UV;
+	gl_Position = projectionMatrix * modelView;
+}
@@ -18,6 +18,7 @@ positive Z axis points "outside" the screen
 // Std. Includes
 #include <string>
 #include <random>
+#include <ctime>
 
 // Loader for OpenGL extensions
 // http://glad.dav1d.de/
@@ -54,6 +55,41 @@ positive Z axis points "outside" the screen
 #include <utils/shader_v1.h>
 #include <utils/model_v2.h>
 #include <utils/camera.h>
+// procedural grid and baked grid noise
+#include <utils/grid_mesh.h>
+#include <utils/grid_noise.h>
+// chunked infinite grid
+#include <utils/terrain.h>
+// GPU timing of the sections of the frame
+#include <utils/gpu_profiler.h>
+// CPU zones, exported as Chrome trace (compiled out in release)
+#include <utils/cpu_profiler.h>
+// offscreen rendering and per-frame log of the headless benchmark
+#include <utils/benchmark.h>
+// gameplay updated at a fixed rate
+#include <utils/simulation.h>
+// record and replay of the gameplay inputs
+#include <utils/replay.h>
+// GPU particles for the explosions of the powerups
+#include <utils/particles.h>
+// ring buffer for the dynamic data of each frame (instance data), written directly by the CPU
+#include <utils/stream_buffer.h>
+// model, model-view and normal matrices of palms, powerups and car, computed in SIMD batches from their translation, rotation and scale
+#include <utils/transforms.h>
+// disk cache of the compiled Shader Programs
+#include <utils/shader_cache.h>
+// reload of the Shader Programs when their files change
+#include <utils/shader_reload.h>
+// rendering of the frame as a graph of passes
+#include <utils/render_graph.h>
+// worker threads for the CPU work of the frame and of the loading
+#include <utils/job_system.h>
+// cache of the OpenGL state, which filters the redundant state changes
+#include <utils/gl_state.h>
+// dual filter bloom of the HDR scene, drawn with fullscreen triangles
+#include <utils/fullscreen_triangle.h>
+#include <utils/bloom.h>
+#include <utils/post_stack.h>
 
 // we load the GLM classes used in the application
 #include <glm/glm.hpp>
@@ -65,40 +101,13 @@ positive Z axis points "outside" the screen
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image/stb_image.h>
 
-struct PowerUp{
-	//powerup and collider position
-	glm::vec3 position;
-	//sphere collider radius
-	GLfloat radius;
-	//check, upon collision, if the speed
-	//must be increased or decreased
-	bool speedUp;
-	//check if a collision occurred
-	bool hit;
-	//int passed as uniform to the geometry
-	//shader to start the explosion animation
-	GLint explodeValue;
-	//the time when the explosion starts
-	GLfloat explosionStartTime;
-	//check if the powerup spawned
-	bool spawned;
-	//check if the powerup is spawning
-	bool spawning;
-	//scale of the outline
-	//used during the spawning animation
-	GLfloat spawningOutlineScale;
-};
-
-struct Car{
-	glm::vec3 position;
-	glm::vec3 size;
-};
-
 // dimensions of application's window
 GLuint screenWidth = 1920, screenHeight = 1080;
 
 // callback functions for keyboard and mouse events
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
+// the key events received by the callback (or replayed from a recording) are managed here
+void ProcessKey(GLFWwindow* window, int key, int action);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 // if one of the WASD keys is pressed, we call the corresponding method of the Camera class
 void apply_camera_movements();
@@ -120,7 +129,7 @@ void AubioReset(bool fftcheck);
 // Setup aubio for spectrum analysis using FFT and Tempo detection
 void AubioInitialize(string musicPath);
 // Compute and extract Fast Fourier Transform and detect Tempo
-void AubioCompute(GLfloat deltaTime, PowerUp pwUps[]);
+void AubioCompute(GLfloat deltaTime, Simulation &simulation);
 // Merge the win_s/2 frequency bands into 8 frequency bands
 void MergeFrequencyBands();
 // Frequency bands normalization leading to a better manipulation inside the vertex shader
@@ -129,8 +138,23 @@ void FrequencyBandsNormalize();
 void CreateBandsBuffer();
 // Stop all the current audio reproductions and start a new one
 void PlayMusic(string musicPath);
-// Collision check AABB - Sphere
-bool CheckCollision(PowerUp pwUp, Car car);
+// Restart the audio analysis and the reproduction with a track (the current one, to restart it). The change is recorded in the session
+void ChangeMusic(string path);
+// Run only the audio analysis and the gameplay simulation (no window, no OpenGL) and print the results
+int SimulationSpeedRun(GLfloat seconds, JobSystem &jobs);
+// Timing of the powerup and palm update kernels (SSE2 and scalar) and of the collision test (linear scan and broadphase) on 100, 10k and 1M entities
+int EntityBenchmark(JobSystem &jobs);
+// Planes of the view frustum (normals towards the inside), and test of a bounding sphere against them
+void FrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6]);
+bool SphereInFrustum(const glm::vec4 planes[6], const glm::vec3 &center, GLfloat radius);
+// 3D lookup table of the color grading of the post-processing stack
+GLuint CreateGradingLUT(GLint size);
+// Set the uniforms shared by all the grid shaders (matrices, music, displacement and lighting)
+void SetGridUniforms(Shader &shader, glm::mat4 &projection, glm::mat4 &view);
+// Side-by-side timing of the grid vertex stage, with per-vertex fbm and with the baked noise texture
+void GridNoiseBenchmark(Shader &gridShader, GridNoise &gridNoise, glm::mat4 projection, glm::mat4 view);
+// time used for animations and gameplay: wall clock, or simulated time in benchmark mode
+double AppTime();
 
 // we initialize an array of booleans for each keybord key
 bool keys[1024];
@@ -154,7 +178,8 @@ GLboolean mouseEnabled = GL_TRUE;
 GLboolean freeCamera = GL_FALSE;
 
 // a vector for all the Shader Programs used in the application
-vector<Shader> shaders;
+// N.B.) pointers, because the programs can be replaced by the hot reload
+vector<Shader*> shaders;
 
 // Uniforms to be passed to shaders
 GLfloat sunAnimationSpeed = 3.0f;
@@ -169,6 +194,15 @@ GLfloat palmOutline[] = {0.0f, 1.0f, 1.0f};
 GLfloat carOutline[] = {0.0f, 1.0f, 1.0f};
 glm::vec3 pwUpOutline;
 GLint blink = 0;
+// fixed rate of the gameplay simulation (steps per second)
+GLfloat simulationRate = 120.0f;
+// speed run of the simulation only (--simulate <seconds>)
+GLfloat simulateSeconds = 0.0f;
+// benchmark of the entity update kernels (--entity-benchmark)
+bool entityBenchmark = false;
+// worker threads of the job system (--jobs <n>, 0 = one for each hardware thread except the main one), and their activity in the last frame
+GLuint jobWorkers = 0;
+vector<JobWorkerStats> jobWorkerStats;
 // uniforms for light calculations
 GLfloat diffuseColor[] = {1.0f, 0.17, 0.6};
 GLfloat specularColor[] = {0.0f, 1.0f, 1.0f};
@@ -186,7 +220,6 @@ GLfloat quadratic = 0.00f;
 GLfloat shininess = 25.0f;
 
 // Variables
-bool once = true;
 string musicPath = "../../../Music/SneakyDriver_KatanaZeroOST.wav";
 string speedUpSFX = "../../../SFX/speedUpSFX.wav";
 string speedDownSFX = "../../../SFX/speedDownSFX.wav";
@@ -194,16 +227,93 @@ GLfloat bufferDecreaseAmount = 0.00005f;
 GLfloat sunPosition[] = {0.0f, 23.0f, -100.0f};
 glm::vec3 lightPosition = glm::vec3(sunPosition[0], sunPosition[1], sunPosition[2]);
 GLfloat carXPos = 0.0f;
-GLfloat carTurnAngle = 0.0f;
 GLfloat streetBorder = (streetSize*100.0f) / 2.0f;
-GLfloat blinkStart;
-GLfloat blinkDuration = 0.8f;
-GLuint tempoSpawn = 0;
 GLuint pwAmount = 100;
+GLuint palmAmount = 20;
+GLfloat sphereScale = 0.3f;
+GLfloat carScale = 0.6f;
+// grid benchmark requested from the GUI, and its results (one line for each grid density)
+bool runGridBenchmark = false;
+vector<string> gridBenchmarkResults;
+// the grid is drawn as a stream of chunks (Terrain class), or as two copies of the OBJ grid
+bool chunkedTerrain = true;
+GLfloat terrainHorizon = 100.0f;
+GLuint terrainActiveChunks = 0, terrainPoolSize = 0;
+// low resolution height strip read back from the captured terrain, the car can follow it
+GLuint terrainStripSamples = 25;
+bool carFollowsTerrain = false;
+// powerups drawn with the old geometry shader path (powerUp.geom for all the spheres, explosions included), for comparison (--powerup-gs)
+bool powerUpGeometryShader = false;
+// particles of each explosion
+GLuint explosionParticles = 64;
+// shader permutations (see ShaderDefines): quality level of the lighting (--shader-quality <0-2>), and debug view of the frequency band zones on the grid
+GLint shaderQuality = 2;
+bool showFrequencyBands = false;
+// GPU time of each section of the rendering loop, shown in the "GPU Profiler" window
+GPUProfiler gpuProfiler;
+bool showGPUProfiler = false;
+// passes of the render graph executed in the last frame (the disabled ones are skipped), and framebuffers of its transient targets
+GLuint renderGraphPasses = 0, renderGraphExecuted = 0, renderGraphFramebuffers = 0;
+// meshes of the models in the geometry arena (before and after the merge by material)
+GLuint arenaSubmeshes = 0, arenaMeshes = 0;
+bool arenaMultiDraw = false;
+// state of the stream buffer in the last frame: persistent mapping or not, bytes written, frames waiting for the GPU, allocations not satisfied
+bool streamPersistent = false;
+GLuint streamUsed = 0, streamStalls = 0, streamOverflows = 0;
+// render statistics of the last complete frame, shown under the FPS
+RenderStats lastRenderStats;
+// the scene is rendered in a HDR target (RGBA16F) with hdrSamples MSAA samples (--msaa <samples>, 1 for none), then resolved, bloomed and post-processed to the window
+GLint hdrSamples = 4;
+GLfloat exposure = 1.0f;
+// bloom (see Bloom class): resolution divisor of the first level, levels of the chain, taps of the filters (4 or 8), threshold and intensity
+GLint bloomDivisor = 4;
+GLint bloomLevels = 5;
+bool bloomFullTaps = false;
+GLfloat bloomThreshold = 1.0f;
+GLfloat bloomKnee = 0.5f;
+GLfloat bloomIntensity = 0.6f;
+// the outlines are emissive, so that they glow through the bloom
+GLfloat outlineEmission = 3.0f;
+// effects of the post-processing stack (see PostStack class), applied in a single pass, and their parameters
+bool postAberration = true, postTonemap = true, postGrading = true, postVignette = true, postScanlines = true, postGrain = true;
+GLfloat aberration = 0.004f;
+GLfloat gradingStrength = 1.0f;
+GLfloat vignetteAmount = 0.5f, vignetteSoftness = 0.6f;
+GLfloat scanlineAmount = 0.12f;
+GLfloat grainAmount = 0.05f;
+// permutations of the post-processing uber shader compiled so far
+GLuint postPermutations = 0;
+string gpuProfilerCSV = "gpu_profile.csv";
+// the last cpuTraceSeconds of CPU zones are written in cpuTracePath when F9 is pressed (or at exit, with --cpu-trace <seconds>)
+bool dumpCPUTrace = false;
+bool dumpCPUTraceOnExit = false;
+GLfloat cpuTraceSeconds = 10.0f;
+string cpuTracePath = "cpu_trace.json";
+// headless benchmark (--benchmark <frames>): offscreen rendering, fixed timestep and seed, audio analyzed from file only, scripted car and camera
+bool benchmarkMode = false;
+GLuint benchmarkFrames = 1000;
+GLuint benchmarkFrame = 0;
+GLfloat benchmarkTimestep = 1.0f / 60.0f;
+GLint benchmarkWidth = 1920, benchmarkHeight = 1080;
+string benchmarkCSV = "benchmark.csv";
+bool benchmarkOSMesa = false;
+// seed of the simulation random generator (--seed <n>), fixed in benchmark mode
+unsigned int randomSeed = 0;
+bool fixedSeed = false;
+// the gameplay inputs can be recorded (--record <file>) and replayed (--replay <file>) to rerun a session exactly
+InputRecorder inputRecorder;
+InputReplayer inputReplayer;
+bool replayMode = false;
+string recordPath = "";
+// the shaders are read (and watched by the hot reload) in the project directory, the parent of the working directory ./Debug (--shader-root <dir>):
+// the files missing there are read from the working directory, where the post build step copies them
+string shaderRoot = "../";
 
 // texture unit for the cube map
 GLuint textureCube;
 
+// number of frequency bands (the spectrum is split in octaves, see MergeFrequencyBands): the grid shaders are compiled for this count (BAND_COUNT)
+const GLint frequencyBandCount = 8;
 // vector to store the frequency bands extracted by FFTCompute
 vector<float> frequencyBands;
 // vector used as Buffer in order to smooth the descending vertex displacement. We avoid the unnecessary flicker of the audio reactive grid.
@@ -213,11 +323,99 @@ vector<float> bufferDecrease;
 irrklang::ISoundEngine* soundEngine = irrklang::createIrrKlangDevice();
 
 /////////////////// MAIN function ///////////////////////
-int main()
+int main(int argc, char* argv[])
 {
-	srand(glfwGetTime());
+	// command line options
+	for(int i = 1; i < argc; i++){
+		string arg = argv[i];
+		if(arg == "--cpu-trace" && i + 1 < argc){
+			cpuTraceSeconds = atof(argv[++i]);
+			dumpCPUTraceOnExit = true;
+		}
+		else if(arg == "--benchmark" && i + 1 < argc){
+			benchmarkMode = true;
+			benchmarkFrames = atoi(argv[++i]);
+			fixedSeed = true;
+		}
+		else if(arg == "--audio" && i + 1 < argc)
+			musicPath = argv[++i];
+		else if(arg == "--seed" && i + 1 < argc){
+			randomSeed = atoi(argv[++i]);
+			fixedSeed = true;
+		}
+		else if(arg == "--timestep" && i + 1 < argc)
+			benchmarkTimestep = atof(argv[++i]);
+		else if(arg == "--size" && i + 2 < argc){
+			benchmarkWidth = atoi(argv[++i]);
+			benchmarkHeight = atoi(argv[++i]);
+		}
+		else if(arg == "--csv" && i + 1 < argc)
+			benchmarkCSV = argv[++i];
+		else if(arg == "--osmesa")
+			benchmarkOSMesa = true;
+		else if(arg == "--powerup-gs")
+			powerUpGeometryShader = true;
+		else if(arg == "--shader-quality" && i + 1 < argc)
+			shaderQuality = glm::clamp(atoi(argv[++i]), 0, 2);
+		else if(arg == "--msaa" && i + 1 < argc)
+			hdrSamples = glm::max(atoi(argv[++i]), 1);
+		else if(arg == "--simulate" && i + 1 < argc)
+			simulateSeconds = atof(argv[++i]);
+		else if(arg == "--entity-benchmark")
+			entityBenchmark = true;
+		else if(arg == "--jobs" && i + 1 < argc)
+			jobWorkers = atoi(argv[++i]);
+		else if(arg == "--simulation-rate" && i + 1 < argc)
+			simulationRate = atof(argv[++i]);
+		else if(arg == "--record" && i + 1 < argc)
+			recordPath = argv[++i];
+		else if(arg == "--shader-root" && i + 1 < argc)
+			shaderRoot = argv[++i];
+		else if(arg == "--replay" && i + 1 < argc){
+			if(!inputReplayer.Load(argv[++i]))
+				return -1;
+			replayMode = true;
+		}
+		else
+			std::cout << "Unknown option: " << arg << std::endl;
+	}
 	
-	if (!soundEngine)
+	// a replay uses seed, simulation rate and music track of the recorded session
+	if(replayMode){
+		randomSeed = inputReplayer.header.seed;
+		fixedSeed = true;
+		simulationRate = inputReplayer.header.simulationRate;
+		musicPath = inputReplayer.header.trackPath;
+		if(HashFile(musicPath) != inputReplayer.header.trackHash)
+			std::cout << "WARNING: " << musicPath << " is not the track of the recorded session" << std::endl;
+	}
+	if(!fixedSeed)
+		randomSeed = (unsigned int)time(NULL);
+	if(recordPath != ""){
+		ReplayHeader header;
+		header.seed = randomSeed;
+		header.simulationRate = simulationRate;
+		header.trackPath = musicPath;
+		header.trackHash = HashFile(musicPath);
+		inputRecorder.Open(recordPath, header);
+	}
+	
+	// the workers are shared by audio analysis, simulation, matrices, culling and loading
+	JobSystem jobs(jobWorkers);
+	
+	// kernels only, without window and OpenGL context
+	if(entityBenchmark)
+		return EntityBenchmark(jobs);
+	// gameplay only, without window and OpenGL context
+	if(simulateSeconds > 0.0f)
+		return SimulationSpeedRun(simulateSeconds, jobs);
+	
+	// the benchmark analyzes the audio file with Aubio, but it does not play it
+	if(benchmarkMode && soundEngine){
+		soundEngine->drop();
+		soundEngine = NULL;
+	}
+	if (!soundEngine && !benchmarkMode)
 	{
 		std::cout << "Could not startup the audio engine." << std::endl;
 		return 0; // error starting up the engine
@@ -237,19 +435,47 @@ int main()
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     // we set if the window is resizable
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-	// Antialiasing samples
-	glfwWindowHint(GLFW_SAMPLES, 4);
-
-	GLFWmonitor* monitor = glfwGetPrimaryMonitor();
-	const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-	 
-	glfwWindowHint(GLFW_RED_BITS, mode->redBits);
-	glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
-	glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
-	glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
-	// we create the application's window
-	GLFWwindow* window = glfwCreateWindow(mode->width, mode->height, "Retrowave", monitor, NULL);
-    //GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Retrowave", nullptr, nullptr);
+	// N.B.) no antialiasing samples for the window: the scene is rendered in a multisampled HDR target (see hdrSamples), and only the tonemapped result and the GUI are drawn in the window
+
+	GLFWwindow* window;
+	if(benchmarkMode){
+		// the window is never shown: frames are rendered in an offscreen framebuffer.
+		// On Linux the context is created through EGL (or OSMesa, if supported by GLFW), so software renderers like llvmpipe can be used without a display.
+		// Elsewhere (e.g. Windows, where there is no EGL) the native context API is used
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		int contextAPI = GLFW_NATIVE_CONTEXT_API;
+#ifdef __linux__
+		contextAPI = GLFW_EGL_CONTEXT_API;
+#endif
+#ifdef GLFW_OSMESA_CONTEXT_API
+		if(benchmarkOSMesa)
+			contextAPI = GLFW_OSMESA_CONTEXT_API;
+#else
+		if(benchmarkOSMesa)
+			std::cout << "OSMesa contexts need GLFW 3.3, --osmesa is ignored" << std::endl;
+#endif
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextAPI);
+		window = glfwCreateWindow(benchmarkWidth, benchmarkHeight, "Retrowave benchmark", nullptr, nullptr);
+		// the EGL (or OSMesa) context is not available: we retry with the native context API
+		if(!window && contextAPI != GLFW_NATIVE_CONTEXT_API)
+		{
+			std::cout << "Failed to create the offscreen context, retrying with the native context API" << std::endl;
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+			window = glfwCreateWindow(benchmarkWidth, benchmarkHeight, "Retrowave benchmark", nullptr, nullptr);
+		}
+	}
+	else{
+		GLFWmonitor* monitor = glfwGetPrimaryMonitor();
+		const GLFWvidmode* mode = glfwGetVideoMode(monitor);
+		 
+		glfwWindowHint(GLFW_RED_BITS, mode->redBits);
+		glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
+		glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
+		glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+		// we create the application's window
+		window = glfwCreateWindow(mode->width, mode->height, "Retrowave", monitor, NULL);
+		//GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Retrowave", nullptr, nullptr);
+	}
     if (!window)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -276,16 +502,25 @@ int main()
     GLint width, height;
     glfwGetFramebufferSize(window, &width, &height);
     glViewport(0, 0, width, height);
+	
+	// in benchmark mode, all the frames are rendered in this framebuffer
+	OffscreenTarget* offscreen = NULL;
+	BenchmarkLog benchmarkLog(benchmarkMode ? benchmarkFrames : 0);
+	if(benchmarkMode){
+		offscreen = new OffscreenTarget(benchmarkWidth, benchmarkHeight);
+		// the GPU times of all the frames are kept, to be written in the CSV
+		gpuProfiler.historySize = benchmarkFrames + GPU_PROFILER_FRAMES;
+	}
 
     // we enable Z test
-    glEnable(GL_DEPTH_TEST);
+    glState.Enable(GL_DEPTH_TEST);
 	// MSAA Enable
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_BLEND);
-	glEnable(GL_STENCIL_TEST);
-	glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glState.Enable(GL_MULTISAMPLE);
+	glState.Enable(GL_BLEND);
+	glState.Enable(GL_STENCIL_TEST);
+	glState.StencilFunc(GL_ALWAYS, 1, 0xFF);
+    glState.StencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	glState.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     //the "clear" color for the frame buffer
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -299,33 +534,173 @@ int main()
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 150");
 
-	Shader grid_shader("FFTDisplacement.vert", "neonGrid.frag");
-	shaders.push_back(grid_shader);
-	Shader sun_shader("retrosun.vert", "retrosunSphere.frag");
-	shaders.push_back(sun_shader);
-	Shader skybox_shader("20_skybox.vert", "20_skybox.frag");
-	shaders.push_back(skybox_shader);
-	Shader qSun_shader("retrosun.vert", "retrosunQuad.frag");
-	shaders.push_back(qSun_shader);
-	Shader palm_shader("palm.vert", "palm.frag");
-	shaders.push_back(palm_shader);
-	Shader full_color("outline.vert", "outline.frag");
-	shaders.push_back(full_color);
-	Shader car_shader("13_phong.vert", "carGGX.frag");
-	shaders.push_back(car_shader);
-	Shader pwUp_shader("powerUp.vert", "../powerUp.geom", "powerUp.frag");
-	shaders.push_back(pwUp_shader);
-	
-	// we load the cube map (we pass the path to the folder containing the 6 views)
+	// programs are loaded from the binary cache, or compiled by the driver while the models are loaded (see ShaderCache::Finish below)
+	ShaderCache shaderCache("shader_cache");
+	shaderCache.SetSourceRoot(shaderRoot);
+	if(glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+		shaderCache.EnableParallelCompile((PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+	else if(glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+		shaderCache.EnableParallelCompile((PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+	// the shader files are watched: a changed program is compiled again and replaced, without restarting the application
+	ShaderHotReload shaderReload(shaderCache);
+	
+	// permutations of the shaders: the shared GLSL files are included, and the features are selected with defines
+	ShaderDefines gridDefines;
+	gridDefines.Set("BAND_COUNT", frequencyBandCount).Set("QUALITY", shaderQuality).Set("SHOW_BANDS", 0);
+	ShaderDefines gridBandsDefines = gridDefines;
+	gridBandsDefines.Set("SHOW_BANDS", 1);
+	ShaderDefines qualityDefines;
+	qualityDefines.Set("QUALITY", shaderQuality);
+	ShaderDefines palmDefines;
+	palmDefines.Set("INSTANCING", 1);
+	ShaderDefines instancingDefines;
+	instancingDefines.Set("INSTANCING", 1);
+	ShaderDefines bloomDefines[2];
+	bloomDefines[0].Set("TAPS", 4);
+	bloomDefines[1].Set("TAPS", 8);
+	
+	Shader grid_shader = shaderCache.Load("FFTDisplacement.vert", "neonGrid.frag", gridDefines);
+	shaders.push_back(&grid_shader);
+	shaderReload.Watch(grid_shader, "FFTDisplacement.vert", "neonGrid.frag", gridDefines);
+	Shader gridBands_shader = shaderCache.Load("FFTDisplacement.vert", "neonGrid.frag", gridBandsDefines);
+	shaders.push_back(&gridBands_shader);
+	shaderReload.Watch(gridBands_shader, "FFTDisplacement.vert", "neonGrid.frag", gridBandsDefines);
+	Shader sun_shader = shaderCache.Load("retrosun.vert", "retrosunSphere.frag");
+	shaders.push_back(&sun_shader);
+	shaderReload.Watch(sun_shader, "retrosun.vert", "retrosunSphere.frag");
+	Shader skybox_shader = shaderCache.Load("20_skybox.vert", "20_skybox.frag");
+	shaders.push_back(&skybox_shader);
+	shaderReload.Watch(skybox_shader, "20_skybox.vert", "20_skybox.frag");
+	Shader qSun_shader = shaderCache.Load("retrosun.vert", "retrosunQuad.frag");
+	shaders.push_back(&qSun_shader);
+	shaderReload.Watch(qSun_shader, "retrosun.vert", "retrosunQuad.frag");
+	Shader palm_shader = shaderCache.Load("palm.vert", "palm.frag", palmDefines);
+	shaders.push_back(&palm_shader);
+	shaderReload.Watch(palm_shader, "palm.vert", "palm.frag", palmDefines);
+	Shader full_color = shaderCache.Load("outline.vert", "outline.frag");
+	shaders.push_back(&full_color);
+	shaderReload.Watch(full_color, "outline.vert", "outline.frag");
+	// outlines of the palms, in a single instanced draw
+	Shader full_color_instanced = shaderCache.Load("outline.vert", "outline.frag", instancingDefines);
+	shaders.push_back(&full_color_instanced);
+	shaderReload.Watch(full_color_instanced, "outline.vert", "outline.frag", instancingDefines);
+	Shader car_shader = shaderCache.Load("13_phong.vert", "carGGX.frag", qualityDefines);
+	shaders.push_back(&car_shader);
+	shaderReload.Watch(car_shader, "13_phong.vert", "carGGX.frag", qualityDefines);
+	Shader pwUp_shader = shaderCache.Load("powerUp.vert", "../powerUp.geom", "powerUp.frag");
+	shaders.push_back(&pwUp_shader);
+	shaderReload.Watch(pwUp_shader, "powerUp.vert", "../powerUp.geom", "powerUp.frag");
+	// powerups not hit by the car do not need the geometry shader, and the explosions are particles
+	Shader pwUpIdle_shader = shaderCache.Load("powerUpIdle.vert", "powerUp.frag");
+	shaders.push_back(&pwUpIdle_shader);
+	shaderReload.Watch(pwUpIdle_shader, "powerUpIdle.vert", "powerUp.frag");
+	Shader explosion_shader = shaderCache.Load("explosion.vert", "explosion.frag");
+	shaders.push_back(&explosion_shader);
+	shaderReload.Watch(explosion_shader, "explosion.vert", "explosion.frag");
+	// post-processing: bloom (4 and 8 taps permutations), and the effects of the uber shader
+	Shader bloomDown4_shader = shaderCache.Load("fullscreen.vert", "bloomDown.frag", bloomDefines[0]);
+	shaders.push_back(&bloomDown4_shader);
+	shaderReload.Watch(bloomDown4_shader, "fullscreen.vert", "bloomDown.frag", bloomDefines[0]);
+	Shader bloomDown8_shader = shaderCache.Load("fullscreen.vert", "bloomDown.frag", bloomDefines[1]);
+	shaders.push_back(&bloomDown8_shader);
+	shaderReload.Watch(bloomDown8_shader, "fullscreen.vert", "bloomDown.frag", bloomDefines[1]);
+	Shader bloomUp4_shader = shaderCache.Load("fullscreen.vert", "bloomUp.frag", bloomDefines[0]);
+	shaders.push_back(&bloomUp4_shader);
+	shaderReload.Watch(bloomUp4_shader, "fullscreen.vert", "bloomUp.frag", bloomDefines[0]);
+	Shader bloomUp8_shader = shaderCache.Load("fullscreen.vert", "bloomUp.frag", bloomDefines[1]);
+	shaders.push_back(&bloomUp8_shader);
+	shaderReload.Watch(bloomUp8_shader, "fullscreen.vert", "bloomUp.frag", bloomDefines[1]);
+	GLuint gradingLUT = CreateGradingLUT(16);
+	// the effects are applied in this order (inside their stage, see post.frag)
+	PostStack postStack(shaderCache, shaderReload, "fullscreen.vert", "post.frag");
+	postStack.Add("Chromatic Aberration", "POST_CHROMATIC_ABERRATION", POST_STAGE_FETCH, "ChromaticAberration(uv)", postAberration, [&](Shader &s){
+		s.Uniform1f("aberration", aberration);
+	});
+	postStack.Add("Tonemapping", "POST_TONEMAP", POST_STAGE_HDR, "color = Tonemap(color);", postTonemap, [&](Shader &s){
+		s.Uniform1f("exposure", exposure);
+	});
+	postStack.Add("Color Grading", "POST_COLOR_GRADING", POST_STAGE_LDR, "color = ColorGrading(color);", postGrading, [&](Shader &s){
+		glState.ActiveTexture(GL_TEXTURE2);
+		glState.BindTexture(GL_TEXTURE_3D, gradingLUT);
+		s.Uniform1i("gradingLUT", 2);
+		s.Uniform1f("gradingStrength", gradingStrength);
+	});
+	postStack.Add("Vignette", "POST_VIGNETTE", POST_STAGE_LDR, "color = Vignette(color, uv);", postVignette, [&](Shader &s){
+		s.Uniform1f("vignetteAmount", vignetteAmount);
+		s.Uniform1f("vignetteSoftness", vignetteSoftness);
+	});
+	postStack.Add("Scanlines", "POST_SCANLINES", POST_STAGE_LDR, "color = Scanlines(color, uv);", postScanlines, [&](Shader &s){
+		s.Uniform1f("scanlineAmount", scanlineAmount);
+		// a dark line every 3 pixels of the frame
+		s.Uniform1f("scanlineCount", (offscreen ? offscreen->height : height) / 3.0f);
+	});
+	postStack.Add("Film Grain", "POST_FILM_GRAIN", POST_STAGE_LDR, "color = FilmGrain(color, uv);", postGrain, [&](Shader &s){
+		s.Uniform1f("grainAmount", grainAmount);
+		s.Uniform1f("grainTime", (GLfloat)AppTime());
+	});
+	postStack.Load();
+	
+	// the grid update pass captures the displaced terrain with Transform Feedback, then terrain_shader draws the captured vertices
+	vector<const GLchar*> terrainCapturedOutputs = {"worldPosition", "worldNormal", "gridUV"};
+	Shader terrainUpdate_shader = shaderCache.Load("terrainUpdate.vert", terrainCapturedOutputs, gridDefines);
+	shaders.push_back(&terrainUpdate_shader);
+	shaderReload.Watch(terrainUpdate_shader, "terrainUpdate.vert", terrainCapturedOutputs, gridDefines);
+	Shader terrain_shader = shaderCache.Load("terrainRender.vert", "neonGrid.frag", gridDefines);
+	shaders.push_back(&terrain_shader);
+	shaderReload.Watch(terrain_shader, "terrainRender.vert", "neonGrid.frag", gridDefines);
+	Shader terrainBands_shader = shaderCache.Load("terrainRender.vert", "neonGrid.frag", gridBandsDefines);
+	shaders.push_back(&terrainBands_shader);
+	shaderReload.Watch(terrainBands_shader, "terrainRender.vert", "neonGrid.frag", gridBandsDefines);
+	
+	// the fbm noise of the grid is baked in a texture, and regenerated only when the noise zoom changes
+	GridNoise gridNoise;
+	// the chunks of the infinite grid bake their noise once, when they are spawned
+	Terrain terrain(gridNoise);
+	
+    // we load the model(s) (code of Model class is in include/utils/model_v2.h)
+	// the files are parsed and the textures decoded by the workers, then the main thread creates the OpenGL buffers and textures
+	CPU_ZONE_BEGIN("Model loading");
+	Model sphereModel, skyboxModel, gridModel, quadModel, palmModel, carModel;
+	Model* models[] = {&sphereModel, &skyboxModel, &gridModel, &quadModel, &palmModel, &carModel};
+	const char* modelPaths[] = {"../../../models/sphere.obj", "../../../models/flippedCube.obj", "../../../models/grid500m100x100.obj",
+		"../../../models/myPlane.obj", "../../../models/palm.obj", "../../../models/Countach.obj"};
+	GLuint modelCount = sizeof(models) / sizeof(models[0]);
+	JobHandle modelsDecoded = jobs.ParallelFor("Model decoding", modelCount, 1, [&](GLuint first, GLuint last){
+		for(GLuint m = first; m < last; m++)
+			models[m]->Load(modelPaths[m]);
+	});
+	// all the meshes (merged by material at loading) are stored in the buffers of a single arena (code of GeometryArena class is in include/utils/geometry_arena.h)
+	GeometryArena geometryArena;
+	if((GLVersion.major == 4 && GLVersion.minor >= 3) || GLVersion.major > 4 || glfwExtensionSupported("GL_ARB_multi_draw_indirect"))
+		geometryArena.EnableMultiDrawIndirect((PFNGLMULTIDRAWELEMENTSINDIRECTPROC)glfwGetProcAddress("glMultiDrawElementsIndirect"));
+	JobHandle modelsUploaded = jobs.RunOnMain("Model upload", [&](){
+		for(GLuint m = 0; m < modelCount; m++)
+			models[m]->Upload(&geometryArena);
+		geometryArena.Upload();
+		for(GLuint m = 0; m < modelCount; m++){
+			arenaSubmeshes += models[m]->submeshes;
+			arenaMeshes += models[m]->meshes.size();
+		}
+	}, {modelsDecoded});
+	
+	// meanwhile, we load the cube map (we pass the path to the folder containing the 6 views)
     textureCube = LoadTextureCube("../../../textures/cube/Purple/");
+	// dynamic data of the frames: with GL_ARB_buffer_storage the buffer is mapped once (persistent mapping), otherwise the region of each frame is mapped without synchronization
+	PFNGLBUFFERSTORAGEPROC bufferStorage = NULL;
+	if(glfwExtensionSupported("GL_ARB_buffer_storage"))
+		bufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+	StreamBuffer streamBuffer(1 << 20, bufferStorage);
+	streamPersistent = streamBuffer.persistent;
+	// explosions of the hit powerups (at most one for each powerup), written in the stream buffer
+	ExplosionParticles explosions(explosionParticles, pwAmount, streamBuffer);
+	jobs.Wait(modelsUploaded);
+	arenaMultiDraw = geometryArena.multiDrawIndirect;
+	CPU_ZONE_END();
 	
-    // we load the model(s) (code of Model class is in include/utils/model_v1.h)
-    Model sphereModel("../../../models/sphere.obj");
-	Model skyboxModel("../../../models/flippedCube.obj");
-	Model gridModel("../../../models/grid500m100x100.obj");
-	Model quadModel("../../../models/myPlane.obj");
-	Model palmModel("../../../models/palm.obj");
-	Model carModel("../../../models/Countach.obj");
+	// we wait for the shaders still compiling, and we store the new binaries in the cache
+	CPU_ZONE_BEGIN("Shader linking");
+	shaderCache.Finish();
+	CPU_ZONE_END();
 
     // we set projection and view matrices
     // N.B.) in this case, the camera is fixed -> we set it up outside the rendering loop
@@ -335,116 +710,96 @@ int main()
     glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 25.0f), glm::vec3(0.0f, 0.0f, -7.0f), glm::vec3(0.0f, 1.0f, 7.0f));
 	
 	// start music reproduction and processing
-	musicStartTime = glfwGetTime();
+	musicStartTime = AppTime();
 	AubioInitialize(musicPath);
-	soundEngine->play2D(musicPath.c_str(), true);
+	if(soundEngine)
+		soundEngine->play2D(musicPath.c_str(), true);
 	
-	// Palms parameters initialization
-	GLfloat palmStartingZ = -75.0f;
-	GLuint palmAmount = 20;
-	GLfloat zOffset = 100.0f / (float)palmAmount;
-	GLfloat palmZPositions[palmAmount];
-	for(int i = 0; i < palmAmount; i++){
-		palmZPositions[i] = palmStartingZ + zOffset * i;
-		palmZPositions[i+1] = palmStartingZ + zOffset * i;
-		i++;
-	}
+	// palms, powerups and car are updated by the simulation at a fixed rate, and rendered interpolating its last two states
+	Simulation simulation(palmAmount, pwAmount, sphereScale, carScale, gridScrollSpeed, streetBorder, simulationRate, randomSeed);
+	simulation.jobs = &jobs;
+	Car countach;
 	
-	// Powerup parameters
-	PowerUp powerUps[pwAmount];
-	GLint respawnThreshold = 30;
-	GLfloat sphereScale = 0.3f;
-	GLfloat pwUpStartingZ = -70.0f;
-	GLfloat minOutlineScale = 1.05f;
-	GLfloat maxOutlineScale = 5.0f;
-	GLint randomZSpawnOffset = 31;
-	// powerups initialization
-	for(int i = 0; i < pwAmount; i++){
-		powerUps[i].position = glm::vec3(0.0f, 0.0f, pwUpStartingZ);
-		powerUps[i].radius = sphereScale;
-		if(i % 2 == 0)
-			powerUps[i].speedUp = true;
-		else
-			powerUps[i].speedUp = false;
-		powerUps[i].explodeValue = 0;
-		powerUps[i].hit = false;
-		powerUps[i].explosionStartTime = 0.0f;
-		powerUps[i].spawned = false;
-		powerUps[i].spawning = true;
-		powerUps[i].spawningOutlineScale = maxOutlineScale;
-	}
+	// state of the frame used by the passes (set in the rendering loop)
+	GLfloat alpha = 0.0f, simulationTime = 0.0f, carTurnAngle = 0.0f;
+	// transforms of palms, powerups and car (and of their outlines), as translation, rotation and scale (code of TransformStore class is in include/utils/transforms.h)
+	TransformStore palms(palmAmount), palmOutlines(palmAmount);
+	TransformStore pwUps(pwAmount), pwUpOutlines(pwAmount);
+	TransformStore carTransforms(2);
+	// the visible palms are drawn with instancing: their model-view and normal matrices are written in the stream buffer
+	TransformStore visiblePalms, visiblePalmOutlines;
+	StreamAllocation palmInstances, palmOutlineInstances;
+	vector<glm::mat4> pwUpModelMatrices(pwAmount), pwUpOutlineMatrices(pwAmount);
+	// car and its outline
+	glm::mat4 carMatrices[2];
+	TransformInstance carInstances[2];
+	// visibility of palms and powerups, computed by the workers (bytes, so that separate elements can be written by different threads)
+	vector<GLubyte> palmVisible(palmAmount), pwUpVisible(pwAmount);
+	glm::vec4 frustum[6];
+	// bounding spheres: the outline of the palms is moved down and enlarged (see the OUTLINES pass)
+	GLfloat palmRadius = (palmModel.radius + 2.0f) * 1.1f * 0.15f;
+	GLfloat sphereRadius = sphereModel.radius * sphereScale;
 	
-	Car countach;
-	GLfloat carScale = 0.6f;
-	countach.position = glm::vec3(0.0f, 0.0f, 19.0f);
-	countach.size = glm::vec3(1.4f * carScale, 1.2f * carScale, 4.3f * carScale);
+	// the frame is described as a graph of passes (code of RenderGraph class is in include/utils/render_graph.h):
+	// each pass declares the target it writes and its depth, stencil and blending state, and the graph sets them before calling the pass
+	RenderGraph graph(gpuProfiler);
+	GLint frameWidth = offscreen ? offscreen->width : width;
+	GLint frameHeight = offscreen ? offscreen->height : height;
+	// the window is completely covered by the post-processing pass: it is not cleared
+	GLuint screen = graph.ImportTarget("screen", offscreen ? offscreen->FBO : 0, frameWidth, frameHeight, 0);
+	// the scene is drawn in a HDR target: with MSAA, in a multisampled one, resolved in hdrScene by the RESOLVE pass
+	GLbitfield sceneClear = GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+	GLuint hdrScene = graph.CreateTarget("hdrScene", RenderTargetDesc(frameWidth, frameHeight, GL_RGBA16F, hdrSamples == 1), hdrSamples == 1 ? sceneClear : 0);
+	GLuint sceneTarget = hdrSamples == 1 ? hdrScene : graph.CreateTarget("hdrSceneMSAA", RenderTargetDesc(frameWidth, frameHeight, GL_RGBA16F, true, hdrSamples), sceneClear);
+	// the outlined objects write 1 in the stencil buffer, and the outlines are drawn only where the stencil is not 1
+	RenderState stencilWriteState;
+	stencilWriteState.stencilWriteMask = 0xFF;
+	RenderState outlineState;
+	outlineState.stencilFunc = GL_NOTEQUAL;
+	// the skybox is at the maximum depth (see the SKYBOX pass)
+	RenderState skyboxState;
+	skyboxState.depthFunc = GL_LEQUAL;
 	
-	// Rendering loop: this code is executed at each frame
-    while(!glfwWindowShouldClose(window))
-    {
-        // we determine the time passed from the beginning
-        // and we calculate time difference between current frame rendering and the previous one
-        GLfloat currentFrame = glfwGetTime() - musicStartTime;
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
-
-		AubioCompute(deltaTime, powerUps);
+	///////////////////// NEONGRID /////////////////////
+	// the chunked terrain and the OBJ grid are alternative passes: only one of them is enabled
+	GLuint terrainPass = graph.AddPass("NEONGRID", [&](){
+		// chunks move at the same speed of palms and powerups
+		terrain.horizon = terrainHorizon;
+		terrain.Update(gridScrollSpeed * 0.505f * deltaTime, gridNoiseZoom, camera.Position.z);
+		terrainActiveChunks = terrain.ActiveChunks();
+		terrainPoolSize = terrain.PoolSize();
 		
-		// Draw the GUI through ImGui
-		DrawGUI();
-
-        // Check is an I/O event is happening
-        glfwPollEvents();
-		// we apply FPS camera movements
-		if(freeCamera){
-			apply_camera_movements();
-			// View matrix (=camera): position, view direction, camera "up" vector
-			glm::mat4 view = camera.GetViewMatrix();
-		}
-		// we "clear" frame, z and stencil buffers
-		glStencilMask(~0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-        // we set the rendering mode
-        if (wireframe)
-            // Draw in wireframe
-            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-        else
-            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		
-		// we activate the cube map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureCube);
-		
-		// We disable the stencil writing, we just need it for the palms' neon effect
-		glStencilMask(0x00);
+		// grid update pass: displaced positions and normals are computed once per frame
+		terrainUpdate_shader.Use();
+		SetGridUniforms(terrainUpdate_shader, projection, view);
+		// the band zones are placed as on the first OBJ grid (V = 0 at z = -25, V = 1 at z = 25)
+		terrainUpdate_shader.Uniform1f("bandLength", 50.0f);
+		terrainUpdate_shader.Uniform1f("bandOrigin", -25.0f);
+		terrain.Capture(terrainUpdate_shader, camera.Position.z, 1);
 		
-		///////////////////// NEONGRID /////////////////////
-		grid_shader.Use();
-		
-		glUniformMatrix4fv(glGetUniformLocation(grid_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(grid_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+		// if needed by the car, the heights across the grid at its position are read back asynchronously
+		if(carFollowsTerrain){
+			terrain.RequestHeightStrip(countach.position.z);
+			terrain.ReadHeightStrip(terrainStripSamples);
+		}
 		
-		// animation and music uniforms
-		glUniform1fv(glGetUniformLocation(grid_shader.Program, "frequencyBands"), bandsBuffer.size(), &bandsBuffer[0]);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "time"), glfwGetTime());
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "scrollSpeed"), gridScrollSpeed);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "zoom"), gridNoiseZoom);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "dPower"), gridDisplacementPower);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "streetSize"), streetSize);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "fade"), fadeAfterStreet);
-		// lighting uniforms
-		glUniform3fv(glGetUniformLocation(grid_shader.Program, "pointLightPosition"), 1, glm::value_ptr(lightPosition));
-		glUniform3fv(glGetUniformLocation(grid_shader.Program, "diffuseColor"), 1, diffuseColor);
-		glUniform3fv(glGetUniformLocation(grid_shader.Program, "specularColor"), 1, specularColor);
-		glUniform3fv(glGetUniformLocation(grid_shader.Program, "ambientColor"), 1, ambientColor);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "Kd"), diffuse);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "Ks"), specular);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "Ka"), ambient);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "constant"), constant);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "linear"), linear);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "quadratic"), quadratic);
-		glUniform1f(glGetUniformLocation(grid_shader.Program, "shininess"), shininess);
+		// the permutation with the band zones is used for the debug view
+		Shader &terrainDraw_shader = showFrequencyBands ? terrainBands_shader : terrain_shader;
+		terrainDraw_shader.Use();
+		SetGridUniforms(terrainDraw_shader, projection, view);
+		// captured vertices are in world coordinates
+		glm::mat3 terrainNormalMatrix = glm::inverseTranspose(glm::mat3(view));
+		terrainDraw_shader.UniformMatrix3fv("normalMatrix", 1, GL_FALSE, glm::value_ptr(terrainNormalMatrix));
+		terrain.Draw();
+	});
+	graph.Write(terrainPass, sceneTarget);
+	
+	GLuint gridPass = graph.AddPass("NEONGRID", [&](){
+		Shader &gridDraw_shader = showFrequencyBands ? gridBands_shader : grid_shader;
+		gridDraw_shader.Use();
+		SetGridUniforms(gridDraw_shader, projection, view);
+		// baked noise on texture unit 1 (unit 0 is used by the cube map)
+		gridNoise.Bind(gridDraw_shader, 1);
 		
 		glm::mat4 gridModelMatrix;
 		glm::mat3 gridNormalMatrix;
@@ -452,367 +807,500 @@ int main()
 		gridModelMatrix = glm::scale(gridModelMatrix, glm::vec3(gridSize, 1.0f, gridSize));
 		// not considering translations on normal matrix, useful for lighting calculations
 		gridNormalMatrix = glm::inverseTranspose(glm::mat3(view * gridModelMatrix));
-		glUniformMatrix4fv(glGetUniformLocation(grid_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(gridModelMatrix));
-		glUniformMatrix3fv(glGetUniformLocation(grid_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(gridNormalMatrix));
+		gridDraw_shader.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(gridModelMatrix));
+		gridDraw_shader.UniformMatrix3fv("normalMatrix", 1, GL_FALSE, glm::value_ptr(gridNormalMatrix));
 		
-		gridModel.Draw(grid_shader);
+		gridModel.Draw(gridDraw_shader);
 		
 		gridModelMatrix = glm::translate(gridModelMatrix, glm::vec3(0.0f, 0.0f, -490.0f));
-		glUniformMatrix4fv(glGetUniformLocation(grid_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(gridModelMatrix));
-		
-		gridModel.Draw(grid_shader);
-		
-		/////////////////// PALM ///////////////////////////////////
-		glm::mat4* modelMatrices;
-		glm::mat3* normalMatrices;
-		modelMatrices = new glm::mat4[palmAmount];
-		normalMatrices = new glm::mat3[palmAmount];
-		streetBorder = (streetSize*100.0f) / 2.0f; // x position is streetSize depending
-		GLfloat palmTranslationSpeed = gridScrollSpeed * 0.505f;
-		for(int i = 0; i < palmAmount; i++){
-			glm::mat4 rightModelMatrix = glm::mat4(1.0f);
-			glm::mat4 leftModelMatrix = glm::mat4(1.0f);
-			palmZPositions[i] += palmTranslationSpeed * deltaTime;
-			if(palmZPositions[i] > 25.0f)
-				palmZPositions[i] = palmStartingZ;
-			rightModelMatrix = glm::translate(rightModelMatrix, glm::vec3(-streetBorder, -0.5f, palmZPositions[i]));
-			leftModelMatrix = glm::translate(leftModelMatrix, glm::vec3(streetBorder, -0.5f, palmZPositions[i]));
-			leftModelMatrix = glm::rotate(leftModelMatrix, 180.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-			rightModelMatrix = glm::scale(rightModelMatrix, glm::vec3(0.15f));
-			leftModelMatrix = glm::scale(leftModelMatrix, glm::vec3(0.15f));
-			modelMatrices[i] = rightModelMatrix;
-			normalMatrices[i] = glm::inverseTranspose(glm::mat3(view * modelMatrices[i]));
-			modelMatrices[i+1] = leftModelMatrix;
-			normalMatrices[i+1] = glm::inverseTranspose(glm::mat3(view * modelMatrices[i+1]));
-			i++;
-		}
-		/*
-		unsigned int buffer;
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, palmAmount * sizeof(glm::mat4), &modelMatrices[0], GL_DYNAMIC_DRAW); // No difference in terms of FPS.....
+		gridDraw_shader.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(gridModelMatrix));
 		
-		for(unsigned int i = 0; i < palmModel.meshes.size(); i++){
-			unsigned int VAO = palmModel.meshes[i].VAO;
-			glBindVertexArray(VAO);
-			glEnableVertexAttribArray(3);
-			glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)0);
-			glEnableVertexAttribArray(4);
-			glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4)));
-			glEnableVertexAttribArray(5);
-			glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(2 * sizeof(glm::vec4)));
-			glEnableVertexAttribArray(6);
-			glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(3 * sizeof(glm::vec4)));
-			
-			glVertexAttribDivisor(3, 1);
-			glVertexAttribDivisor(4, 1);
-			glVertexAttribDivisor(5, 1);
-			glVertexAttribDivisor(6, 1);
-
-			glBindVertexArray(0);
-		}
-		*/
-		for(int i = 0; i < palmAmount; i++){
-			
-			palm_shader.Use();
-			glStencilFunc(GL_ALWAYS, 1, 0xFF);
-			glStencilMask(0xFF);
-			
-			glUniformMatrix4fv(glGetUniformLocation(palm_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-			glUniformMatrix4fv(glGetUniformLocation(palm_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-			
-			// lighting uniforms
-			glUniform3fv(glGetUniformLocation(palm_shader.Program, "pointLightPosition"), 1, glm::value_ptr(lightPosition));
-			glUniform3fv(glGetUniformLocation(palm_shader.Program, "diffuseColor"), 1, diffuseColor);
-			glUniform3fv(glGetUniformLocation(palm_shader.Program, "specularColor"), 1, specularColor);
-			glUniform3fv(glGetUniformLocation(palm_shader.Program, "ambientColor"), 1, ambientColor);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "Kd"), 0.0f);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "Ks"), 1.0f);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "Ka"), 0.0f);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "constant"), constant);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "linear"), linear);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "quadratic"), quadratic);
-			glUniform1f(glGetUniformLocation(palm_shader.Program, "shininess"), shininess);
-			
-			glUniformMatrix4fv(glGetUniformLocation(palm_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMatrices[i]));
-			glUniformMatrix3fv(glGetUniformLocation(palm_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrices[i]));
-			palmModel.Draw(palm_shader);
-			
-			glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-			glStencilMask(0x00);
-			
-			full_color.Use();
-			
-			glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-			glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-			
-			glUniform3fv(glGetUniformLocation(full_color.Program, "color"), 1, palmOutline);
-			glUniform1i(glGetUniformLocation(full_color.Program, "blink"), 0);
-			glUniform1f(glGetUniformLocation(full_color.Program, "time"), glfwGetTime());
-
-			glm::mat4 palmModelMatrix = modelMatrices[i];
-			palmModelMatrix = glm::translate(palmModelMatrix, glm::vec3(0.0f, -2.0f, 0.0f));
-			palmModelMatrix = glm::scale(palmModelMatrix, glm::vec3(1.1f));
-			glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(palmModelMatrix));
-			
-			palmModel.Draw(full_color);
-			
-		}
+		gridModel.Draw(gridDraw_shader);
+	});
+	graph.Write(gridPass, sceneTarget);
+	
+	/////////////////// PALM ///////////////////////////////////
+	GLuint palmPass = graph.AddPass("PALM", [&](){
+		palm_shader.Use();
 		
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
-		/*for(unsigned int i = 0; i < palmModel.meshes.size(); i++){
-			glBindVertexArray(palmModel.meshes[i].VAO);
-			glDrawElementsInstanced(GL_TRIANGLES, palmModel.meshes[i].indices.size(), GL_UNSIGNED_INT, 0, palmAmount);
-			glBindVertexArray(0);
-		}*/
+		palm_shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+		palm_shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
 		
-		/////////////////// CAR /////////////////////////////////
+		// lighting uniforms
+		palm_shader.Uniform3fv("pointLightPosition", 1, glm::value_ptr(lightPosition));
+		palm_shader.Uniform3fv("diffuseColor", 1, diffuseColor);
+		palm_shader.Uniform3fv("specularColor", 1, specularColor);
+		palm_shader.Uniform3fv("ambientColor", 1, ambientColor);
+		palm_shader.Uniform1f("Kd", 0.0f);
+		palm_shader.Uniform1f("Ks", 1.0f);
+		palm_shader.Uniform1f("Ka", 0.0f);
+		palm_shader.Uniform1f("constant", constant);
+		palm_shader.Uniform1f("linear", linear);
+		palm_shader.Uniform1f("quadratic", quadratic);
+		palm_shader.Uniform1f("shininess", shininess);
 		
+		// all the visible palms in a single instanced draw call
+		if(palmInstances.data)
+			palmModel.DrawInstanced(palm_shader, visiblePalms.Size(), streamBuffer.buffer, palmInstances.offset, sizeof(TransformInstance));
+	});
+	graph.Write(palmPass, sceneTarget);
+	graph.SetState(palmPass, stencilWriteState);
+	
+	/////////////////// CAR /////////////////////////////////
+	GLuint carPass = graph.AddPass("CAR", [&](){
 		car_shader.Use();
 		
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
-		glStencilMask(0xFF);
+		car_shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+		car_shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
 		
-		glUniformMatrix4fv(glGetUniformLocation(car_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(car_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+		car_shader.Uniform3fv("pointLightPosition", 1, glm::value_ptr(lightPosition));
+		car_shader.Uniform3fv("diffuseColor", 1, diffuseColor);
+		car_shader.Uniform3fv("specularColor", 1, carSpecularColor);
+		car_shader.Uniform1f("Kd", 0.0f);
+		car_shader.Uniform1f("alpha", 0.2f);
+		car_shader.Uniform1f("F0", 0.9f);
 		
-		glUniform3fv(glGetUniformLocation(car_shader.Program, "pointLightPosition"), 1, glm::value_ptr(lightPosition));
-		glUniform3fv(glGetUniformLocation(car_shader.Program, "diffuseColor"), 1, diffuseColor);
-		glUniform3fv(glGetUniformLocation(car_shader.Program, "specularColor"), 1, carSpecularColor);
-		glUniform1f(glGetUniformLocation(car_shader.Program, "Kd"), 0.0f);
-		glUniform1f(glGetUniformLocation(car_shader.Program, "alpha"), 0.2f);
-		glUniform1f(glGetUniformLocation(car_shader.Program, "F0"), 0.9f);
+		car_shader.Uniform1f("time", AppTime());
+		car_shader.Uniform1i("blink", blink);
 		
-		glUniform1f(glGetUniformLocation(car_shader.Program, "time"), glfwGetTime());
-		glUniform1i(glGetUniformLocation(car_shader.Program, "blink"), blink);
-		
-		glm::mat4 carModelMatrix;
-		glm::mat3 carNormalMatrix;
 		// car engine tremble
 		GLfloat trembleSpeed = 100.0f;
 		GLfloat trembleTranslation = 0.002f;
-		GLfloat maxTurnAngle = 2.0f;
-		GLfloat rotationSpeed = 100.0f + gridScrollSpeed * 0.1f;
-		GLfloat turnSpeed = 2.0f + gridScrollSpeed * 0.05f;
-		carModelMatrix = glm::translate(carModelMatrix, glm::vec3(std::sin(glfwGetTime() * trembleSpeed) * trembleTranslation, std::sin(glfwGetTime() * trembleSpeed) * trembleTranslation, countach.position.z));
-		if(!freeCamera){
-			if(keys[GLFW_KEY_A] && countach.position.x >= (-streetBorder + 1.0f)){
-				countach.position.x -= deltaTime * turnSpeed;
-				if(carTurnAngle <= maxTurnAngle)
-					carTurnAngle += deltaTime * rotationSpeed;
-			}
-			if(keys[GLFW_KEY_D] && countach.position.x <= (streetBorder - 1.0f)){
-				countach.position.x += deltaTime * turnSpeed;
-				if(carTurnAngle >= -maxTurnAngle)
-					carTurnAngle -= deltaTime * rotationSpeed;
-			}
-			if(!keys[GLFW_KEY_A] && !keys[GLFW_KEY_D]){
-				if(carTurnAngle != 0.0f){
-					if(carTurnAngle >= 0.0f)
-						carTurnAngle -= deltaTime * rotationSpeed;
-					else if(carTurnAngle <= 0.0f)
-						carTurnAngle += deltaTime * rotationSpeed;
-				}
-			}
+		GLfloat tremble = std::sin(AppTime() * trembleSpeed) * trembleTranslation;
+		// the grid is at Y = -0.5, the car rests on it when the terrain is flat.
+		// If the last strip is too far from the car, the car keeps its height until a new one is read
+		if(carFollowsTerrain && chunkedTerrain)
+		{
+			if(terrain.StripNear(countach.position.z))
+				countach.position.y = terrain.HeightAt(countach.position.x) + 0.5f;
 		}
-		carModelMatrix = glm::translate(carModelMatrix, glm::vec3(countach.position.x, 0.0f, 0.0f));
-		carModelMatrix = glm::rotate(carModelMatrix, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		carModelMatrix = glm::rotate(carModelMatrix, glm::radians(carTurnAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-        carModelMatrix = glm::scale(carModelMatrix, glm::vec3(carScale));
-		carNormalMatrix = glm::inverseTranspose(glm::mat3(view * carModelMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(car_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(carModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(car_shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(carNormalMatrix));
+		else
+			countach.position.y = 0.0f;
+		// the car is turned by 180 degrees (plus the steering angle); the outline is slightly larger
+		glm::vec3 carPosition = glm::vec3(tremble + countach.position.x, tremble + countach.position.y, countach.position.z);
+		GLfloat carAngle = glm::radians(180.0f) + glm::radians(carTurnAngle);
+		carTransforms.Set(0, carPosition, carAngle, carScale);
+		carTransforms.Set(1, carPosition, carAngle, carScale * 1.05f);
+		carTransforms.Compute(0, 2, view, carInstances, carMatrices);
+		car_shader.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(carMatrices[0]));
+		car_shader.UniformMatrix3fv("normalMatrix", 1, GL_FALSE, carInstances[0].normal);
 		
 		carModel.Draw(car_shader);
+	});
+	graph.Write(carPass, sceneTarget);
+	graph.SetState(carPass, stencilWriteState);
+	
+	/////////////////// POWERUPS ///////////////////////////////
+	GLuint powerUpPass = graph.AddPass("POWERUPS", [&](){
+		PowerUpStore &powerUps = simulation.current.powerUps;
 		
-		glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-		glStencilMask(0x00);
+		// the geometry shader is needed only by the old path, to explode the hit powerups
+		Shader &sphere_shader = powerUpGeometryShader ? pwUp_shader : pwUpIdle_shader;
+		sphere_shader.Use();
+		sphere_shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+		sphere_shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
+		
+		for(GLuint i = 0; i < pwAmount; i++){
+			if(!pwUpVisible[i])
+				continue;
+			bool hit = powerUps.Is(i, POWERUP_HIT);
+			
+			// shader animation based on the powerup type
+			if(powerUps.Is(i, POWERUP_SPEEDUP))
+				sphere_shader.Uniform1f("u_time", AppTime());
+			else
+				sphere_shader.Uniform1f("u_time", -AppTime());
+			sphere_shader.Uniform1f("time", simulationTime - powerUps.explosionStart[i]);
+			sphere_shader.Uniform1i("explodeValue", powerUpGeometryShader && hit);
+			sphere_shader.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(pwUpModelMatrices[i]));
+			
+			// a hit powerup is replaced by its explosion particles, collected before the passes and drawn by the EXPLOSIONS pass
+			if(powerUps.Is(i, POWERUP_SPAWNED) && (powerUpGeometryShader || !hit))
+				sphereModel.Draw(sphere_shader);
+		}
+	});
+	graph.Write(powerUpPass, sceneTarget);
+	graph.SetState(powerUpPass, stencilWriteState);
+	
+	/////////////////// OUTLINES ///////////////////////////////
+	// outlines of palms, car and spawning powerups, after all the outlined objects have written the stencil buffer
+	GLuint outlinePass = graph.AddPass("OUTLINES", [&](){
+		PowerUpStore &powerUps = simulation.current.powerUps;
+		if(palmOutlineInstances.data){
+			full_color_instanced.Use();
+			full_color_instanced.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+			full_color_instanced.Uniform1f("time", AppTime());
+			full_color_instanced.Uniform3fv("color", 1, palmOutline);
+			full_color_instanced.Uniform1i("blink", 0);
+			full_color_instanced.Uniform1f("emission", outlineEmission);
+			palmModel.DrawInstanced(full_color_instanced, visiblePalmOutlines.Size(), streamBuffer.buffer, palmOutlineInstances.offset, sizeof(TransformInstance));
+		}
 		
 		full_color.Use();
 		
-		glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+		full_color.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+		full_color.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
+		full_color.Uniform1f("time", AppTime());
+		full_color.Uniform1f("emission", outlineEmission);
 		
-		glUniform3fv(glGetUniformLocation(full_color.Program, "color"), 1, carOutline);
-		glUniform1i(glGetUniformLocation(full_color.Program, "blink"), blink);
-		glUniform1f(glGetUniformLocation(full_color.Program, "time"), glfwGetTime());
+		full_color.Uniform3fv("color", 1, carOutline);
+		full_color.Uniform1i("blink", blink);
+		full_color.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(carMatrices[1]));
+		carModel.DrawUntextured(full_color);
 		
-		glm::mat4 carOutlineModelMatrix = carModelMatrix;
-		carOutlineModelMatrix = glm::scale(carOutlineModelMatrix, glm::vec3(1.05f));
-		glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(carOutlineModelMatrix));
+		// outline color based on the powerup type
+		full_color.Uniform1i("blink", 0);
+		for(GLuint i = 0; i < pwAmount; i++){
+			if(!pwUpVisible[i] || powerUps.Is(i, POWERUP_HIT) || !powerUps.Is(i, POWERUP_SPAWNING))
+				continue;
+			pwUpOutline = powerUps.Is(i, POWERUP_SPEEDUP) ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+			full_color.Uniform3fv("color", 1, glm::value_ptr(pwUpOutline));
+			full_color.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(pwUpOutlineMatrices[i]));
+			sphereModel.DrawUntextured(full_color);
+		}
+	});
+	graph.Write(outlinePass, sceneTarget);
+	graph.SetState(outlinePass, outlineState);
+	
+	/////////////////// SKYBOX ////////////////////////////////////////////////
+	// we use the cube to attach the 6 textures of the environment map.
+	// we render it after all the other objects, in order to avoid the depth tests as much as possible.
+	// we will set, in the vertex shader for the skybox, all the values to the maximum depth. Thus, the environment map is rendered only where there are no other objects in the image (so, only on the background). Thus, we set the depth test to GL_LEQUAL (see skyboxState), in order to let the fragments of the background pass the depth test (because they have the maximum depth possible, and the default setting is GL_LESS)
+	GLuint skyboxPass = graph.AddPass("SKYBOX", [&](){
+		skybox_shader.Use();
+		// we activate the cube map
+		glState.ActiveTexture(GL_TEXTURE0);
+		glState.BindTexture(GL_TEXTURE_CUBE_MAP, textureCube);
+		// we pass projection and view matrices to the Shader Program of the skybox
+		skybox_shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+		// to have the background fixed during camera movements, we have to remove the translations from the view matrix
+		// thus, we consider only the top-left submatrix, and we create a new 4x4 matrix
+		glm::mat4 skyboxView = glm::mat4(glm::mat3(view));    // Remove any translation component of the view matrix
+		skybox_shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(skyboxView));
 		
-		carModel.Draw(full_color);
+		// we assign the value to the uniform variable (its position in the Shader Program is determined by the Shader)
+		skybox_shader.Uniform1i("tCube", 0);
 		
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
+		// we render the cube with the environment map
+		skyboxModel.Draw(skybox_shader);
+	});
+	graph.Write(skyboxPass, sceneTarget);
+	graph.SetState(skyboxPass, skyboxState);
+	
+	// Transparent objects are rendered after all opaque ones
 	
-		/////////////////// POWERUPS ///////////////////////////////
+	/////////// QUAD SUN ///////////////
+	GLuint sunPass = graph.AddPass("QUAD SUN", [&](){
+		qSun_shader.Use();
 		
-		modelMatrices = new glm::mat4[pwAmount];
+		// uniforms are passed to the corresponding shader
+		qSun_shader.Uniform1f("u_time", AppTime() * sunAnimationSpeed);
 		
-		for(int i = 0; i < pwAmount; i++){
-			pwUp_shader.Use();
-			
-			glStencilFunc(GL_ALWAYS, 1, 0xFF);
-			glStencilMask(0xFF);
-			
-			glUniformMatrix4fv(glGetUniformLocation(pwUp_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-			glUniformMatrix4fv(glGetUniformLocation(pwUp_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-			
-			// shader animation and outline color based on the powerup type
-			if(powerUps[i].speedUp){
-				glUniform1f(glGetUniformLocation(pwUp_shader.Program, "u_time"), glfwGetTime());
-				pwUpOutline = glm::vec3(0.0f, 1.0f, 0.0f);
-			}
-			else{
-				glUniform1f(glGetUniformLocation(pwUp_shader.Program, "u_time"), -glfwGetTime());
-				pwUpOutline = glm::vec3(1.0f, 0.0f, 0.0f);
-			}
-			glUniform1f(glGetUniformLocation(pwUp_shader.Program, "time"), glfwGetTime() - powerUps[i].explosionStartTime);
-			glUniform1i(glGetUniformLocation(pwUp_shader.Program, "explodeValue"), powerUps[i].explodeValue);
-			// initial X positioning of powerups this will be executed just one time
-			if(once){
-				powerUps[i].position.z = 25.0f;
-				powerUps[i].position.x = (GLfloat)(rand()%((GLint)streetBorder+(GLint)streetBorder + 1) - (GLint)streetBorder);
-			}
-			if(powerUps[i].spawning){
-				if(powerUps[i].spawningOutlineScale > minOutlineScale){
-					powerUps[i].spawningOutlineScale -= deltaTime * (gridScrollSpeed * 0.05f);
-				}
-				else
-					powerUps[i].spawned = true;
-				// powerups translation along the grid
-				powerUps[i].position.z += palmTranslationSpeed * deltaTime;
-				// check if the powerup reached the respawn threshold, considered as Z axis position threshold
-				// if so, the powerup is repositioned on a random X coordinate and shader values are reset
-				if(powerUps[i].position.z > (GLfloat)respawnThreshold){
-					powerUps[i].spawned = false;
-					powerUps[i].spawning = false;
-					powerUps[i].spawningOutlineScale = maxOutlineScale;
-					powerUps[i].hit = false;
-					powerUps[i].explodeValue = 0;
-					powerUps[i].position.z = pwUpStartingZ - (rand() % randomZSpawnOffset);
-					powerUps[i].position.x = (GLfloat)(rand()%(((GLint)streetBorder - 1) + ((GLint)streetBorder - 1) + 1) - ((GLint)streetBorder - 1));
-				}
-			}
-			modelMatrices[i] = glm::translate(modelMatrices[i], powerUps[i].position);
-			//modelMatrices[i] = glm::rotate(modelMatrices[i], glm::radians(30.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-			modelMatrices[i] = glm::scale(modelMatrices[i], glm::vec3(sphereScale));
-			glUniformMatrix4fv(glGetUniformLocation(pwUp_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMatrices[i]));
-			
-			if(powerUps[i].spawned)
-				sphereModel.Draw(pwUp_shader);
-			
-			glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-			glStencilMask(0x00);
-			
-			full_color.Use();
+		// we pass projection and view matrices to the Shader Program
+		qSun_shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+		qSun_shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
 		
-			glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-			glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-			
-			glUniform3fv(glGetUniformLocation(full_color.Program, "color"), 1, glm::value_ptr(pwUpOutline));
-			glUniform1i(glGetUniformLocation(full_color.Program, "blink"), 0);
-			glUniform1f(glGetUniformLocation(full_color.Program, "time"), glfwGetTime());
-			
-			glm::mat4 pwUpOutlineMatrix = modelMatrices[i];
-			pwUpOutlineMatrix = glm::scale(pwUpOutlineMatrix, glm::vec3(powerUps[i].spawningOutlineScale));
-			glUniformMatrix4fv(glGetUniformLocation(full_color.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(pwUpOutlineMatrix));
-			
-			if(!powerUps[i].hit && powerUps[i].spawning)
-				sphereModel.Draw(full_color);
-			
-			glStencilFunc(GL_ALWAYS, 1, 0xFF);
-			
-			// Collision check for each powerup
-			if(!powerUps[i].hit && powerUps[i].spawned){
-				if(CheckCollision(powerUps[i], countach)){
-					powerUps[i].hit = true;
-					if(powerUps[i].speedUp){
-						gridScrollSpeed += gridScrollSpeed * 0.1f;
-						soundEngine->play2D(speedUpSFX.c_str(), false);
-						blink = 1;
-					}
-					else{
-						gridScrollSpeed -= gridScrollSpeed * 0.1f;
-						if(gridScrollSpeed < 5.0f)
-							gridScrollSpeed = 5.0f;
-						soundEngine->play2D(speedDownSFX.c_str(), false);
-						blink = -1;
-					}
-					blinkStart = glfwGetTime();
-					powerUps[i].explodeValue = 1;
-					powerUps[i].explosionStartTime = glfwGetTime();
-				}
-			}
-			
-			// turn off the car blink after blinkDuration seconds
-			if(blink != 0 && glfwGetTime() - blinkStart > blinkDuration){
-				blink = 0;
-			}
+		glm::mat4 quadModelMatrix;
+		
+		quadModelMatrix = glm::translate(quadModelMatrix, glm::vec3(sunPosition[0], sunPosition[1], sunPosition[2]));
+		quadModelMatrix = glm::rotate(quadModelMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+		quadModelMatrix = glm::scale(quadModelMatrix, glm::vec3(sunSize, 1.0f, sunSize));
+		qSun_shader.UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(quadModelMatrix));
+		
+		quadModel.Draw(qSun_shader);
+	});
+	graph.Write(sunPass, sceneTarget);
+	
+	/////////// EXPLOSIONS ///////////////
+	// all the explosions in a single instanced draw call, after the skybox (otherwise the background covers the particles)
+	GLuint explosionPass = graph.AddPass("EXPLOSIONS", [&](){
+		explosions.Draw(explosion_shader, projection, view, AppTime());
+	});
+	graph.Write(explosionPass, sceneTarget);
+	
+	/////////// HDR RESOLVE, BLOOM AND POST-PROCESSING ///////////////
+	if(sceneTarget != hdrScene){
+		GLuint resolvePass = graph.AddPass("RESOLVE", [&](){
+			// the graph has bound the framebuffer of hdrScene, we read from the multisampled one
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, graph.Framebuffer(sceneTarget));
+			glBlitFramebuffer(0, 0, frameWidth, frameHeight, 0, 0, frameWidth, frameHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, graph.Framebuffer(hdrScene));
+		});
+		graph.Read(resolvePass, sceneTarget);
+		graph.Write(resolvePass, hdrScene);
+		graph.SetState(resolvePass, FullscreenState());
+	}
+	
+	FullscreenTriangle fullscreen;
+	Shader* bloomDownShaders[2] = {&bloomDown4_shader, &bloomDown8_shader};
+	Shader* bloomUpShaders[2] = {&bloomUp4_shader, &bloomUp8_shader};
+	Bloom bloom(graph, hdrScene, frameWidth, frameHeight, bloomDownShaders, bloomUpShaders, fullscreen);
+	
+	// all the effects of the stack in a single pass: the scene is read once, and the window is written once
+	GLuint postPass = graph.AddPass("POST", [&](){
+		Shader &post_shader = postStack.Use();
+		glState.ActiveTexture(GL_TEXTURE0);
+		glState.BindTexture(GL_TEXTURE_2D, graph.Texture(hdrScene));
+		glState.ActiveTexture(GL_TEXTURE1);
+		glState.BindTexture(GL_TEXTURE_2D, graph.Texture(bloom.Result()));
+		post_shader.Uniform1i("scene", 0);
+		post_shader.Uniform1i("bloom", 1);
+		post_shader.Uniform1f("bloomIntensity", bloomIntensity);
+		fullscreen.Draw();
+		postPermutations = postStack.Permutations();
+	});
+	graph.Read(postPass, hdrScene);
+	graph.Read(postPass, bloom.Result());
+	graph.Write(postPass, screen);
+	graph.SetState(postPass, FullscreenState());
+	
+	GLuint guiPass = graph.AddPass("ImGui", [&](){
+		ImGui::Render();
+		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+	});
+	graph.Write(guiPass, screen);
+	
+	// Rendering loop: this code is executed at each frame
+    while(!glfwWindowShouldClose(window) && !(benchmarkMode && benchmarkFrame >= benchmarkFrames) && !(replayMode && inputReplayer.Finished()))
+    {
+		benchmarkLog.BeginFrame();
+		renderStats.Reset();
+        // we determine the time passed from the beginning
+        // and we calculate time difference between current frame rendering and the previous one
+        GLfloat currentFrame = AppTime() - musicStartTime;
+        deltaTime = currentFrame - lastFrame;
+        lastFrame = currentFrame;
+		// in a replay, the gameplay receives the recorded frame times
+		if(replayMode)
+			deltaTime = inputReplayer.Current().deltaTime;
+		
+		CPU_ZONE_BEGIN("Frame");
+		// results of the frame recorded GPU_PROFILER_FRAMES frames ago are collected here
+		gpuProfiler.BeginFrame();
+		GLuint profiledFrame = gpuProfiler.FrameNumber();
+		jobs.BeginFrame();
+		jobWorkerStats = jobs.stats;
+		// the region of the stream buffer used 3 frames ago is written again (we wait if the GPU is still reading it)
+		streamBuffer.BeginFrame();
+		// state changes issued and filtered in the previous frame
+		glState.BeginFrame();
+
+		// the audio of the frame is analyzed by a worker, while the main thread reloads the shaders and reads the input events
+		JobHandle audioAnalysis = jobs.Run("AubioCompute", [&](){ AubioCompute(deltaTime, simulation); });
+		
+		// changed shader files (not in the benchmark, where the programs must not change)
+		if(!benchmarkMode){
+			CPU_ZONE_BEGIN("Shader reload");
+			shaderReload.Update();
+			CPU_ZONE_END();
 		}
-		once = false;
+
+        // Check is an I/O event is happening
+		CPU_ZONE_BEGIN("glfwPollEvents");
+        glfwPollEvents();
+		CPU_ZONE_END();
 		
-        /////////////////// SKYBOX ////////////////////////////////////////////////
-		// we use the cube to attach the 6 textures of the environment map.
-        // we render it after all the other objects, in order to avoid the depth tests as much as possible.
-        // we will set, in the vertex shader for the skybox, all the values to the maximum depth. Thus, the environment map is rendered only where there are no other objects in the image (so, only on the background). Thus, we set the depth test to GL_LEQUAL, in order to let the fragments of the background pass the depth test (because they have the maximum depth possible, and the default setting is GL_LESS)
-        glDepthFunc(GL_LEQUAL);
-        skybox_shader.Use();
-        // we activate the cube map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureCube);
-         // we pass projection and view matrices to the Shader Program of the skybox
-        glUniformMatrix4fv(glGetUniformLocation(skybox_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        // to have the background fixed during camera movements, we have to remove the translations from the view matrix
-        // thus, we consider only the top-left submatrix, and we create a new 4x4 matrix
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));    // Remove any translation component of the view matrix
-        glUniformMatrix4fv(glGetUniformLocation(skybox_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-
-        // we determine the position in the Shader Program of the uniform variables
-        GLint textureLocation = glGetUniformLocation(skybox_shader.Program, "tCube");
-        // we assign the value to the uniform variable
-        glUniform1i(textureLocation, 0);
-
-        // we render the cube with the environment map
-        skyboxModel.Draw(skybox_shader);
-        // we set again the depth test to the default operation for the next frame
-        glDepthFunc(GL_LESS);
+		// the GUI shows the frequency bands, and it can restart the music
+		jobs.Wait(audioAnalysis);
 		
-		// Transparent objects are rendered after all opaque ones
+		// Draw the GUI through ImGui
+		DrawGUI();
 		
-		/////////// QUAD SUN ///////////////
+		// gameplay update: the simulation consumes the elapsed time in fixed steps
+		CPU_ZONE_BEGIN("Simulation");
+		streetBorder = (streetSize*100.0f) / 2.0f; // x position is streetSize depending
+		simulation.streetBorder = streetBorder;
+		// recorded key events and GUI parameters replace the live ones
+		if(replayMode){
+			const ReplayFrame &replayFrame = inputReplayer.Current();
+			for(GLuint k = 0; k < replayFrame.keys.size(); k++)
+				ProcessKey(window, replayFrame.keys[k].key, replayFrame.keys[k].action);
+			// the music restarted or changed from the GUI in the recorded frame
+			if(replayFrame.musicChanged){
+				if(HashFile(replayFrame.musicPath) != replayFrame.musicHash)
+					std::cout << "WARNING: " << replayFrame.musicPath << " is not the track of the recorded session" << std::endl;
+				ChangeMusic(replayFrame.musicPath);
+			}
+			gridScrollSpeed = replayFrame.scrollSpeed;
+			streetBorder = replayFrame.streetBorder;
+			simulation.streetBorder = streetBorder;
+		}
+		// the scroll speed can be changed from the GUI, and by the powerups
+		simulation.current.scrollSpeed = gridScrollSpeed;
+		SimulationInput input;
+		input.left = !freeCamera && keys[GLFW_KEY_A];
+		input.right = !freeCamera && keys[GLFW_KEY_D];
+		input.autopilot = benchmarkMode;
+		alpha = simulation.Advance(deltaTime, input);
+		uint32_t stateHash = simulation.StateHash();
+		inputRecorder.EndFrame(deltaTime, gridScrollSpeed, streetBorder, stateHash);
+		if(replayMode)
+			inputReplayer.EndFrame(stateHash);
+		gridScrollSpeed = simulation.current.scrollSpeed;
+		blink = simulation.current.blink;
+		// interpolated simulation time, for the animations driven by gameplay events
+		simulationTime = simulation.Time(alpha);
+		for(GLuint e = 0; e < simulation.events.size(); e++){
+			if(soundEngine)
+				soundEngine->play2D(simulation.events[e].speedUp ? speedUpSFX.c_str() : speedDownSFX.c_str(), false);
+		}
+		countach = simulation.current.car;
+		countach.position = simulation.CarPosition(alpha);
+		carTurnAngle = simulation.CarTurnAngle(alpha);
+		CPU_ZONE_END();
+		// we apply FPS camera movements
+		if(freeCamera)
+			apply_camera_movements();
+		// the benchmark camera sways slowly across the street
+		if(benchmarkMode)
+			camera.Position.x = std::sin(currentFrame * 0.3f) * 2.0f;
+		// View matrix (=camera): position, view direction, camera "up" vector
 		view = camera.GetViewMatrix();
-		qSun_shader.Use();
 		
-		// uniforms are passed to the corresponding shader
-		glUniform1f(glGetUniformLocation(qSun_shader.Program, "u_time"), glfwGetTime() * sunAnimationSpeed);
+		// transforms and visibility of palms and powerups are computed by the workers, while the main thread bakes the grid noise
+		FrustumPlanes(projection * view, frustum);
+		JobHandle palmTransforms = jobs.ParallelFor("Palm transforms", palmAmount / 2, 4, [&](GLuint first, GLuint last){
+			// palms in pairs, one for each side of the street (the left ones are rotated around Y)
+			for(GLuint pair = first; pair < last; pair++){
+				GLuint i = pair * 2;
+				glm::vec3 rightPosition = glm::vec3(-streetBorder, -0.5f, simulation.PalmZ(i, alpha));
+				glm::vec3 leftPosition = glm::vec3(streetBorder, -0.5f, simulation.PalmZ(i + 1, alpha));
+				palms.Set(i, rightPosition, 0.0f, 0.15f);
+				palms.Set(i + 1, leftPosition, 180.0f, 0.15f);
+				// the outline is moved down by 2 units (in model space) and enlarged by 10%
+				palmOutlines.Set(i, rightPosition - glm::vec3(0.0f, 2.0f * 0.15f, 0.0f), 0.0f, 0.15f * 1.1f);
+				palmOutlines.Set(i + 1, leftPosition - glm::vec3(0.0f, 2.0f * 0.15f, 0.0f), 180.0f, 0.15f * 1.1f);
+				palmVisible[i] = SphereInFrustum(frustum, rightPosition, palmRadius);
+				palmVisible[i+1] = SphereInFrustum(frustum, leftPosition, palmRadius);
+			}
+		});
+		JobHandle pwUpTransforms = jobs.ParallelFor("PowerUp transforms", pwAmount, 32, [&](GLuint first, GLuint last){
+			PowerUpStore &powerUps = simulation.current.powerUps;
+			for(GLuint i = first; i < last; i++){
+				glm::vec3 pwUpPosition = simulation.PowerUpPosition(i, alpha);
+				pwUps.Set(i, pwUpPosition, 0.0f, sphereScale);
+				pwUpOutlines.Set(i, pwUpPosition, 0.0f, sphereScale * powerUps.outlineScale[i]);
+				// the hit powerups are always processed: their explosion is not culled
+				pwUpVisible[i] = powerUps.Is(i, POWERUP_HIT) || SphereInFrustum(frustum, pwUpPosition, sphereRadius * glm::max(powerUps.outlineScale[i], 1.0f));
+			}
+			// model matrices of the range, in a single batch
+			pwUps.Compute(first, last, view, NULL, &pwUpModelMatrices[0]);
+			pwUpOutlines.Compute(first, last, view, NULL, &pwUpOutlineMatrices[0]);
+		});
+		// we bake again the grid noise if the zoom has been changed from the GUI
+		gridNoise.Bake(gridNoiseZoom);
 		
-		// we pass projection and view matrices to the Shader Program
-        glUniformMatrix4fv(glGetUniformLocation(qSun_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(qSun_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+		if(runGridBenchmark){
+			GridNoiseBenchmark(grid_shader, gridNoise, projection, view);
+			runGridBenchmark = false;
+		}
 		
-		glm::mat4 quadModelMatrix;
+        // we set the rendering mode
+        if (wireframe)
+            // Draw in wireframe
+            glState.PolygonMode(GL_LINE);
+        else
+            glState.PolygonMode(GL_FILL);
 		
-		quadModelMatrix = glm::translate(quadModelMatrix, glm::vec3(sunPosition[0], sunPosition[1], sunPosition[2]));
-		quadModelMatrix = glm::rotate(quadModelMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        quadModelMatrix = glm::scale(quadModelMatrix, glm::vec3(sunSize, 1.0f, sunSize));
-        glUniformMatrix4fv(glGetUniformLocation(qSun_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(quadModelMatrix));
+		// we activate the cube map
+        glState.ActiveTexture(GL_TEXTURE0);
+        glState.BindTexture(GL_TEXTURE_CUBE_MAP, textureCube);
 		
-		quadModel.Draw(qSun_shader);
+		jobs.Wait(palmTransforms);
+		jobs.Wait(pwUpTransforms);
+		// the matrices of the visible palms (and of their outlines) are written directly in the stream buffer, as instance data
+		visiblePalms.Select(palms, palmVisible);
+		visiblePalmOutlines.Select(palmOutlines, palmVisible);
+		renderStats.culledObjects += palms.Size() - visiblePalms.Size();
+		for(GLuint i = 0; i < pwAmount; i++)
+			if(!pwUpVisible[i])
+				renderStats.culledObjects++;
+		palmInstances = streamBuffer.Allocate(visiblePalms.Size() * sizeof(TransformInstance));
+		palmOutlineInstances = streamBuffer.Allocate(visiblePalmOutlines.Size() * sizeof(TransformInstance));
+		if(palmInstances.data)
+			visiblePalms.Compute(0, visiblePalms.Size(), view, (TransformInstance*)palmInstances.data, NULL);
+		if(palmOutlineInstances.data)
+			visiblePalmOutlines.Compute(0, visiblePalmOutlines.Size(), view, (TransformInstance*)palmOutlineInstances.data, NULL);
+		// the explosions of the hit powerups are written in the stream buffer too: without persistent mapping, the buffer must not be mapped while the passes draw from it
+		PowerUpStore &hitPowerUps = simulation.current.powerUps;
+		explosions.Clear();
+		if(!powerUpGeometryShader)
+			for(GLuint i = 0; i < pwAmount; i++)
+				if(pwUpVisible[i] && hitPowerUps.Is(i, POWERUP_SPAWNED) && hitPowerUps.Is(i, POWERUP_HIT))
+					explosions.Add(glm::vec3(pwUpModelMatrices[i][3]), simulationTime - hitPowerUps.explosionStart[i], hitPowerUps.Is(i, POWERUP_SPEEDUP));
+		streamBuffer.Commit();
 		
-		ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		// the frame is cleared and drawn by the passes of the render graph
+		graph.SetEnabled(terrainPass, chunkedTerrain);
+		graph.SetEnabled(gridPass, !chunkedTerrain);
+		bloom.divisor = bloomDivisor;
+		bloom.levels = (GLuint)bloomLevels;
+		bloom.taps = bloomFullTaps ? 8 : 4;
+		bloom.threshold = bloomThreshold;
+		bloom.knee = bloomKnee;
+		bloom.Update();
+		graph.Execute();
+		// the region of the frame is protected by a fence, until the GPU has executed the draw calls using it
+		streamBuffer.EndFrame();
+		streamUsed = streamBuffer.used;
+		streamStalls = streamBuffer.stalls;
+		streamOverflows = streamBuffer.overflows;
+		renderGraphPasses = graph.PassCount();
+		renderGraphExecuted = graph.ExecutedPasses();
+		renderGraphFramebuffers = graph.FramebufferCount();
+		lastRenderStats = renderStats;
+		gpuProfiler.EndFrame();
         // Swapping back and front buffers
-        glfwSwapBuffers(window);
+		if(benchmarkMode){
+			benchmarkLog.EndFrame(profiledFrame, currentFrame, renderStats);
+			benchmarkFrame++;
+		}
+		else{
+			CPU_ZONE_BEGIN("glfwSwapBuffers");
+			glfwSwapBuffers(window);
+			CPU_ZONE_END();
+		}
+		CPU_ZONE_END();
+		
+		if(dumpCPUTrace){
+			CPUProfiler::DumpChromeTrace(cpuTracePath, cpuTraceSeconds);
+			dumpCPUTrace = false;
+		}
     }
+	
+	if(dumpCPUTraceOnExit)
+		CPUProfiler::DumpChromeTrace(cpuTracePath, cpuTraceSeconds);
+	
+	if(benchmarkMode){
+		// we wait for the GPU times of the last frames
+		gpuProfiler.Flush();
+		benchmarkLog.WriteCSV(benchmarkCSV, gpuProfiler);
+		offscreen->Delete();
+		delete offscreen;
+	}
 
     // when I exit from the graphics loop, it is because the application is closing
+	inputRecorder.Close();
+	if(replayMode)
+		inputReplayer.Report();
     // we delete the Shader Programs
+    shaderReload.Delete();
     DeleteShaders();
+	terrain.Delete();
+	gridNoise.Delete();
+	gpuProfiler.Delete();
+	graph.Delete();
+	fullscreen.Delete();
+	postStack.Delete();
+	glState.DeleteTexture(gradingLUT);
+	explosions.Delete();
+	geometryArena.Delete();
+	streamBuffer.Delete();
 	
 	AubioReset(true);
 	// Delete irrKlang sound engine
-	soundEngine->drop();
+	if(soundEngine)
+		soundEngine->drop();
 	
 	// ImGui Cleanup
     ImGui_ImplOpenGL3_Shutdown();
@@ -829,7 +1317,7 @@ int main()
 void DeleteShaders()
 {
     for(GLuint i = 0; i < shaders.size(); i++)
-        shaders[i].Delete();
+        shaders[i]->Delete();
 }
 
 //////////////////////////////////////////
@@ -842,8 +1330,8 @@ GLint LoadTextureCube(string path)
     string fullname;
 
     glGenTextures(1, &textureImage);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureImage);
+    glState.ActiveTexture(GL_TEXTURE0);
+    glState.BindTexture(GL_TEXTURE_CUBE_MAP, textureImage);
 
     // we use as convention that the names of the 6 images are "posx, negx, posy, negy, posz, negz", placed at the path passed as parameter
     //POSX
@@ -903,15 +1391,69 @@ GLint LoadTextureCube(string path)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glState.BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
     return textureImage;
 
 }
 
+//////////////////////////////////////////
+// we create the 3D lookup table of the color grading (see postColorGrading.glsl): each texel is the graded color of its coordinates.
+// The retrowave look: purple shadows, warm highlights, more saturation and a soft S-curve of contrast
+GLuint CreateGradingLUT(GLint size)
+{
+	vector<GLubyte> texels;
+	texels.reserve(size * size * size * 3);
+	const glm::vec3 luma(0.2126f, 0.7152f, 0.0722f);
+	const glm::vec3 shadowTint(0.45f, 0.2f, 0.65f), highlightTint(1.0f, 0.7f, 0.5f);
+	// the red coordinate changes faster (width, then height, then depth)
+	for(GLint b = 0; b < size; b++)
+		for(GLint g = 0; g < size; g++)
+			for(GLint r = 0; r < size; r++)
+			{
+				glm::vec3 color = glm::vec3(r, g, b) / (GLfloat)(size - 1);
+				GLfloat l = glm::dot(color, luma);
+				color += (shadowTint - 0.5f) * 0.2f * (1.0f - l) + (highlightTint - 0.5f) * 0.15f * l;
+				color = glm::mix(glm::vec3(l), color, 1.2f);
+				color = glm::clamp(color, 0.0f, 1.0f);
+				color = glm::mix(color, color * color * (3.0f - 2.0f * color), 0.3f);
+				for(GLuint c = 0; c < 3; c++)
+					texels.push_back((GLubyte)(color[c] * 255.0f + 0.5f));
+			}
+
+	GLuint lut;
+	glGenTextures(1, &lut);
+	glState.ActiveTexture(GL_TEXTURE0);
+	glState.BindTexture(GL_TEXTURE_3D, lut);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB8, size, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, &texels[0]);
+	// the colors between the texels are interpolated, and the coordinates are never outside the table
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glState.BindTexture(GL_TEXTURE_3D, 0);
+	return lut;
+}
+
 //////////////////////////////////////////
 // callback for keyboard events
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
+{
+	// during a replay, the live keyboard is ignored (apart from ESC)
+	if(replayMode){
+		if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+			glfwSetWindowShouldClose(window, GL_TRUE);
+		return;
+	}
+	if(key >= 0 && key < 1024)
+		inputRecorder.RecordKey(key, action);
+	ProcessKey(window, key, action);
+}
+
+//////////////////////////////////////////
+// we manage a key event, received live or from a recording
+void ProcessKey(GLFWwindow* window, int key, int action)
 {
     // if ESC is pressed, we close the application
     if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
@@ -932,6 +1474,10 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 	if(key == GLFW_KEY_LEFT_CONTROL && action == GLFW_PRESS){
 		freeCamera=!freeCamera;
 	}
+	
+	// if F9 is pressed, the last seconds of CPU zones are written in a Chrome trace file (at the end of the frame)
+	if(key == GLFW_KEY_F9 && action == GLFW_PRESS)
+		dumpCPUTrace = true;
 
 	// we keep trace of the pressed keys
     // with this method, we can manage 2 keys pressed at the same time:
@@ -1001,9 +1547,9 @@ float samplesPerWindow;
 
 void DrawGUI()
 {
+	CPU_ZONE("DrawGUI");
 	static bool fileDialog = false;
 	static bool showAubioUI = false;
-	static string fileName = "";
 	
 	ImGui_ImplOpenGL3_NewFrame();
 	ImGui_ImplGlfw_NewFrame();
@@ -1013,46 +1559,38 @@ void DrawGUI()
 	ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Press ALT to enable/disable cursor.");
 	ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Camera is free to rotate, press CTRL to enable/disable camera movement.");
 	ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Press A to turn left, D to turn right. WASD for camera movement.");
+#ifdef CPU_PROFILER_ENABLED
+	ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Press F9 to save the last %.0f seconds of CPU zones in %s.", cpuTraceSeconds, cpuTracePath.c_str());
+#endif
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-	if(fileName.size() > 0)
-		ImGui::Text("Current Music: %s", fileName.c_str());
-	else
-		ImGui::Text("Current Music: SneakyDriver_KatanaZeroOST.wav");
-
-	if(ImGui::Button("Restart Music")){
-		AubioReset(true);
-		lastFrame = 0;
-		remainingFrames = 0;
-		musicStartTime = glfwGetTime();
-		AubioInitialize(musicPath);
-		PlayMusic(musicPath);
-	}
-	ImGui::SameLine();
-	
-	if(ImGui::Button("Change Music"))
-		fileDialog = true;
+	// counters of the last frame (the same ones written in the benchmark CSV)
+	const RenderStats &stats = lastRenderStats;
+	ImGui::Text("Draw calls: %u (%u instanced), triangles: %llu", stats.drawCalls, stats.instancedDraws, (unsigned long long)stats.triangles);
+	ImGui::Text("Program binds: %u, uniform uploads: %u, texture binds: %u, stencil changes: %u", stats.programBinds, stats.uniformUploads, stats.textureBinds, stats.stencilChanges);
+	ImGui::Text("Buffer uploads: %.1f KB, culled objects: %u", stats.bufferBytes / 1024.0f, stats.culledObjects);
+	ImGui::Text("Current Music: %s", musicPath.substr(musicPath.find_last_of("/\\") + 1).c_str());
+
+	// in a replay, the music is restarted and changed as in the recording (see the main loop)
+	if(!replayMode){
+		if(ImGui::Button("Restart Music"))
+			ChangeMusic(musicPath);
+		ImGui::SameLine();
 		
-	if(fileDialog){
-		if(ImGuiFileDialog::Instance()->FileDialog("Choose Music File", "", "../../../Music", "")){
-			if(ImGuiFileDialog::Instance()->IsOk == true){
-				string tempFileName = ImGuiFileDialog::Instance()->GetCurrentFileName();
-				if(tempFileName != ""){
-					fileName = ImGuiFileDialog::Instance()->GetCurrentFileName();
-					musicPath = ImGuiFileDialog::Instance()->GetFilepathName();
-					AubioReset(true);
-					lastFrame = 0;
-					remainingFrames = 0;
-					musicStartTime = glfwGetTime();
-					AubioInitialize(musicPath);
-					PlayMusic(musicPath);
+		if(ImGui::Button("Change Music"))
+			fileDialog = true;
+			
+		if(fileDialog){
+			if(ImGuiFileDialog::Instance()->FileDialog("Choose Music File", "", "../../../Music", "")){
+				if(ImGuiFileDialog::Instance()->IsOk == true){
+					string tempFileName = ImGuiFileDialog::Instance()->GetCurrentFileName();
+					if(tempFileName != "")
+						ChangeMusic(ImGuiFileDialog::Instance()->GetFilepathName());
 				}
+				fileDialog = false;
 			}
-			else{
-			}
-			fileDialog = false;
 		}
+		ImGui::SameLine();
 	}
-	ImGui::SameLine();
 	
 	if(ImGui::Button("Open/Close Aubio UI")){
 		if(showAubioUI)
@@ -1061,6 +1599,9 @@ void DrawGUI()
 			showAubioUI = true;
 	}
 	ImGui::SameLine();
+	
+	if(ImGui::Button("Open/Close GPU Profiler"))
+		showGPUProfiler = !showGPUProfiler;
 	ImGui::End();
 	
 	if(showAubioUI){
@@ -1078,6 +1619,60 @@ void DrawGUI()
 		ImGui::End();
 	}
 	
+	if(showGPUProfiler){
+		ImGui::Begin("GPU Profiler");
+		ImGui::Checkbox("Enabled", &gpuProfiler.enabled);
+		ImGui::SameLine();
+		if(ImGui::Button("Dump CSV") && gpuProfiler.DumpCSV(gpuProfilerCSV))
+			cout << "GPU profile written to " << gpuProfilerCSV << endl;
+		ImGui::Text("Times in ms over the last %u frames (results are %u frames late)", gpuProfiler.historySize, GPU_PROFILER_FRAMES);
+		// one row for each section of the rendering loop
+		vector<ProfilerStats> stats = gpuProfiler.Stats();
+		GLfloat total = 0.0f;
+		ImGui::Columns(5, "gpuProfilerColumns");
+		ImGui::Text("Pass"); ImGui::NextColumn();
+		ImGui::Text("Last"); ImGui::NextColumn();
+		ImGui::Text("Min"); ImGui::NextColumn();
+		ImGui::Text("Avg"); ImGui::NextColumn();
+		ImGui::Text("p99"); ImGui::NextColumn();
+		ImGui::Separator();
+		for(GLuint i = 0; i < stats.size(); i++){
+			ImGui::Text("%s", stats[i].name.c_str()); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats[i].last); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats[i].min); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats[i].avg); ImGui::NextColumn();
+			ImGui::Text("%.3f", stats[i].p99); ImGui::NextColumn();
+			total += stats[i].avg;
+		}
+		ImGui::Columns(1);
+		ImGui::Separator();
+		ImGui::Text("Sum of the averages: %.3f ms", total);
+		ImGui::Text("Render graph: %u of %u passes executed, %u transient framebuffers", renderGraphExecuted, renderGraphPasses, renderGraphFramebuffers);
+		ImGui::Text("Geometry arena: %u meshes (%u before the merge by material), %s", arenaMeshes, arenaSubmeshes, arenaMultiDraw ? "multi-draw indirect" : "base vertex draws");
+		ImGui::Text("Stream buffer (%s): %.1f KB per frame, %u stalls, %u overflows", streamPersistent ? "persistent" : "unsynchronized", streamUsed / 1024.0f, streamStalls, streamOverflows);
+		for(GLuint i = 0; i < jobWorkerStats.size(); i++)
+			ImGui::Text("%s: %.0f%% busy, %u jobs (%u stolen)", jobWorkerStats[i].name.c_str(), jobWorkerStats[i].utilization * 100.0f, jobWorkerStats[i].jobs, jobWorkerStats[i].steals);
+		// state changes of the last frame: issued to the driver, and filtered by the GLState because redundant
+		ImGui::Separator();
+		GLuint issued = 0, filtered = 0;
+		ImGui::Columns(3, "glStateColumns");
+		ImGui::Text("State"); ImGui::NextColumn();
+		ImGui::Text("Issued"); ImGui::NextColumn();
+		ImGui::Text("Filtered"); ImGui::NextColumn();
+		ImGui::Separator();
+		for(GLuint k = 0; k < GL_STATE_KINDS; k++){
+			ImGui::Text("%s", GL_STATE_KIND_NAMES[k]); ImGui::NextColumn();
+			ImGui::Text("%u", glState.lastIssued[k]); ImGui::NextColumn();
+			ImGui::Text("%u", glState.lastFiltered[k]); ImGui::NextColumn();
+			issued += glState.lastIssued[k];
+			filtered += glState.lastFiltered[k];
+		}
+		ImGui::Columns(1);
+		ImGui::Separator();
+		ImGui::Text("State changes: %u issued, %u filtered", issued, filtered);
+		ImGui::End();
+	}
+	
 	ImGui::Begin("Environment Parameters");
 	ImGui::TextColored(ImVec4(1.0, 0.0, 1.0, 1.0), "Neon Grid Parameters");
 	ImGui::InputFloat("Scroll Speed", &gridScrollSpeed, 0.5f, 1.0f);
@@ -1086,6 +1681,15 @@ void DrawGUI()
 	ImGui::InputFloat("Street Size", &streetSize, 0.01f, 0.1f, "%.3f");
 	ImGui::InputFloat("Fade After Street", &fadeAfterStreet, 0.01f, 0.1f, "%.3f");
 	ImGui::InputFloat("Buffer Decrease Amount", &bufferDecreaseAmount, 0.000001f, 0.0001f, "%.6f");
+	ImGui::Checkbox("Chunked Terrain", &chunkedTerrain);
+	if(chunkedTerrain){
+		ImGui::SliderFloat("Terrain Horizon", &terrainHorizon, 20.0f, 200.0f);
+		ImGui::Text("Terrain Chunks: %u active, %u in pool", terrainActiveChunks, terrainPoolSize);
+		ImGui::Checkbox("Car Follows Terrain", &carFollowsTerrain);
+	}
+	// old path, to compare the POWERUPS time in the GPU Profiler
+	ImGui::Checkbox("Powerups with Geometry Shader", &powerUpGeometryShader);
+	ImGui::Checkbox("Show Frequency Bands", &showFrequencyBands);
 	ImGui::TextColored(ImVec4(1.0, 0.8, 0.0, 1.0), "Retro Sun Parameters");
 	ImGui::SliderFloat("Shader Animation Speed", &sunAnimationSpeed, 0.0f, 10.0f);
 	ImGui::SliderFloat3("Sun Position", sunPosition, -100.0f, 100.0f);
@@ -1102,6 +1706,42 @@ void DrawGUI()
 	ImGui::InputFloat("Linear", &linear, 0.01f, 0.1f);
 	ImGui::InputFloat("Quadratic", &quadratic, 0.01f, 0.1f);
 	ImGui::SliderFloat("Shininess", &shininess, 0.0f, 50.0f);
+	ImGui::TextColored(ImVec4(1.0, 0.4, 0.8, 1.0), "HDR and Bloom");
+	ImGui::Text("Scene MSAA samples: %d", hdrSamples);
+	ImGui::SliderFloat("Exposure", &exposure, 0.1f, 4.0f);
+	ImGui::SliderFloat("Bloom Intensity", &bloomIntensity, 0.0f, 2.0f);
+	ImGui::SliderFloat("Bloom Threshold", &bloomThreshold, 0.0f, 4.0f);
+	ImGui::SliderFloat("Bloom Knee", &bloomKnee, 0.0f, 1.0f);
+	// the first level is at 1/divisor of the resolution: the cost of the bloom is mostly there
+	ImGui::SliderInt("Bloom Divisor", &bloomDivisor, 1, 8);
+	ImGui::SliderInt("Bloom Levels", &bloomLevels, 2, BLOOM_MAX_LEVELS);
+	ImGui::Checkbox("Bloom 8 Taps", &bloomFullTaps);
+	ImGui::SliderFloat("Outline Emission", &outlineEmission, 1.0f, 8.0f);
+	// all the enabled effects are compiled in a single uber shader: each combination is a permutation, compiled the first time it is used
+	ImGui::TextColored(ImVec4(0.4, 1.0, 0.6, 1.0), "Post-Processing (%u permutations)", postPermutations);
+	ImGui::Checkbox("Chromatic Aberration", &postAberration);
+	if(postAberration)
+		ImGui::SliderFloat("Aberration", &aberration, 0.0f, 0.02f, "%.4f");
+	ImGui::Checkbox("Tonemapping", &postTonemap);
+	ImGui::Checkbox("Color Grading", &postGrading);
+	if(postGrading)
+		ImGui::SliderFloat("Grading Strength", &gradingStrength, 0.0f, 1.0f);
+	ImGui::Checkbox("Vignette", &postVignette);
+	if(postVignette){
+		ImGui::SliderFloat("Vignette Amount", &vignetteAmount, 0.0f, 1.0f);
+		ImGui::SliderFloat("Vignette Softness", &vignetteSoftness, 0.05f, 1.0f);
+	}
+	ImGui::Checkbox("Scanlines", &postScanlines);
+	if(postScanlines)
+		ImGui::SliderFloat("Scanline Amount", &scanlineAmount, 0.0f, 0.5f);
+	ImGui::Checkbox("Film Grain", &postGrain);
+	if(postGrain)
+		ImGui::SliderFloat("Grain Amount", &grainAmount, 0.0f, 0.2f);
+	ImGui::TextColored(ImVec4(0.0, 1.0, 1.0, 1.0), "Grid Noise Benchmark");
+	if(ImGui::Button("Run Benchmark"))
+		runGridBenchmark = true;
+	for(GLuint i = 0; i < gridBenchmarkResults.size(); i++)
+		ImGui::Text("%s", gridBenchmarkResults[i].c_str());
 	ImGui::End();
 }
 
@@ -1124,21 +1764,22 @@ void AubioInitialize(string musicPath)
 	tout = new_fvec(1);
 	tempo = new_aubio_tempo("default", win_s, hop_s, samplerate);
 	
-	bandsBuffer.assign(8, 0.0);
-	bufferDecrease.assign(8, 0.0);
+	bandsBuffer.assign(frequencyBandCount, 0.0);
+	bufferDecrease.assign(frequencyBandCount, 0.0);
 	
 	if(!fft || !tempo)
 		AubioReset(false);
 }
 
-void AubioCompute(GLfloat deltaTime, PowerUp pwUps[])
+void AubioCompute(GLfloat deltaTime, Simulation &simulation)
 {
+	CPU_ZONE("AubioCompute");
 	// Taking time and frame relationship into account in order to compute FFT in real time.
 	uint_t framesRead = 0;
 	int n_frames = 0;
 	int passedFrames = deltaTime * (int)samplerate - remainingFrames;
 	
-	frequencyBands.assign(8, 0.0);
+	frequencyBands.assign(frequencyBandCount, 0.0);
 	
 	// iterate through all the passing frames
 	while(n_frames < passedFrames){
@@ -1152,12 +1793,9 @@ void AubioCompute(GLfloat deltaTime, PowerUp pwUps[])
 		FrequencyBandsNormalize();
 		CreateBandsBuffer();
 		
-		if(tout->data[0] != 0){
-			tempoSpawn++;
-			if(tempoSpawn > pwAmount)
-				tempoSpawn = 0;
-			pwUps[tempoSpawn-1].spawning = true;
-		}
+		// each beat spawns a powerup (see Simulation::Beat)
+		if(tout->data[0] != 0)
+			simulation.Beat();
 		
 		// check if too much frames are read...
 		if(framesRead != hop_s)
@@ -1171,13 +1809,14 @@ void AubioCompute(GLfloat deltaTime, PowerUp pwUps[])
 
 void MergeFrequencyBands()
 {
+	CPU_ZONE("MergeFrequencyBands");
 	int count = 0;
 	float frequency;
 	
-	for(int i = 0; i < 8; i++){
+	for(int i = 0; i < frequencyBandCount; i++){
 		float average = 0;
 		int sampleCount = (int)pow(2, i) * 2;
-		if(i == 7)
+		if(i == frequencyBandCount - 1)
 			sampleCount += 2;
 		for(int j = 0; j < sampleCount; j++){
 			average += fftout->norm[count] * (count + 1);
@@ -1203,7 +1842,7 @@ void FrequencyBandsNormalize()
 // In case the next frequency is higher, the buffer will just spike up.
 void CreateBandsBuffer()
 {
-	for(int i = 0; i < 8; i++){
+	for(int i = 0; i < frequencyBandCount; i++){
 		if(frequencyBands[i] > bandsBuffer[i]){
 			bandsBuffer[i] = frequencyBands[i];
 			bufferDecrease[i] = abs(bufferDecreaseAmount);
@@ -1230,20 +1869,298 @@ void AubioReset(bool ffttcheck)
 
 void PlayMusic(string musicPath)
 {
+	if(!soundEngine)
+		return;
 	soundEngine->stopAllSounds();
 	soundEngine->play2D(musicPath.c_str(), true);
 }
 
-bool CheckCollision(PowerUp pwUp, Car car){
-	glm::vec3 aabb_half_extents(car.size.x / 2.0f, car.size.y / 2.0f, car.size.z / 2.0f);
-	// Distance vector between AABB and Sphere centers
-	glm::vec3 difference = pwUp.position - car.position;
-	// clamped vector used to get the AABB's closest point to the sphere
-	glm::vec3 clamped = glm::clamp(difference, -aabb_half_extents, aabb_half_extents);
-	// Position of the AABB's closest point to the sphere
-	glm::vec3 closest = car.position + clamped;
-	// the new distance vector between AABB's closest point and the Sphere's center
-	difference = closest - pwUp.position;
-	// Collision check
-	return glm::length(difference) < pwUp.radius;
+void ChangeMusic(string path)
+{
+	musicPath = path;
+	AubioReset(true);
+	lastFrame = 0;
+	remainingFrames = 0;
+	musicStartTime = AppTime();
+	AubioInitialize(musicPath);
+	PlayMusic(musicPath);
+	// the audio analysis drives the powerups: a replay must restart the same track at the same frame
+	if(inputRecorder.IsOpen())
+		inputRecorder.RecordMusic(musicPath, HashFile(musicPath));
+}
+
+// The simulation runs at its fixed rate, fed with frames of 1/60 s and with the autopilot, as fast as possible
+int SimulationSpeedRun(GLfloat seconds, JobSystem &jobs)
+{
+	GLfloat frameTime = 1.0f / 60.0f;
+	GLuint frames = (GLuint)(seconds / frameTime);
+	GLuint hits = 0, speedUps = 0;
+	
+	AubioInitialize(musicPath);
+	Simulation simulation(palmAmount, pwAmount, sphereScale, carScale, gridScrollSpeed, streetBorder, simulationRate, randomSeed);
+	simulation.jobs = &jobs;
+	SimulationInput input;
+	input.left = input.right = false;
+	input.autopilot = true;
+	
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for(GLuint f = 0; f < frames; f++){
+		AubioCompute(frameTime, simulation);
+		simulation.Advance(frameTime, input);
+		for(GLuint e = 0; e < simulation.events.size(); e++){
+			hits++;
+			if(simulation.events[e].speedUp)
+				speedUps++;
+		}
+	}
+	GLfloat elapsed = chrono::duration<GLfloat>(chrono::steady_clock::now() - start).count();
+	AubioReset(true);
+	
+	cout << "Simulated " << simulation.current.time << " s (" << simulation.stepCount << " steps at " << simulationRate << " Hz) in " << elapsed << " s" << endl;
+	cout << "Powerups hit: " << hits << " (" << speedUps << " speed up), final scroll speed " << simulation.current.scrollSpeed << endl;
+	cout << "Beats queued at the end: " << simulation.pool.queuedBeats << ", dropped: " << simulation.pool.droppedBeats << endl;
+	return 0;
+}
+
+// Each kernel runs on the same data with the SSE2 path and with the scalar one (and the powerups also split between the workers): times are per step, and the results of all the paths must be identical
+int EntityBenchmark(JobSystem &jobs)
+{
+	GLuint sizes[] = {100, 10000, 1000000};
+	GLuint steps = 200;
+	GLfloat dt = 1.0f / simulationRate;
+	GLfloat translationSpeed = gridScrollSpeed * 0.505f;
+	Random random(randomSeed);
+	
+#ifdef ENTITY_SIMD
+	cout << "Entity kernels: SSE2 enabled" << endl;
+#else
+	cout << "Entity kernels: SSE2 not available, both paths are scalar" << endl;
+#endif
+	for(GLuint s = 0; s < 3; s++){
+		GLuint n = sizes[s];
+		PowerUpStore simd;
+		simd.Resize(n);
+		for(GLuint i = 0; i < n; i++){
+			simd.x[i] = (GLfloat)(random.Range(11) - 5);
+			simd.z[i] = -70.0f - random.Range(31);
+			simd.outlineScale[i] = 5.0f;
+			// one powerup out of 4 is waiting for a beat
+			simd.flags[i] = (i % 4 == 0 ? 0 : POWERUP_SPAWNING) | (i % 2 == 0 ? POWERUP_SPEEDUP : 0);
+		}
+		PowerUpStore scalar = simd;
+		PowerUpStore parallel = simd;
+		vector<GLfloat> palmSIMD(simd.z), palmScalar(simd.z);
+		vector<GLuint> passed;
+		passed.reserve(n);
+		
+		// powerups: scroll and spawning animation, then search of the powerups to respawn
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < steps; k++){
+			simd.Advance(translationSpeed * dt, dt * (gridScrollSpeed * 0.05f), 1.05f);
+			passed.clear();
+			simd.FindPassed(30.0f, passed);
+		}
+		GLfloat simdMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count() / steps;
+		
+		GLuint passedSIMD = passed.size();
+		start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < steps; k++){
+			scalar.AdvanceScalar(translationSpeed * dt, dt * (gridScrollSpeed * 0.05f), 1.05f, 0, n);
+			passed.clear();
+			for(GLuint i = 0; i < n; i++)
+				if(scalar.Is(i, POWERUP_SPAWNING) && scalar.z[i] > 30.0f)
+					passed.push_back(i);
+		}
+		GLfloat scalarMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count() / steps;
+		GLuint passedScalar = passed.size();
+		
+		// the same SSE2 kernel on ranges of 16k powerups, executed by the workers
+		start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < steps; k++){
+			jobs.Wait(jobs.ParallelFor("PowerUp update", n, 16384, [&](GLuint first, GLuint last){
+				parallel.Advance(translationSpeed * dt, dt * (gridScrollSpeed * 0.05f), 1.05f, first, last);
+			}));
+			passed.clear();
+			parallel.FindPassed(30.0f, passed);
+		}
+		GLfloat jobsMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count() / steps;
+		
+		// palms: scroll and wrap
+		start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < steps; k++)
+			ScrollAndWrap(&palmSIMD[0], n, translationSpeed * dt, 25.0f, -75.0f);
+		GLfloat palmSIMDMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count() / steps;
+		start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < steps; k++){
+			for(GLuint i = 0; i < n; i++){
+				palmScalar[i] += translationSpeed * dt;
+				if(palmScalar[i] > 25.0f)
+					palmScalar[i] = -75.0f;
+			}
+		}
+		GLfloat palmScalarMs = chrono::duration<GLfloat, milli>(chrono::steady_clock::now() - start).count() / steps;
+		
+		bool same = passedSIMD == passedScalar && passedSIMD == passed.size() && simd.z == scalar.z && simd.outlineScale == scalar.outlineScale && simd.flags == scalar.flags && palmSIMD == palmScalar
+			&& simd.z == parallel.z && simd.outlineScale == parallel.outlineScale && simd.flags == parallel.flags;
+		cout << n << " entities: powerups " << simdMs << " ms (scalar " << scalarMs << " ms, " << jobs.Workers() << " workers " << jobsMs << " ms), palms " << palmSIMDMs << " ms (scalar " << palmScalarMs << " ms)"
+			 << (same ? "" : " ERROR: results differ") << endl;
+		
+		// collisions: the powerups have the density of the game (one every 1.25 units along Z), so a longer street for more powerups
+		PowerUpStore field;
+		field.Resize(n);
+		field.radius = sphereScale;
+		ZBroadphase broadphase;
+		vector<GLuint> all(n), candidates, hits;
+		for(GLuint i = 0; i < n; i++){
+			field.x[i] = (GLfloat)(random.Range(9) - 4);
+			field.z[i] = -(GLfloat)(n - i) * 1.25f;
+			field.flags[i] = POWERUP_SPAWNING | POWERUP_SPAWNED;
+			broadphase.Insert(field, i);
+			all[i] = i;
+		}
+		glm::vec3 carSize(1.4f * carScale, 1.2f * carScale, 4.3f * carScale);
+		glm::vec3 halfExtents = carSize / 2.0f;
+		GLuint queries = 1000;
+		GLuint linearHits = 0, broadphaseHits = 0;
+		start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < queries; k++){
+			glm::vec3 carPosition(sin(k * 0.1f) * 4.0f, 0.0f, field.z[(k * 7919) % n]);
+			hits.clear();
+			NarrowPhase(field, all, carPosition, halfExtents, hits);
+			linearHits += hits.size();
+		}
+		GLfloat linearUs = chrono::duration<GLfloat, micro>(chrono::steady_clock::now() - start).count() / queries;
+		start = chrono::steady_clock::now();
+		for(GLuint k = 0; k < queries; k++){
+			glm::vec3 carPosition(sin(k * 0.1f) * 4.0f, 0.0f, field.z[(k * 7919) % n]);
+			candidates.clear();
+			broadphase.Query(field, carPosition.z - halfExtents.z - field.radius, carPosition.z + halfExtents.z + field.radius, candidates);
+			hits.clear();
+			NarrowPhase(field, candidates, carPosition, halfExtents, hits);
+			broadphaseHits += hits.size();
+		}
+		GLfloat broadphaseUs = chrono::duration<GLfloat, micro>(chrono::steady_clock::now() - start).count() / queries;
+		cout << n << " entities: collisions " << broadphaseUs << " us with broadphase (linear scan " << linearUs << " us)"
+			 << (linearHits == broadphaseHits ? "" : " ERROR: hits differ") << endl;
+	}
+	return 0;
+}
+
+// Planes from the rows of the view-projection matrix (Gribb and Hartmann): a point is inside if dot(plane, (p, 1)) >= 0 for all the planes
+void FrustumPlanes(const glm::mat4 &viewProjection, glm::vec4 planes[6])
+{
+	// GLM matrices are column major: row r is (m[0][r], m[1][r], m[2][r], m[3][r])
+	glm::vec4 rows[4];
+	for(int r = 0; r < 4; r++)
+		rows[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	// normalized, so that the distance can be compared with the radius
+	for(int p = 0; p < 6; p++)
+		planes[p] /= glm::length(glm::vec3(planes[p]));
+}
+
+bool SphereInFrustum(const glm::vec4 planes[6], const glm::vec3 &center, GLfloat radius)
+{
+	for(int p = 0; p < 6; p++)
+		if(glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius)
+			return false;
+	return true;
+}
+
+// We set the uniforms shared by the grid shaders: FFTDisplacement.vert, FFTDisplacementFBM.vert, terrainUpdate.vert and terrainRender.vert (with neonGrid.frag)
+void SetGridUniforms(Shader &shader, glm::mat4 &projection, glm::mat4 &view)
+{
+	shader.UniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(projection));
+	shader.UniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(view));
+	
+	// animation and music uniforms
+	shader.Uniform1fv("frequencyBands", bandsBuffer.size(), &bandsBuffer[0]);
+	shader.Uniform1f("time", AppTime());
+	shader.Uniform1f("scrollSpeed", gridScrollSpeed);
+	shader.Uniform1f("zoom", gridNoiseZoom);
+	shader.Uniform1f("dPower", gridDisplacementPower);
+	shader.Uniform1f("streetSize", streetSize);
+	shader.Uniform1f("fade", fadeAfterStreet);
+	// lighting uniforms
+	shader.Uniform3fv("pointLightPosition", 1, glm::value_ptr(lightPosition));
+	shader.Uniform3fv("diffuseColor", 1, diffuseColor);
+	shader.Uniform3fv("specularColor", 1, specularColor);
+	shader.Uniform3fv("ambientColor", 1, ambientColor);
+	shader.Uniform1f("Kd", diffuse);
+	shader.Uniform1f("Ks", specular);
+	shader.Uniform1f("Ka", ambient);
+	shader.Uniform1f("constant", constant);
+	shader.Uniform1f("linear", linear);
+	shader.Uniform1f("quadratic", quadratic);
+	shader.Uniform1f("shininess", shininess);
+}
+
+// We measure only the vertex stage: rasterization is disabled, so fragments are never generated.
+// Each grid is drawn several times inside a GL_TIME_ELAPSED query, with the per-vertex fbm shader and with the baked noise shader.
+void GridNoiseBenchmark(Shader &gridShader, GridNoise &gridNoise, glm::mat4 projection, glm::mat4 view)
+{
+	const GLuint resolutions[] = {100, 250, 500, 750, 1000};
+	const int drawsPerSample = 20;
+	
+	// the reference shader is compiled only for the benchmark
+	Shader fbmShader("FFTDisplacementFBM.vert", "neonGrid.frag");
+	Shader* benchShaders[2] = {&fbmShader, &gridShader};
+	
+	glm::mat4 model;
+	model = glm::translate(model, glm::vec3(0.0f, -0.5f, 0.0f));
+	model = glm::scale(model, glm::vec3(gridSize, 1.0f, gridSize));
+	glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(view * model));
+	
+	GLuint query;
+	glGenQueries(1, &query);
+	glState.Enable(GL_RASTERIZER_DISCARD);
+	
+	gridBenchmarkResults.clear();
+	cout << "Grid vertex stage benchmark (" << drawsPerSample << " draws for each sample)" << endl;
+	for(GLuint r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++){
+		Mesh grid = CreateGridMesh(resolutions[r], 500.0f);
+		GLuint64 elapsed[2];
+		
+		for(int s = 0; s < 2; s++){
+			benchShaders[s]->Use();
+			SetGridUniforms(*benchShaders[s], projection, view);
+			benchShaders[s]->UniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(model));
+			benchShaders[s]->UniformMatrix3fv("normalMatrix", 1, GL_FALSE, glm::value_ptr(normalMatrix));
+			gridNoise.Bind(*benchShaders[s], 1);
+			// a first draw out of the query, to avoid measuring lazy driver work
+			grid.Draw(*benchShaders[s]);
+			
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			for(int i = 0; i < drawsPerSample; i++)
+				grid.Draw(*benchShaders[s]);
+			glEndQuery(GL_TIME_ELAPSED);
+			// N.B.) waiting for the result stalls the pipeline, it is acceptable only in a benchmark
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed[s]);
+		}
+		grid.Delete();
+		
+		double fbmMs = elapsed[0] / (1000000.0 * drawsPerSample);
+		double bakedMs = elapsed[1] / (1000000.0 * drawsPerSample);
+		char line[128];
+		snprintf(line, sizeof(line), "%4ux%-4u  fbm %.3f ms  baked %.3f ms  (x%.1f)", resolutions[r], resolutions[r], fbmMs, bakedMs, fbmMs / bakedMs);
+		gridBenchmarkResults.push_back(string(line));
+		cout << line << endl;
+	}
+	
+	glState.Disable(GL_RASTERIZER_DISCARD);
+	glDeleteQueries(1, &query);
+	fbmShader.Delete();
+}
+
+// In benchmark mode the time advances by a fixed step at each frame, so runs are reproducible
+double AppTime()
+{
+	if(benchmarkMode)
+		return benchmarkFrame * (double)benchmarkTimestep;
+	return glfwGetTime();
 }
@@ -0,0 +1,28 @@
+// Frequency bands of the audio analysis, shared by the grid shaders.
+// The [0, 1] range of a coordinate is divided in BAND_COUNT zones, one for each band: each zone blends its band with the next one (the last one with the first).
+// BAND_COUNT is defined by the application (see ShaderDefines), so the zone is found with arithmetic instead of a chain of branches.
+
+#ifndef BAND_COUNT
+#define BAND_COUNT 8
+#endif
+
+// values of the frequency bands
+uniform float frequencyBands[BAND_COUNT];
+
+// zone of v: the two bands to blend, and the weight of the second one
+void BandZone(float v, out int first, out int second, out float weight)
+{
+	float zone = clamp(v, 0.0, 1.0) * float(BAND_COUNT);
+	first = min(int(zone), BAND_COUNT - 1);
+	second = (first + 1) % BAND_COUNT;
+	weight = zone - float(first);
+}
+
+// value of the frequency bands at v
+float BandValue(float v)
+{
+	int first, second;
+	float weight;
+	BandZone(v, first, second, weight);
+	return mix(frequencyBands[first], frequencyBands[second], weight);
+}
@@ -0,0 +1,57 @@
+// Blinn-Phong illumination model with a single attenuated point light, shared by palm.frag and neonGrid.frag.
+// N.B.) the vertex shader computes the light incidence direction and the view position in view coordinates (see 13_phong.vert)
+
+// ambient, diffusive and specular components (passed from the application)
+uniform vec3 ambientColor;
+uniform vec3 diffuseColor;
+uniform vec3 specularColor;
+// weight of the components
+uniform float Ka;
+uniform float Kd;
+uniform float Ks;
+// attenuation parameters
+uniform float constant;
+uniform float linear;
+uniform float quadratic;
+// shininess coefficient
+uniform float shininess;
+
+// N: normalized normal, lightDirection: vector from the fragment to the light, viewPosition: vector from the fragment to the camera
+vec3 BlinnPhong(vec3 N, vec3 lightDirection, vec3 viewPosition)
+{
+    // ambient component can be calculated at the beginning
+    vec3 color = Ka*ambientColor;
+
+    // we take the distance from the light source (before normalization, for the attenuation parameter)
+    float distanceL = length(lightDirection);
+    // normalization of the per-fragment light incidence direction
+    vec3 L = normalize(lightDirection);
+
+    // we calculate the attenuation factor (based on the distance from light source)
+    float attenuation = 1.0/(constant + linear*distanceL + quadratic*(distanceL*distanceL));
+
+    // Lambert coefficient
+    float lambertian = max(dot(L,N), 0.0);
+
+    // if the lambert coefficient is positive, then I can calculate the specular component
+    if(lambertian > 0.0)
+    {
+        // the view vector has been calculated in the vertex shader, already negated to have direction from the mesh to the camera
+        vec3 V = normalize(viewPosition);
+
+        // in the Blinn-Phong model we do not use the reflection vector, but the half vector
+        vec3 H = normalize(L + V);
+
+        // we use H to calculate the specular component
+        float specAngle = max(dot(H, N), 0.0);
+        // shininess application to the specular component
+        float specular = pow(specAngle, shininess);
+
+        // We add diffusive and specular components to the final color
+        // N.B. ): in this implementtion, the sum of the components can be different than 1
+        color += vec3( Kd * lambertian * diffuseColor +
+                        Ks * specular * specularColor);
+        color*=attenuation;
+    }
+    return color;
+}
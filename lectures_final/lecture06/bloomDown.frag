@@ -0,0 +1,48 @@
+#version 330 core
+
+// Downsample of the dual filter bloom (see Bloom class): each output pixel covers 4x4 texels of the source with bilinear taps
+// Permutations (see ShaderDefines):
+// TAPS: 4 samples only the 4 diagonal taps; 8 adds the center tap (weight 4), like the original dual filter
+#ifndef TAPS
+#define TAPS 8
+#endif
+
+in vec2 interp_UV;
+
+out vec4 fragColor;
+
+// previous level (the HDR scene for the first downsample)
+uniform sampler2D source;
+// size of a texel of the source
+uniform vec2 texelSize;
+// the first downsample keeps only the bright part of the scene
+uniform bool prefilter;
+// brightness where the bloom starts, and width of the soft transition around it
+uniform float threshold;
+uniform float knee;
+
+// soft threshold: the contribution grows quadratically in [threshold - knee, threshold + knee], then linearly
+vec3 Prefilter(vec3 color)
+{
+	float brightness = max(color.r, max(color.g, color.b));
+	float soft = clamp(brightness - threshold + knee, 0.0, 2.0 * knee);
+	soft = soft * soft / (4.0 * knee + 0.0001);
+	return color * max(soft, brightness - threshold) / max(brightness, 0.0001);
+}
+
+void main()
+{
+	// the diagonal taps are on the corners between 4 texels: each one is the average of 4 texels
+	vec3 sum = texture(source, interp_UV + vec2(-texelSize.x, -texelSize.y)).rgb;
+	sum += texture(source, interp_UV + vec2(texelSize.x, -texelSize.y)).rgb;
+	sum += texture(source, interp_UV + vec2(-texelSize.x, texelSize.y)).rgb;
+	sum += texture(source, interp_UV + vec2(texelSize.x, texelSize.y)).rgb;
+#if TAPS == 8
+	vec3 color = (sum + texture(source, interp_UV).rgb * 4.0) / 8.0;
+#else
+	vec3 color = sum * 0.25;
+#endif
+	if(prefilter)
+		color = Prefilter(color);
+	fragColor = vec4(color, 1.0);
+}
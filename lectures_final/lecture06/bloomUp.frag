@@ -0,0 +1,36 @@
+#version 330 core
+
+// Upsample of the dual filter bloom (see Bloom class): tent filter over the texels of the lower level
+// Permutations (see ShaderDefines):
+// TAPS: 4 samples the 4 diagonal taps; 8 adds 4 taps along the axes, one texel away, like the original dual filter
+#ifndef TAPS
+#define TAPS 8
+#endif
+
+in vec2 interp_UV;
+
+out vec4 fragColor;
+
+// lower level of the chain
+uniform sampler2D source;
+// size of a texel of the source
+uniform vec2 texelSize;
+
+void main()
+{
+	vec2 halfTexel = texelSize * 0.5;
+	vec3 diagonal = texture(source, interp_UV + vec2(-halfTexel.x, -halfTexel.y)).rgb;
+	diagonal += texture(source, interp_UV + vec2(halfTexel.x, -halfTexel.y)).rgb;
+	diagonal += texture(source, interp_UV + vec2(-halfTexel.x, halfTexel.y)).rgb;
+	diagonal += texture(source, interp_UV + vec2(halfTexel.x, halfTexel.y)).rgb;
+#if TAPS == 8
+	vec3 axes = texture(source, interp_UV + vec2(-texelSize.x, 0.0)).rgb;
+	axes += texture(source, interp_UV + vec2(texelSize.x, 0.0)).rgb;
+	axes += texture(source, interp_UV + vec2(0.0, -texelSize.y)).rgb;
+	axes += texture(source, interp_UV + vec2(0.0, texelSize.y)).rgb;
+	vec3 color = (diagonal * 2.0 + axes) / 12.0;
+#else
+	vec3 color = diagonal * 0.25;
+#endif
+	fragColor = vec4(color, 1.0);
+}
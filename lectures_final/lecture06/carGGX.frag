@@ -14,7 +14,11 @@ Universita' degli Studi di Milano
 
 #version 330 core
 
-const float PI = 3.14159265359;
+// Permutations (see ShaderDefines):
+// QUALITY: 0 drops the GGX specular component (Lambert only)
+#ifndef QUALITY
+#define QUALITY 2
+#endif
 
 // output shader variable
 out vec4 colorFrag;
@@ -35,18 +39,8 @@ uniform vec3 specularColor;
 uniform int blink;
 uniform float time;
 
-float G1(float angle, float alpha)
-{
-    // in case of Image Based Lighting, the k factor is different:
-    // usually it is set as k=(alpha*alpha)/2
-    float r = (alpha + 1.0);
-    float k = (r*r) / 8.0;
-
-    float num   = angle;
-    float denom = angle * (1.0 - k) + k;
-
-    return num / denom;
-}
+// GGX specular component (GGXSpecular), and PI
+#include "ggx.glsl"
 
 void main()
 {
@@ -64,40 +58,16 @@ void main()
     // we initialize the specular component
     vec3 specular = vec3(0.0);
 
+#if QUALITY > 0
     // if the cosine of the angle between direction of light and normal is positive, then I can calculate the specular component
     if(NdotL > 0.0)
     {
         // the view vector has been calculated in the vertex shader, already negated to have direction from the mesh to the camera
         vec3 V = normalize( vViewPosition );
 
-        // half vector
-        vec3 H = normalize(L + V);
-
-        // we implement the components seen in the slides for a PBR BRDF
-        // we calculate the cosines and parameters to be used in the different components
-        float NdotH = max(dot(N, H), 0.0);
-        float NdotV = max(dot(N, V), 0.0);
-        float VdotH = max(dot(V, H), 0.0);
-        float alpha_Squared = alpha * alpha;
-        float NdotH_Squared = NdotH * NdotH;
-
-        // Geometric factor G2
-        float G2 = G1(NdotV, alpha)*G1(NdotL, alpha);
-
-        // Rugosity D
-        // GGX Distribution
-        float D = alpha_Squared;
-        float denom = (NdotH_Squared*(alpha_Squared-1.0)+1.0);
-        D /= PI*denom*denom;
-
-        // Fresnel reflectance F (approx Schlick)
-        vec3 F = vec3(pow(1.0 - VdotH, 5.0));
-        F *= (1.0 - F0);
-        F += F0;
-
-        // we put everything together for the specular component
-        specular = (F * G2 * D) / (4.0 * NdotV * NdotL);
+        specular = GGXSpecular(N, L, V, NdotL, alpha, F0);
     }
+#endif
 	
 	vec3 startingColor = specularColor;
 	vec3 actualSColor = specularColor;
@@ -0,0 +1,26 @@
+#version 330 core
+
+// Explosion particles: round spots flickering with the color of the powerup (green for speed up, red for speed down), blended additively
+
+uniform float u_time;
+
+in vec2 quadUV;
+in float life;
+in float particleKind;
+in float particleSeed;
+
+out vec4 fragColor;
+
+void main()
+{
+    float distance = length(quadUV);
+    if(distance > 1.0)
+        discard;
+
+    // same flickering of powerUp.frag for the exploding powerups
+    float flickerSpeed = 100.0;
+    float flicker = abs(sin(u_time * particleSeed * flickerSpeed));
+    vec3 color = particleKind > 0.0 ? vec3(0.0, flicker, 0.0) : vec3(flicker, 0.0, 0.0);
+
+    fragColor = vec4(color, life * (1.0 - distance));
+}
@@ -0,0 +1,54 @@
+#version 330 core
+
+// Explosion particles of the powerups (see include/utils/particles.h): one camera-facing quad for each instance.
+// Particles have no state: position, size and fading are computed from the time since the explosion
+
+// corner of the quad, in [-1, 1]
+layout (location = 0) in vec2 corner;
+// per explosion: center (xyz) and time since the explosion (w)
+layout (location = 1) in vec4 explosion;
+// per explosion: 1 for a speed up powerup, -1 for a speed down one
+layout (location = 2) in float kind;
+
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+
+uniform int particlesPerExplosion;
+uniform float lifetime;
+uniform float speed;
+uniform float size;
+
+out vec2 quadUV;
+out float life;
+out float particleKind;
+out float particleSeed;
+
+float hash(float n)
+{
+    return fract(sin(n) * 43758.5453);
+}
+
+void main()
+{
+    // index of the particle inside its explosion
+    int id = gl_InstanceID % particlesPerExplosion;
+
+    // directions evenly distributed on the sphere (Fibonacci lattice)
+    float y = 1.0 - 2.0 * (float(id) + 0.5) / float(particlesPerExplosion);
+    float radius = sqrt(1.0 - y * y);
+    float phi = float(id) * 2.39996323;
+    vec3 direction = vec3(cos(phi) * radius, y, sin(phi) * radius);
+
+    float t = explosion.w;
+    life = clamp(1.0 - t / lifetime, 0.0, 1.0);
+    particleSeed = hash(float(id));
+    vec3 center = explosion.xyz + direction * speed * (0.5 + particleSeed) * t;
+
+    // the quad is expanded in view space, so it always faces the camera, and it shrinks while fading
+    vec4 viewCenter = viewMatrix * vec4(center, 1.0);
+    viewCenter.xy += corner * size * (0.5 + life);
+    gl_Position = projectionMatrix * viewCenter;
+
+    quadUV = corner;
+    particleKind = kind;
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// The output variable for UV coordinates, going from (0,0) to (1,1) on the screen
+out vec2 interp_UV;
+
+// A single triangle covering the whole viewport is generated from gl_VertexID,
+// so no vertex buffer is needed (an empty VAO must be bound anyway).
+void main()
+{
+	vec2 vertex = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	interp_UV = vertex;
+	gl_Position = vec4(vertex * 2.0 - 1.0, 0.0, 1.0);
+}
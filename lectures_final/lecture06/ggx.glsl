@@ -0,0 +1,48 @@
+// Specular component of the GGX microfacet model (Cook-Torrance BRDF with GGX distribution, Smith-Schlick geometric factor and Schlick fresnel).
+
+const float PI = 3.14159265359;
+
+float G1(float angle, float alpha)
+{
+    // in case of Image Based Lighting, the k factor is different:
+    // usually it is set as k=(alpha*alpha)/2
+    float r = (alpha + 1.0);
+    float k = (r*r) / 8.0;
+
+    float num   = angle;
+    float denom = angle * (1.0 - k) + k;
+
+    return num / denom;
+}
+
+// N, L, V: normalized normal, light incidence and view directions. alpha: rugosity, F0: fresnel reflectance at normal incidence
+// N.B.) NdotL must be positive
+vec3 GGXSpecular(vec3 N, vec3 L, vec3 V, float NdotL, float alpha, float F0)
+{
+    // half vector
+    vec3 H = normalize(L + V);
+
+    // we calculate the cosines and parameters to be used in the different components
+    float NdotH = max(dot(N, H), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+    float VdotH = max(dot(V, H), 0.0);
+    float alpha_Squared = alpha * alpha;
+    float NdotH_Squared = NdotH * NdotH;
+
+    // Geometric factor G2
+    float G2 = G1(NdotV, alpha)*G1(NdotL, alpha);
+
+    // Rugosity D
+    // GGX Distribution
+    float D = alpha_Squared;
+    float denom = (NdotH_Squared*(alpha_Squared-1.0)+1.0);
+    D /= PI*denom*denom;
+
+    // Fresnel reflectance F (approx Schlick)
+    vec3 F = vec3(pow(1.0 - VdotH, 5.0));
+    F *= (1.0 - F0);
+    F += F0;
+
+    // we put everything together for the specular component
+    return (F * G2 * D) / (4.0 * NdotV * NdotL);
+}
@@ -0,0 +1,39 @@
+#version 330 core
+
+// UV coordinates of the texel, (0,0) to (1,1) on the whole texture
+in vec2 interp_UV;
+
+// baked noise value (R32F texture)
+out float noiseValue;
+
+// The amount of zoom applied to the UV coordinates is used to "zoom" in/out the noise
+uniform float zoom;
+// region of the noise field covered by the texture, in grid UV units
+uniform vec2 origin;
+uniform vec2 extent;
+// texture size in texels
+uniform vec2 resolution;
+// tileable textures are cross-faded along V, otherwise the border texels lie exactly on the region edges
+uniform bool tileable;
+
+// rand, noise and fbm (the same of FFTDisplacementFBM.vert)
+#include "noise.glsl"
+
+void main()
+{
+	if(tileable){
+		// position in grid UV space, sampled at the texel centers
+		vec2 noisePos = (origin + interp_UV * extent) * zoom;
+		
+		// we cross-fade with the field one period behind: at the top edge of the texture we get
+		// the same values of the bottom edge, so the texture can be repeated along V without seams
+		float behind = fbm(noisePos - vec2(0.0, extent.y * zoom));
+		noiseValue = mix(fbm(noisePos), behind, interp_UV.y);
+	}
+	else{
+		// the first and last texels are placed on the region edges, so that adjacent regions
+		// (e.g. two terrain chunks) have the same values on the shared border
+		vec2 texel = (gl_FragCoord.xy - 0.5) / (resolution - 1.0);
+		noiseValue = fbm((origin + texel * extent) * zoom);
+	}
+}
@@ -85,6 +85,7 @@ PostBuild:
 	copy ..\..\libs\win\*.dll .\Debug
 	copy *.vert Debug
 	copy *.frag Debug
+	copy *.glsl Debug
 	@echo Done
 
 MakeIntermediateDirs:
@@ -1,5 +1,15 @@
 #version 330
 
+// Permutations (see ShaderDefines):
+// QUALITY: 2 uses the face normals (derivatives), lower levels the interpolated vertex normals
+// SHOW_BANDS: 1 shows the zones of the frequency bands instead of the grid
+#ifndef QUALITY
+#define QUALITY 2
+#endif
+#ifndef SHOW_BANDS
+#define SHOW_BANDS 0
+#endif
+
 in vec2 interp_UV;
 
 in vec3 lightDir;
@@ -9,20 +19,8 @@ in vec3 vPosition;
 
 out vec4 outColor;
 
-// lighting components color
-uniform vec3 diffuseColor;
-uniform vec3 specularColor;
-uniform vec3 ambientColor;
-// weights
-uniform float Kd;
-uniform float Ks;
-uniform float Ka;
-// attenuation parameters
-uniform float constant;
-uniform float linear;
-uniform float quadratic;
-// shininess coefficient
-uniform float shininess;
+// Blinn-Phong lighting (material uniforms and BlinnPhong)
+#include "blinnphong.glsl"
 
 const vec3 gridColor = vec3(1.0, 0.0, 1.0);
 const float edgeThickness = 2.1;
@@ -34,44 +32,25 @@ const float gridZoom = 99.0;
 
 uniform float streetSize;
 uniform float fade;
-uniform float frequencyBands[];
 
-vec3 deepBass;
-vec3 bass;
-vec3 mediumBass;
-vec3 medium;
-vec3 mediumHigh;
-vec3 high;
-vec3 veryHigh;
-vec3 highest;
+#if SHOW_BANDS
+// frequency band zones (BandZone)
+#include "bands.glsl"
+
+// debug view of the zones relative to the frequency bands: one hue for each band, from red to blue, blended like the displacement
+vec3 BandColor(int band)
+{
+	float hue = float(band) / float(BAND_COUNT) * 0.66;
+	return clamp(abs(mod(hue * 6.0 + vec3(0.0, 4.0, 2.0), 6.0) - 3.0) - 1.0, 0.0, 1.0);
+}
 
-// method to visualize the eight zones relative to the eight frequency bands
 vec3 BandsColor(){
-    if(interp_UV.y <= 0.125){
-        return mix(deepBass, bass, interp_UV.y / 0.125);
-    }
-    if(interp_UV.y <= 0.25){
-        return mix(bass, mediumBass, (interp_UV.y - 0.125) / 0.125);
-    }
-    if(interp_UV.y <= 0.375){
-        return mix(mediumBass, medium, (interp_UV.y - 0.25) / 0.125);
-    }
-    if(interp_UV.y <= 0.5){
-        return mix(medium, mediumHigh, (interp_UV.y - 0.375) / 0.125);
-    }
-    if(interp_UV.y <= 0.625){
-        return mix(mediumHigh, high, (interp_UV.y - 0.5) / 0.125);
-    }
-    if(interp_UV.y <= 0.75){
-        return mix(high, veryHigh, (interp_UV.y - 0.625) / 0.125);
-    }
-    if(interp_UV.y <= 0.875){
-        return mix(veryHigh, highest, (interp_UV.y - 0.75) / 0.125);
-    }
-	if(interp_UV.y <= 1.0){
-		return mix(highest, deepBass, (interp_UV.y - 0.875) / 0.125);
-	}
+	int first, second;
+	float weight;
+	BandZone(interp_UV.y, first, second, weight);
+	return mix(BandColor(first), BandColor(second), weight);
 }
+#endif
 
 vec3 Grid(){
 	vec2 st = vec2(interp_UV * gridZoom);
@@ -85,41 +64,17 @@ vec3 Grid(){
 
 void main() 
 {
-	vec3 bgColor = Ka * ambientColor;
-	
-	//vec3 fNorm = normalize(vNormal);
+#if QUALITY >= 2
+	// faceted look: normal of the triangle, from the derivatives of the position
 	vec3 fNorm = normalize(cross(dFdx(vViewPosition), dFdy(vViewPosition)));
-	float lightDistance = length(lightDir.xyz);
-	vec3 lightIncidence = normalize(lightDir.xyz);
-	
-	float attenuation = 1.0 / (constant + linear * lightDistance + quadratic * (lightDistance*lightDistance));
+#else
+	vec3 fNorm = normalize(vNormal);
+#endif
+	vec3 bgColor = BlinnPhong(fNorm, lightDir, vViewPosition);
 	
-	float lambert = max(dot(lightIncidence, fNorm), 0.0);
-	
-	if(lambert > 0.0)
-	{
-		vec3 viewVector = normalize(vViewPosition);
-		vec3 halfVector = normalize(lightIncidence + viewVector);
-		
-		float specAngle = max(dot(halfVector, fNorm), 0.0);
-		// compute the shininess
-		float shine = pow(specAngle, shininess);
-		// apply diffusive, specular and shininess components to the final color
-		bgColor += vec3(Kd * lambert * diffuseColor + Ks * shine * specularColor);
-		bgColor *= attenuation;
-	}
-	
-   	outColor = vec4(bgColor + Grid(), 1.0f);
-	// Uncomment all the following lines to see the 8 frequency UV areas
-	/*
-	deepBass = vec3(1.0, 0.0, 0.0);
-	bass = vec3(1.0, 0.5, 0.0);
-	mediumBass = vec3(1.0, 1.0, 0.0);
-	medium = vec3(0.5, 1.0, 0.0);
-	mediumHigh = vec3(0.0, 1.0, 0.0);
-	high = vec3(0.0, 1.0, 0.5);
-	veryHigh = vec3(0.0, 1.0, 1.0);
-	highest = vec3(0.0, 0.0, 1.0);
+#if SHOW_BANDS
 	outColor = vec4(BandsColor(), 1.0f);
-	*/
-}
\ No newline at end of file
+#else
+   	outColor = vec4(bgColor + Grid(), 1.0f);
+#endif
+}
@@ -0,0 +1,39 @@
+// Value noise and fractal brownian motion, shared by the noise bake (gridNoiseBake.frag) and the per-vertex reference shader (FFTDisplacementFBM.vert).
+// NUM_OCTAVES is a compile-time constant, so the fbm loop can be unrolled.
+
+#ifndef NUM_OCTAVES
+#define NUM_OCTAVES 5
+#endif
+
+float rand(vec2 n)
+{ 
+	return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453);
+}
+
+float noise(vec2 p)
+{
+	vec2 ip = floor(p);
+	vec2 u = fract(p);
+	u = u*u*(3.0-2.0*u);
+	
+	float res = mix(
+		mix(rand(ip),rand(ip+vec2(1.0,0.0)),u.x),
+		mix(rand(ip+vec2(0.0,1.0)),rand(ip+vec2(1.0,1.0)),u.x),u.y);
+	return res*res;
+}
+
+// Fractal brownian motion
+float fbm(vec2 x)
+{
+	float v = 0.0;
+	float a = 0.5;
+	vec2 shift = vec2(100);
+	// Rotate to reduce axial bias
+    mat2 rot = mat2(cos(0.5), sin(0.5), -sin(0.5), cos(0.5));
+	for (int i = 0; i < NUM_OCTAVES; ++i) {
+		v += a * noise(x);
+		x = (rot * x) * 2.0 + shift;
+		a *= 0.5;
+	}
+	return v;
+}
@@ -7,6 +7,8 @@ in vec2 interp_UV;
 uniform vec3 color;
 uniform int blink;
 uniform float time;
+// the outlines are emissive: values above 1 are kept in the HDR target, and they glow through the bloom
+uniform float emission;
 
 void main(){
 	vec3 startingColor = color;
@@ -25,6 +27,6 @@ void main(){
 	else
 		actualColor = startingColor;
 
-	fragColor = vec4(actualColor, 1.0);
+	fragColor = vec4(actualColor * emission, 1.0);
 	
 }
\ No newline at end of file
@@ -1,7 +1,16 @@
 #version 330 core
+
+// Permutations (see ShaderDefines):
+// INSTANCING: 1 reads the model-view matrix of each instance from the instance attributes (locations 5 to 8, see TransformInstance), for a single instanced draw of all the outlines
+#ifndef INSTANCING
+#define INSTANCING 0
+#endif
+
 layout (location = 0) in vec3 position;
 layout (location = 2) in vec2 UV;
-//layout (location = 3) in mat4 instanceMatrix;
+#if INSTANCING
+layout (location = 5) in mat4 instanceModelView;
+#endif
 
 uniform mat4 viewMatrix;
 uniform mat4 projectionMatrix;
@@ -12,5 +21,9 @@ out vec2 interp_UV;
 void main()
 {
     interp_UV = UV;
-    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0f); 
+#if INSTANCING
+    gl_Position = projectionMatrix * instanceModelView * vec4(position, 1.0f);
+#else
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0f);
+#endif
 }
\ No newline at end of file
@@ -15,20 +15,34 @@ Universita' degli Studi di Milano
 
 #version 330 core
 
+// Permutations (see ShaderDefines):
+// INSTANCING: 1 reads the model-view and normal matrices of each palm from instance attributes (locations 5 to 11, after the tangents of the Mesh, see TransformInstance), for a single instanced draw of all the palms
+#ifndef INSTANCING
+#define INSTANCING 0
+#endif
+
 // vertex position in world coordinates
 layout (location = 0) in vec3 position;
 // vertex normal in world coordinate
 layout (location = 1) in vec3 normal;
 
+#if INSTANCING
+// model-view and normal matrices of the instance (computed on the CPU by TransformStore)
+layout (location = 5) in mat4 instanceModelView;
+layout (location = 9) in mat3 instanceNormalMatrix;
+#else
 // model matrix
 uniform mat4 modelMatrix;
+#endif
 // view matrix
 uniform mat4 viewMatrix;
 // Projection matrix
 uniform mat4 projectionMatrix;
 
+#if !INSTANCING
 // normals transformation matrix (= transpose of the inverse of the model-view matrix)
 uniform mat3 normalMatrix;
+#endif
 
 // the position of the point light is passed as uniform
 // N. B.) with more lights, and of different kinds, the shader code must be modified with a for cycle, with different treatment of the source lights parameters (directions, position, cutoff angle for spot lights, etc)
@@ -47,9 +61,14 @@ out vec3 vViewPosition;
 
 void main(){
 
+#if INSTANCING
+  mat3 normalMatrix = instanceNormalMatrix;
+  vec4 mvPosition = instanceModelView * vec4( position, 1.0 );
+#else
   // vertex position in ModelView coordinate (see the last line for the application of projection)
   // when I need to use coordinates in camera coordinates, I need to split the application of model and view transformations from the projection transformations
   vec4 mvPosition = viewMatrix * modelMatrix * vec4( position, 1.0 );
+#endif
   
   // view direction, negated to have vector from the vertex to the camera
   vViewPosition = -mvPosition.xyz;
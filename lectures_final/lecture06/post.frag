@@ -0,0 +1,50 @@
+#version 330 core
+
+// Uber shader of the post-processing stack (see PostStack class): all the enabled effects are applied in this single pass
+// Permutations (generated by PostStack from the enabled effects):
+// POST_<EFFECT>: the code of the module is compiled (each module file is guarded by its define)
+// POST_FETCH: expression reading the scene at uv (the plain read of the scene and of the bloom, if not defined)
+// POST_HDR_CHAIN, POST_LDR_CHAIN: statements applied to the color before and after the tonemapping, in the order the effects are declared
+
+in vec2 interp_UV;
+
+out vec4 fragColor;
+
+// HDR scene (resolved) and bloom (see Bloom class)
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloomIntensity;
+
+// HDR color of the frame at uv: the scene with its bloom
+vec3 SceneColor(vec2 uv)
+{
+	return texture(scene, uv).rgb + texture(bloom, uv).rgb * bloomIntensity;
+}
+
+#include "postChromaticAberration.glsl"
+#include "postTonemap.glsl"
+#include "postColorGrading.glsl"
+#include "postVignette.glsl"
+#include "postScanlines.glsl"
+#include "postFilmGrain.glsl"
+
+#ifndef POST_FETCH
+#define POST_FETCH SceneColor(uv)
+#endif
+#ifndef POST_HDR_CHAIN
+#define POST_HDR_CHAIN
+#endif
+#ifndef POST_LDR_CHAIN
+#define POST_LDR_CHAIN
+#endif
+
+void main()
+{
+	vec2 uv = interp_UV;
+	vec3 color = POST_FETCH;
+	POST_HDR_CHAIN
+	// without the tonemapping, the HDR color is clipped
+	color = clamp(color, 0.0, 1.0);
+	POST_LDR_CHAIN
+	fragColor = vec4(color, 1.0);
+}
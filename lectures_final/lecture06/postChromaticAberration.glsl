@@ -0,0 +1,15 @@
+// Chromatic aberration module of the post-processing stack (see post.frag): the color channels are read at different distances from the center,
+// red outwards and blue inwards, like the lateral aberration of a cheap lens
+
+#ifdef POST_CHROMATIC_ABERRATION
+
+// offset of the red and blue channels at the corners, in UV units
+uniform float aberration;
+
+vec3 ChromaticAberration(vec2 uv)
+{
+	vec2 offset = (uv - 0.5) * aberration;
+	return vec3(SceneColor(uv + offset).r, SceneColor(uv).g, SceneColor(uv - offset).b);
+}
+
+#endif
@@ -0,0 +1,17 @@
+// Color grading module of the post-processing stack (see post.frag): the LDR color is remapped through a 3D lookup table
+
+#ifdef POST_COLOR_GRADING
+
+uniform sampler3D gradingLUT;
+// blend between the original color (0) and the graded one (1)
+uniform float gradingStrength;
+
+vec3 ColorGrading(vec3 color)
+{
+	// the centers of the first and last texels are mapped to 0 and 1
+	float size = float(textureSize(gradingLUT, 0).x);
+	vec3 graded = texture(gradingLUT, color * ((size - 1.0) / size) + 0.5 / size).rgb;
+	return mix(color, graded, gradingStrength);
+}
+
+#endif
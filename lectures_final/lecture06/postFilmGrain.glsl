@@ -0,0 +1,16 @@
+// Film grain module of the post-processing stack (see post.frag): noise changing every frame, stronger in the dark areas
+
+#ifdef POST_FILM_GRAIN
+
+uniform float grainAmount;
+// time, to change the noise every frame
+uniform float grainTime;
+
+vec3 FilmGrain(vec3 color, vec2 uv)
+{
+	float noise = fract(sin(dot(uv + fract(grainTime), vec2(12.9898, 78.233))) * 43758.5453) - 0.5;
+	float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+	return clamp(color + noise * grainAmount * (1.0 - 0.5 * luminance), 0.0, 1.0);
+}
+
+#endif
@@ -0,0 +1,15 @@
+// Scanlines module of the post-processing stack (see post.frag): dark horizontal lines, like an old CRT monitor
+
+#ifdef POST_SCANLINES
+
+// darkening of the lines, and number of lines in the frame
+uniform float scanlineAmount;
+uniform float scanlineCount;
+
+vec3 Scanlines(vec3 color, vec2 uv)
+{
+	float line = 0.5 + 0.5 * cos(uv.y * scanlineCount * 6.28318531);
+	return color * (1.0 - scanlineAmount * line);
+}
+
+#endif
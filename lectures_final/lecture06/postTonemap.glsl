@@ -0,0 +1,24 @@
+// Tonemapping module of the post-processing stack (see post.frag): filmic mapping of the HDR color to the LDR backbuffer
+
+#ifdef POST_TONEMAP
+
+// scale of the HDR values before the tonemapping
+uniform float exposure;
+
+// filmic curve (fit of the ACES reference tonemapping by K. Narkowicz): soft shoulder for the bright neon colors, instead of clipping
+vec3 ACESFilm(vec3 x)
+{
+	const float a = 2.51;
+	const float b = 0.03;
+	const float c = 2.43;
+	const float d = 0.59;
+	const float e = 0.14;
+	return clamp((x * (a * x + b)) / (x * (c * x + d) + e), 0.0, 1.0);
+}
+
+vec3 Tonemap(vec3 color)
+{
+	return ACESFilm(color * exposure);
+}
+
+#endif
@@ -0,0 +1,16 @@
+// Vignette module of the post-processing stack (see post.frag): the color is darkened towards the corners of the frame
+
+#ifdef POST_VIGNETTE
+
+// darkening at the corners, and width of the transition (as a fraction of the distance from the center)
+uniform float vignetteAmount;
+uniform float vignetteSoftness;
+
+vec3 Vignette(vec3 color, vec2 uv)
+{
+	// 1 at the corners
+	float d = length(uv - 0.5) * 1.41421356;
+	return color * (1.0 - vignetteAmount * smoothstep(1.0 - vignetteSoftness, 1.0, d));
+}
+
+#endif
@@ -8,10 +8,8 @@ uniform int explodeValue;
 
 out vec4 fragColor;
 
-float rand(vec2 n)
-{ 
-	return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453);
-}
+// rand
+#include "noise.glsl"
 
 float line(float center, float size, float edge, float coord) {
 	return max(
@@ -0,0 +1,20 @@
+#version 330 core
+
+// Powerup sphere without the geometry shader (powerUp.geom): it is used for the powerups not hit by the car.
+// The explosion of the hit powerups is a separate particle effect (see explosion.vert)
+
+layout (location = 0) in vec3 position;
+layout (location = 2) in vec2 UV;
+
+uniform mat4 viewMatrix;
+uniform mat4 projectionMatrix;
+uniform mat4 modelMatrix;
+
+// same output of powerUp.geom, read by powerUp.frag
+out vec2 i_UV;
+
+void main()
+{
+    i_UV = UV;
+    gl_Position = projectionMatrix * viewMatrix * modelMatrix * vec4(position, 1.0f);
+}
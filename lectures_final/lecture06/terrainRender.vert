@@ -0,0 +1,46 @@
+#version 330 core
+
+// Rendering of the terrain chunks from the buffers captured by the grid update pass (terrainUpdate.vert):
+// vertices are already displaced, in world coordinates.
+
+// displaced vertex position in world coordinates
+layout (location = 0) in vec3 position;
+// normal of the displaced surface in world coordinates
+layout (location = 1) in vec3 normal;
+// UV coordinates for the neon lines
+layout (location = 2) in vec2 UV;
+
+// view matrix
+uniform mat4 viewMatrix;
+// Projection matrix
+uniform mat4 projectionMatrix;
+// normal matrix (the model matrix is the identity)
+uniform mat3 normalMatrix;
+
+uniform vec3 pointLightPosition;
+
+// Interpolated UV coordinates to pass to the fragment shader
+out vec2 interp_UV;
+
+out vec3 lightDir;
+out vec3 vNormal;
+out vec3 vViewPosition;
+out vec3 vPosition;
+
+void main()
+{
+	vPosition = position;
+	
+	vec4 modelView = viewMatrix * vec4(position, 1.0);
+	
+	vViewPosition = -modelView.xyz;
+	// transformations are applied to the normal
+	vNormal = normalize( normalMatrix * normal );
+
+	// light incidence direction (in view coordinate)
+	vec4 lightPos = viewMatrix  * vec4(pointLightPosition, 1.0);
+	lightDir = lightPos.xyz - modelView.xyz;
+	
+	interp_UV = UV;
+	gl_Position = projectionMatrix * modelView;
+}
@@ -0,0 +1,76 @@
+#version 330 core
+
+// Grid update pass: the displaced vertices of a terrain chunk are captured with Transform Feedback (no rasterization),
+// then all the grid draws use the captured buffer (see terrainRender.vert).
+
+// vertex position in model coordinates (the chunk is centered in the origin)
+layout (location = 0) in vec3 position;
+// UV texture coordinates inside the chunk
+layout (location = 2) in vec2 UV;
+
+// model matrix (translation of the chunk)
+uniform mat4 modelMatrix;
+
+// frequency bands (BandValue): each band length is divided in one zone for each band
+#include "bands.glsl"
+
+uniform float dPower;
+uniform float streetSize;
+uniform float fade;
+
+// fbm noise baked by the Terrain class when the chunk was spawned
+uniform sampler2D chunkNoise;
+// texels of the noise texture covering the chunk: the first and last ones lie exactly on the chunk edges
+uniform vec2 noiseResolution;
+// texels baked past each edge of the chunk (the noise of the neighbouring chunks), so the normals at the edges match theirs
+uniform float noiseBorder;
+// rows of the grid in the chunk
+uniform float chunkRows;
+// the eight frequency band zones are fixed in world space: they repeat every bandLength units, starting from bandOrigin
+uniform float bandLength;
+uniform float bandOrigin;
+// distance between two vertices of the chunk mesh in UV, and size of the chunk in world units (used for the normals)
+uniform vec2 cellSize;
+uniform vec2 chunkSize;
+
+// captured outputs
+// displaced vertex position in world coordinates
+out vec3 worldPosition;
+// normal of the displaced surface in world coordinates
+out vec3 worldNormal;
+// UV for the neon lines of the fragment shader
+out vec2 gridUV;
+
+// vertical displacement of the grid at the given chunk UV and world Z
+float Height(vec2 uv, float worldZ)
+{
+	// the noise has been computed once for the whole chunk, we just fetch it
+	// uv outside [0,1] (the next vertices at the far edges) reads the border texels
+	vec2 noiseUV = (uv * (noiseResolution - 1.0) + noiseBorder + 0.5) / (noiseResolution + 2.0 * noiseBorder);
+	float noised = textureLod(chunkNoise, noiseUV, 0.0).r;
+	
+	// we add the street space into the grid by smoothing the noise
+	noised *= 1.0 - (smoothstep(0.5 - streetSize - fade, 0.5 - streetSize, uv.x) 
+				- smoothstep(0.5 + streetSize, 0.5 + streetSize + fade, uv.x));
+	
+	// audio modulation, the only per-frame part of the displacement
+	float bandV = fract((worldZ - bandOrigin) / bandLength);
+	return (noised * BandValue(bandV)) * dPower;
+}
+
+void main()
+{
+	vec3 world = (modelMatrix * vec4(position, 1.0)).xyz;
+	float h = Height(UV, world.z);
+	
+	// normal from the heights of the next vertices along U (+X) and V (+Z)
+	vec3 stepX = vec3(cellSize.x * chunkSize.x, 0.0, 0.0);
+	vec3 stepZ = vec3(0.0, 0.0, cellSize.y * chunkSize.y);
+	stepX.y = Height(UV + vec2(cellSize.x, 0.0), world.z) - h;
+	stepZ.y = Height(UV + vec2(0.0, cellSize.y), world.z + stepZ.z) - h;
+	
+	worldPosition = world + vec3(0.0, h, 0.0);
+	worldNormal = normalize(cross(stepZ, stepX));
+	// the fragment shader draws a line every 1/99 of UV: we scale V so that lines fall on the chunk rows
+	gridUV = vec2(UV.x, UV.y * chunkRows / 99.0);
+}